@@ -0,0 +1,226 @@
+/**
+ * Copyright (C) 2020  Evgeny Zinoviev
+ * This file is part of isv <https://github.com/gch1p/isv>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "cache.h"
+#include "query.h"
+#include "p18.h"
+#include "util.h"
+
+/*
+ * Validated raw responses to get queries, keyed by the device and the built
+ * command string, so that e.g. ^P009EY2020 and ^P009EY2019 are cached
+ * separately. Only useful in long-running modes, where the same queries are
+ * asked over and over. Safe to use from several threads.
+ */
+
+#define CACHE_QUERY_INDEX(key) ((key) - P18_QUERY_CMDS_ENUM_OFFSET)
+#define CACHE_QUERY_BIT(key)   ((uint32_t)1 << CACHE_QUERY_INDEX(key))
+#define CACHE_ALL              UINT32_MAX
+
+#define CACHE_TTL(key, ttl) \
+    [CACHE_QUERY_INDEX(key)] = (ttl)
+
+#define CACHE_INVALIDATES(key, mask) \
+    [(key) - P18_SET_CMDS_ENUM_OFFSET] = (mask)
+
+typedef struct {
+    bool used;
+    voltronic_dev_t dev;
+    int command_key;
+    unsigned long long time;
+    char command[COMMAND_BUF_LENGTH];
+    char response[RESPONSE_BUF_LENGTH];
+    size_t size;
+} cache_entry_t;
+
+/* queries not listed here, like GS and PGS, are not cached by default */
+static unsigned int cache_ttls[P18_SET_CMDS_ENUM_OFFSET - P18_QUERY_CMDS_ENUM_OFFSET] = {
+    CACHE_TTL(P18_QUERY_PROTOCOL_ID,                               CACHE_TTL_STATIC),
+    CACHE_TTL(P18_QUERY_TOTAL_GENERATED,                           CACHE_TTL_COUNTER),
+    CACHE_TTL(P18_QUERY_YEAR_GENERATED,                            CACHE_TTL_COUNTER),
+    CACHE_TTL(P18_QUERY_MONTH_GENERATED,                           CACHE_TTL_COUNTER),
+    CACHE_TTL(P18_QUERY_DAY_GENERATED,                             CACHE_TTL_COUNTER),
+    CACHE_TTL(P18_QUERY_SERIES_NUMBER,                             CACHE_TTL_STATIC),
+    CACHE_TTL(P18_QUERY_CPU_VERSION,                               CACHE_TTL_STATIC),
+    CACHE_TTL(P18_QUERY_RATED_INFORMATION,                         CACHE_TTL_STATIC),
+    CACHE_TTL(P18_QUERY_FLAGS_STATUSES,                            CACHE_TTL_STATIC),
+    CACHE_TTL(P18_QUERY_DEFAULTS,                                  CACHE_TTL_STATIC),
+    CACHE_TTL(P18_QUERY_MAX_CHARGING_CURRENT_SELECTABLE_VALUES,    CACHE_TTL_STATIC),
+    CACHE_TTL(P18_QUERY_MAX_AC_CHARGING_CURRENT_SELECTABLE_VALUES, CACHE_TTL_STATIC),
+    CACHE_TTL(P18_QUERY_PARALLEL_RATED_INFORMATION,                CACHE_TTL_STATIC),
+    CACHE_TTL(P18_QUERY_AC_CHARGE_TIME_BUCKET,                     CACHE_TTL_STATIC),
+    CACHE_TTL(P18_QUERY_AC_SUPPLY_LOAD_TIME_BUCKET,                CACHE_TTL_STATIC),
+};
+
+#define CACHE_RATED (CACHE_QUERY_BIT(P18_QUERY_RATED_INFORMATION) \
+                     | CACHE_QUERY_BIT(P18_QUERY_PARALLEL_RATED_INFORMATION))
+
+#define CACHE_GENERATED (CACHE_QUERY_BIT(P18_QUERY_TOTAL_GENERATED) \
+                         | CACHE_QUERY_BIT(P18_QUERY_YEAR_GENERATED) \
+                         | CACHE_QUERY_BIT(P18_QUERY_MONTH_GENERATED) \
+                         | CACHE_QUERY_BIT(P18_QUERY_DAY_GENERATED))
+
+/* which cached queries each set command affects; anything not listed here
+   flushes the whole cache */
+static const uint32_t cache_invalidates[] = {
+    CACHE_INVALIDATES(P18_SET_LOADS,                                   CACHE_QUERY_BIT(P18_QUERY_GENERAL_STATUS)),
+    CACHE_INVALIDATES(P18_SET_FLAG,                                    CACHE_QUERY_BIT(P18_QUERY_FLAGS_STATUSES)),
+    CACHE_INVALIDATES(P18_SET_DEFAULTS,                                CACHE_ALL),
+    CACHE_INVALIDATES(P18_SET_BAT_MAX_CHARGE_CURRENT,                  CACHE_RATED),
+    CACHE_INVALIDATES(P18_SET_BAT_MAX_AC_CHARGE_CURRENT,               CACHE_RATED),
+    CACHE_INVALIDATES(P18_SET_AC_OUTPUT_FREQ,                          CACHE_RATED),
+    CACHE_INVALIDATES(P18_SET_BAT_MAX_CHARGE_VOLTAGE,                  CACHE_RATED),
+    CACHE_INVALIDATES(P18_SET_AC_OUTPUT_RATED_VOLTAGE,                 CACHE_RATED),
+    CACHE_INVALIDATES(P18_SET_OUTPUT_SOURCE_PRIORITY,                  CACHE_RATED),
+    CACHE_INVALIDATES(P18_SET_BAT_CHARGING_THRESHOLDS_WHEN_UTILITY_AVAIL, CACHE_RATED),
+    CACHE_INVALIDATES(P18_SET_CHARGING_SOURCE_PRIORITY,                CACHE_RATED),
+    CACHE_INVALIDATES(P18_SET_SOLAR_POWER_PRIORITY,                    CACHE_RATED),
+    CACHE_INVALIDATES(P18_SET_AC_INPUT_VOLTAGE_RANGE,                  CACHE_RATED),
+    CACHE_INVALIDATES(P18_SET_BAT_TYPE,                                CACHE_RATED),
+    CACHE_INVALIDATES(P18_SET_OUTPUT_MODEL,                            CACHE_RATED),
+    CACHE_INVALIDATES(P18_SET_BAT_CUTOFF_VOLTAGE,                      CACHE_RATED),
+    CACHE_INVALIDATES(P18_SET_SOLAR_CONFIG,                            CACHE_RATED),
+    CACHE_INVALIDATES(P18_SET_CLEAR_GENERATED,                         CACHE_GENERATED),
+    CACHE_INVALIDATES(P18_SET_DATE_TIME,                               CACHE_QUERY_BIT(P18_QUERY_CURRENT_TIME) | CACHE_GENERATED),
+    CACHE_INVALIDATES(P18_SET_AC_CHARGE_TIME_BUCKET,                   CACHE_QUERY_BIT(P18_QUERY_AC_CHARGE_TIME_BUCKET)),
+    CACHE_INVALIDATES(P18_SET_AC_SUPPLY_LOAD_TIME_BUCKET,              CACHE_QUERY_BIT(P18_QUERY_AC_SUPPLY_LOAD_TIME_BUCKET)),
+};
+
+static cache_entry_t cache[CACHE_SIZE];
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned int cache_ttl(int command_key)
+{
+    int index = CACHE_QUERY_INDEX(command_key);
+    if (index < 0 || index >= (int)ARRAY_SIZE(cache_ttls))
+        return 0;
+    return cache_ttls[index];
+}
+
+void cache_set_ttl(int command_key, unsigned int ttl)
+{
+    int index = CACHE_QUERY_INDEX(command_key);
+    if (index >= 0 && index < (int)ARRAY_SIZE(cache_ttls))
+        cache_ttls[index] = ttl;
+}
+
+/* Copies a cached response to buf if there's a fresh one. */
+bool cache_get(voltronic_dev_t dev, int command_key, const char *command, char *buf, size_t bufsize, size_t *received)
+{
+    unsigned int ttl = cache_ttl(command_key);
+    bool found = false;
+    if (!ttl)
+        return false;
+
+    unsigned long long now = monotonic_ms();
+    pthread_mutex_lock(&cache_mutex);
+    for (size_t i = 0; i < ARRAY_SIZE(cache); i++) {
+        cache_entry_t *e = &cache[i];
+        if (!e->used
+            || e->dev != dev
+            || e->command_key != command_key
+            || strcmp(e->command, command) != 0)
+            continue;
+
+        if (now - e->time >= ttl || e->size > bufsize) {
+            e->used = false;
+            break;
+        }
+
+        memcpy(buf, e->response, e->size);
+        *received = e->size;
+        found = true;
+        break;
+    }
+    pthread_mutex_unlock(&cache_mutex);
+
+    if (found)
+        LOG("%s: using cached response to %s\n", __func__, command);
+    return found;
+}
+
+void cache_put(voltronic_dev_t dev, int command_key, const char *command, const char *response, size_t size)
+{
+    if (!cache_ttl(command_key)
+        || size > RESPONSE_BUF_LENGTH
+        || strlen(command) >= COMMAND_BUF_LENGTH)
+        return;
+
+    pthread_mutex_lock(&cache_mutex);
+
+    /* reuse the entry for the same command, a free one, or the oldest one */
+    cache_entry_t *slot = NULL;
+    for (size_t i = 0; i < ARRAY_SIZE(cache); i++) {
+        cache_entry_t *e = &cache[i];
+        if (e->used && e->dev == dev && !strcmp(e->command, command)) {
+            slot = e;
+            break;
+        }
+        if (slot == NULL || (slot->used && (!e->used || e->time < slot->time)))
+            slot = e;
+    }
+
+    slot->used = true;
+    slot->dev = dev;
+    slot->command_key = command_key;
+    slot->time = monotonic_ms();
+    strcpy(slot->command, command);
+    memcpy(slot->response, response, size);
+    slot->size = size;
+
+    pthread_mutex_unlock(&cache_mutex);
+}
+
+void cache_invalidate(voltronic_dev_t dev, int set_command_key)
+{
+    uint32_t mask = 0;
+    int index = set_command_key - P18_SET_CMDS_ENUM_OFFSET;
+    if (index >= 0 && index < (int)ARRAY_SIZE(cache_invalidates))
+        mask = cache_invalidates[index];
+    if (!mask)
+        mask = CACHE_ALL;
+
+    pthread_mutex_lock(&cache_mutex);
+    for (size_t i = 0; i < ARRAY_SIZE(cache); i++) {
+        cache_entry_t *e = &cache[i];
+        if (e->used && e->dev == dev && (mask & CACHE_QUERY_BIT(e->command_key)))
+            e->used = false;
+    }
+    pthread_mutex_unlock(&cache_mutex);
+}
+
+void cache_forget(voltronic_dev_t dev)
+{
+    pthread_mutex_lock(&cache_mutex);
+    for (size_t i = 0; i < ARRAY_SIZE(cache); i++) {
+        if (cache[i].dev == dev)
+            cache[i].used = false;
+    }
+    pthread_mutex_unlock(&cache_mutex);
+}
+
+void cache_clear(void)
+{
+    pthread_mutex_lock(&cache_mutex);
+    memset(cache, 0, sizeof(cache));
+    pthread_mutex_unlock(&cache_mutex);
+}
@@ -0,0 +1,42 @@
+/**
+ * Copyright (C) 2020  Evgeny Zinoviev
+ * This file is part of isv <https://github.com/gch1p/isv>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ISV_CACHE_H
+#define ISV_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "libvoltronic/voltronic_dev.h"
+
+#define CACHE_SIZE          32
+
+/* default TTLs, in milliseconds */
+#define CACHE_TTL_STATIC    60000 /* changes only on reconfiguration */
+#define CACHE_TTL_COUNTER   10000 /* energy counters */
+
+void cache_set_ttl(int command_key, unsigned int ttl);
+bool cache_get(voltronic_dev_t dev, int command_key, const char *command, char *buf, size_t bufsize, size_t *received);
+void cache_put(voltronic_dev_t dev, int command_key, const char *command, const char *response, size_t size);
+void cache_invalidate(voltronic_dev_t dev, int set_command_key);
+/* drops the entries of a device that's being closed, another one may be
+   opened at the same address */
+void cache_forget(voltronic_dev_t dev);
+void cache_clear(void);
+
+#endif //ISV_CACHE_H
@@ -0,0 +1,158 @@
+/**
+ * Copyright (C) 2020  Evgeny Zinoviev
+ * This file is part of isv <https://github.com/gch1p/isv>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+
+#include "daemon.h"
+#include "query.h"
+#include "device.h"
+#include "util.h"
+
+static volatile sig_atomic_t stop = 0;
+
+static void daemon_signal_handler(int signo)
+{
+    UNUSED(signo);
+    stop = 1;
+}
+
+void daemon_install_signal_handlers(void)
+{
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = daemon_signal_handler;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+}
+
+bool daemon_stopping(void)
+{
+    return stop != 0;
+}
+
+int daemon_run(daemon_task_t *tasks,
+               size_t tasks_count,
+               daemon_open_fn_t open_device,
+               int timeout,
+               print_format_t format,
+               record_t *record)
+{
+    voltronic_dev_t dev = NULL;
+    unsigned int failures = 0;
+    int ret = 0;
+    unsigned long long now = monotonic_ms();
+
+    for (size_t i = 0; i < tasks_count; i++) {
+        tasks[i].next = now;
+        query_section_name(&tasks[i].request, tasks[i].section, sizeof(tasks[i].section));
+    }
+
+    daemon_install_signal_handlers();
+
+    while (!stop) {
+        if (dev == NULL) {
+            dev = open_device();
+            if (dev == NULL) {
+                ERROR("could not open device: %s, retrying in %d ms\n",
+                      strerror(errno), DAEMON_REOPEN_INTERVAL);
+                sleep_ms(DAEMON_REOPEN_INTERVAL);
+                continue;
+            }
+            LOG("%s: device opened\n", __func__);
+            failures = 0;
+        }
+
+        now = monotonic_ms();
+
+        unsigned long long next = tasks[0].next;
+        for (size_t i = 1; i < tasks_count; i++) {
+            if (tasks[i].next < next)
+                next = tasks[i].next;
+        }
+        if (next > now) {
+            sleep_until_ms(next);
+            continue;
+        }
+
+        bool reopen = false;
+        if (record == NULL) {
+            print_begin(format);
+            if (print_stamps_samples(format)) {
+                print_section("sample", format);
+                print_sample_clock(realtime_ms(), now, format);
+            }
+        }
+        for (size_t i = 0; i < tasks_count && !reopen && !stop; i++) {
+            daemon_task_t *task = &tasks[i];
+            if (task->next > now)
+                continue;
+
+            int key = task->request.command_key;
+            const char **args = (const char **)task->request.args;
+            int result;
+
+            if (record != NULL) {
+                char buf[RESPONSE_BUF_LENGTH];
+                size_t received;
+                result = query_fetch(dev, key, timeout, args, QUERY_MAX_ARGS,
+                                     false, format, buf, sizeof(buf), &received);
+                if (result == QUERY_OK && record_write(record, key, args, buf+5) == -1) {
+                    ret = 1;
+                    stop = 1;
+                }
+            } else {
+                print_section(task->section, format);
+                result = query(dev, key, timeout, args, QUERY_MAX_ARGS, false,
+                               task->request.fields, format);
+            }
+
+            /* keep the schedule aligned to the original deadlines,
+               but don't try to catch up on missed runs */
+            task->next += task->interval;
+            if (task->next <= now)
+                task->next = now + task->interval;
+
+            if (result == QUERY_OK) {
+                failures = 0;
+            } else if (result == QUERY_ERR_COMM) {
+                if (query_is_device_error(errno) || ++failures >= DAEMON_MAX_FAILURES)
+                    reopen = true;
+            }
+        }
+        if (record == NULL)
+            print_end(format);
+
+        if (reopen) {
+            ERROR("reopening device\n");
+            /* it may come back as a different device */
+            device_close(dev);
+            dev = NULL;
+        }
+    }
+
+    if (dev != NULL)
+        device_close(dev);
+
+    return ret;
+}
@@ -0,0 +1,57 @@
+/**
+ * Copyright (C) 2020  Evgeny Zinoviev
+ * This file is part of isv <https://github.com/gch1p/isv>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ISV_DAEMON_H
+#define ISV_DAEMON_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "print.h"
+#include "query.h"
+#include "record.h"
+#include "libvoltronic/voltronic_dev.h"
+
+#define DAEMON_MAX_TASKS        32
+#define DAEMON_REOPEN_INTERVAL  1000 /* ms */
+#define DAEMON_MAX_FAILURES     3    /* consecutive failures before reopening */
+
+typedef struct {
+    query_request_t request;
+    char buf[QUERY_LINE_LENGTH]; /* request.args point here */
+    unsigned int interval;   /* ms */
+    unsigned long long next; /* managed by daemon_run() */
+    char section[QUERY_LINE_LENGTH]; /* managed by daemon_run() */
+} daemon_task_t;
+
+typedef voltronic_dev_t (*daemon_open_fn_t)(void);
+
+/* SIGINT and SIGTERM make daemon_stopping() return true */
+void daemon_install_signal_handlers(void);
+bool daemon_stopping(void);
+
+/* Runs tasks until interrupted. If record is not NULL, samples are appended
+   to it instead of being printed. */
+int daemon_run(daemon_task_t *tasks,
+               size_t tasks_count,
+               daemon_open_fn_t open_device,
+               int timeout,
+               print_format_t format,
+               record_t *record);
+
+#endif //ISV_DAEMON_H
@@ -0,0 +1,165 @@
+/**
+ * Copyright (C) 2020  Evgeny Zinoviev
+ * This file is part of isv <https://github.com/gch1p/isv>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "delta.h"
+#include "util.h"
+
+typedef struct {
+    char name[DELTA_KEY_LENGTH * 2]; /* context.key */
+    bool printed;
+    variant_t value;
+    char s[DELTA_STRING_LENGTH];     /* copy of value.s */
+} delta_item_t;
+
+typedef struct {
+    char key[DELTA_KEY_LENGTH];
+    double deadband;
+} delta_deadband_t;
+
+static bool enabled = false;
+
+static delta_item_t items_seen[DELTA_MAX_ITEMS];
+static size_t items_seen_count = 0;
+
+static delta_deadband_t deadbands[DELTA_MAX_DEADBANDS];
+static size_t deadbands_count = 0;
+
+void delta_enable(void)
+{
+    enabled = true;
+}
+
+bool delta_enabled(void)
+{
+    return enabled;
+}
+
+bool delta_set_deadband(const char *key, double deadband)
+{
+    if (strlen(key) >= DELTA_KEY_LENGTH)
+        return false;
+
+    for (size_t i = 0; i < deadbands_count; i++) {
+        if (!strcmp(deadbands[i].key, key)) {
+            deadbands[i].deadband = deadband;
+            return true;
+        }
+    }
+
+    if (deadbands_count >= ARRAY_SIZE(deadbands))
+        return false;
+
+    strcpy(deadbands[deadbands_count].key, key);
+    deadbands[deadbands_count].deadband = deadband;
+    deadbands_count++;
+    return true;
+}
+
+static double delta_deadband(const char *key)
+{
+    for (size_t i = 0; i < deadbands_count; i++) {
+        if (!strcmp(deadbands[i].key, key))
+            return deadbands[i].deadband;
+    }
+    return 0;
+}
+
+static delta_item_t *delta_find(const char *name, bool create)
+{
+    for (size_t i = 0; i < items_seen_count; i++) {
+        if (!strcmp(items_seen[i].name, name))
+            return &items_seen[i];
+    }
+
+    if (!create || items_seen_count >= ARRAY_SIZE(items_seen))
+        return NULL;
+
+    delta_item_t *item = &items_seen[items_seen_count++];
+    strcpy(item->name, name);
+    item->printed = false;
+    return item;
+}
+
+static bool delta_exceeds(double diff, double deadband)
+{
+    return (diff < 0 ? -diff : diff) > deadband;
+}
+
+static bool delta_changed(const delta_item_t *prev, variant_t value, double deadband)
+{
+    if (!prev->printed || prev->value.type != value.type)
+        return true;
+
+    switch (value.type) {
+        case VARIANT_TYPE_STRING:
+            return strcmp(prev->s, value.s) != 0;
+        case VARIANT_TYPE_LONG:
+            return delta_exceeds((double)value.l - (double)prev->value.l, deadband);
+        case VARIANT_TYPE_DOUBLE:
+            return delta_exceeds(value.d - prev->value.d, deadband);
+        case VARIANT_TYPE_FIXED:
+            if (value.scale != prev->value.scale)
+                return true;
+            return delta_exceeds((double)value.l - (double)prev->value.l,
+                                 deadband * variant_fixed_divisor(value.scale));
+        case VARIANT_TYPE_BOOL:
+        case VARIANT_TYPE_FLAG:
+            return value.b != prev->value.b;
+    }
+
+    return true;
+}
+
+/* Leaves in the list of indices only items that changed since the last
+   time, remembering their values. Items are told apart by their keys within
+   the context, which is the section name. Returns the new list size. */
+size_t delta_filter(const char *context,
+                    const print_field_t *fields,
+                    const variant_t *values,
+                    unsigned char *list,
+                    size_t count)
+{
+    char name[DELTA_KEY_LENGTH * 2];
+    size_t changed = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        const print_field_t *field = &fields[list[i]];
+        const variant_t *value = &values[list[i]];
+        snprintf(name, sizeof(name), "%s.%s", context != NULL ? context : "", field->key);
+
+        delta_item_t *prev = delta_find(name, true);
+        if (prev != NULL && !delta_changed(prev, *value, delta_deadband(field->key)))
+            continue;
+
+        list[changed++] = list[i];
+        if (prev == NULL)
+            continue;
+
+        prev->printed = true;
+        prev->value = *value;
+        if (variant_is_string(*value)) {
+            snprintf(prev->s, sizeof(prev->s), "%s", value->s);
+            prev->value.s = prev->s;
+        }
+    }
+
+    return changed;
+}
@@ -0,0 +1,45 @@
+/**
+ * Copyright (C) 2020  Evgeny Zinoviev
+ * This file is part of isv <https://github.com/gch1p/isv>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ISV_DELTA_H
+#define ISV_DELTA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "print.h"
+
+#define DELTA_MAX_ITEMS      512
+#define DELTA_MAX_DEADBANDS  32
+#define DELTA_KEY_LENGTH     64
+#define DELTA_STRING_LENGTH  64
+
+/* In delta mode, only items that changed since they were last printed are
+   printed, so in JSON formats every output is a merge patch (RFC 7396) to the
+   previous state. Numeric items can have a deadband: they're considered
+   changed only if they differ from the last printed value by more than that. */
+void delta_enable(void);
+bool delta_enabled(void);
+bool delta_set_deadband(const char *key, double deadband);
+size_t delta_filter(const char *context,
+                    const print_field_t *fields,
+                    const variant_t *values,
+                    unsigned char *list,
+                    size_t count);
+
+#endif //ISV_DELTA_H
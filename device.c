@@ -0,0 +1,249 @@
+/**
+ * Copyright (C) 2020  Evgeny Zinoviev
+ * This file is part of isv <https://github.com/gch1p/isv>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "device.h"
+#include "query.h"
+#include "cache.h"
+#include "p18.h"
+#include "util.h"
+#include "libvoltronic/voltronic_dev_usb.h"
+#include "libvoltronic/voltronic_dev_serial.h"
+#include "libvoltronic/voltronic_dev_tcp.h"
+
+#define DEVICE_STRING_LENGTH 128
+
+typedef struct {
+    char path[DEVICE_STRING_LENGTH];
+    char serial[DEVICE_STRING_LENGTH];
+    char manufacturer[DEVICE_STRING_LENGTH];
+    char product[DEVICE_STRING_LENGTH];
+} device_info_t;
+
+typedef struct {
+    device_info_t list[DEVICE_MAX];
+    size_t count;
+} device_info_list_t;
+
+static void device_copy(char *dst, const char *src)
+{
+    snprintf(dst, DEVICE_STRING_LENGTH, "%s", src);
+}
+
+static void device_enumerate_cb(const char *path,
+                                const char *serial,
+                                const char *manufacturer,
+                                const char *product,
+                                void *ctx)
+{
+    device_info_list_t *devices = (device_info_list_t *)ctx;
+    if (devices->count == ARRAY_SIZE(devices->list))
+        return;
+
+    device_info_t *info = &devices->list[devices->count++];
+    device_copy(info->path, path);
+    device_copy(info->serial, serial);
+    device_copy(info->manufacturer, manufacturer);
+    device_copy(info->product, product);
+}
+
+static void device_enumerate(device_info_list_t *devices)
+{
+    devices->count = 0;
+    voltronic_usb_enumerate(DEVICE_VENDOR_ID, DEVICE_PRODUCT_ID,
+                            device_enumerate_cb, devices);
+}
+
+/* Asks the device for its series number, sn must be at least as big as
+   p18_series_number_msg_t.id. The cache is bypassed, as device_open() is
+   also used by libisv, which shares nothing with the rest of the process. */
+static bool device_series_number(voltronic_dev_t dev, int timeout, char *sn)
+{
+    char buf[RESPONSE_BUF_LENGTH];
+    char error[QUERY_ERROR_LENGTH];
+    char command[COMMAND_BUF_LENGTH];
+    p18_frame_t frame_buf;
+    size_t received, data_size;
+
+    const p18_frame_t *frame = query_prepare(P18_QUERY_SERIES_NUMBER, NULL, 0, &frame_buf,
+                                             command, error, sizeof(error));
+    if (frame == NULL
+        || query_transfer(dev, P18_QUERY_SERIES_NUMBER, frame, command, timeout,
+                          buf, sizeof(buf), &received,
+                          error, sizeof(error)) != QUERY_OK) {
+        LOG("%s: %s\n", __func__, error);
+        return false;
+    }
+
+    if (!p18_validate_query_response(buf, received, &data_size)) {
+        LOG("%s: invalid response\n", __func__);
+        return false;
+    }
+
+    p18_series_number_msg_t m = p18_unpack_series_number_msg(buf+5);
+    strcpy(sn, m.id);
+    return true;
+}
+
+/* Opens every device found until one reports the series number sn. */
+static voltronic_dev_t device_open_sn(const char *sn, int timeout)
+{
+    device_info_list_t devices;
+    char id[sizeof(((p18_series_number_msg_t *)0)->id)];
+
+    device_enumerate(&devices);
+    for (size_t i = 0; i < devices.count; i++) {
+        voltronic_dev_t dev = voltronic_usb_create_path(devices.list[i].path);
+        if (!dev) {
+            LOG("%s: could not open %s: %s\n", __func__, devices.list[i].path, strerror(errno));
+            continue;
+        }
+
+        if (device_series_number(dev, timeout, id) && !strcmp(id, sn))
+            return dev;
+
+        device_close(dev);
+    }
+
+    errno = ENODEV;
+    return 0;
+}
+
+/* Opens an RS-232 port, spec is PORT or PORT:BAUD. */
+static voltronic_dev_t device_open_tty(const char *spec)
+{
+    char port[DEVICE_STRING_LENGTH];
+    baud_rate_t baud = DEVICE_SERIAL_BAUD;
+
+    if (strlen(spec) >= sizeof(port)) {
+        errno = ENAMETOOLONG;
+        return 0;
+    }
+    strcpy(port, spec);
+
+    char *colon = strrchr(port, ':');
+    if (colon != NULL && colon[1] != '\0' && isnumeric(colon + 1)) {
+        baud = (baud_rate_t)strtoul(colon + 1, NULL, 10);
+        *colon = '\0';
+    }
+
+    return voltronic_serial_create(port, baud, DATA_BITS_EIGHT, STOP_BITS_ONE, SERIAL_PARITY_NONE);
+}
+
+/* Connects to a serial-to-Ethernet bridge, spec is HOST:PORT, an IPv6
+   address can be in brackets. */
+static voltronic_dev_t device_open_tcp(const char *spec, int timeout)
+{
+    char host[DEVICE_STRING_LENGTH];
+
+    if (strlen(spec) >= sizeof(host)) {
+        errno = ENAMETOOLONG;
+        return 0;
+    }
+    strcpy(host, spec);
+
+    char *colon = strrchr(host, ':');
+    if (colon == NULL || colon == host || colon[1] == '\0') {
+        errno = EINVAL;
+        return 0;
+    }
+    *colon = '\0';
+
+    char *name = host;
+    size_t len = strlen(name);
+    if (name[0] == '[' && name[len-1] == ']') {
+        name[len-1] = '\0';
+        name++;
+    }
+
+    return voltronic_tcp_create(name, colon + 1, (unsigned int)timeout);
+}
+
+/*
+ * Opens the device described by spec:
+ *     NULL          the first device found
+ *     /dev/hidraw0  device at the path, as printed by --list-devices
+ *     serial:XXX    device with USB serial number XXX
+ *     sn:XXX        device whose series number (--get-series-number) is XXX
+ *     tty:PORT:BAUD inverter connected to an RS-232 port, BAUD is optional
+ *     tcp:HOST:PORT inverter behind a serial-to-Ethernet bridge
+ */
+voltronic_dev_t device_open(const char *spec, int timeout)
+{
+    if (spec == NULL)
+        return voltronic_usb_create(DEVICE_VENDOR_ID, DEVICE_PRODUCT_ID);
+
+    if (!strncmp(spec, DEVICE_SPEC_SERIAL, strlen(DEVICE_SPEC_SERIAL)))
+        return voltronic_usb_create_serial(DEVICE_VENDOR_ID, DEVICE_PRODUCT_ID,
+                                           spec + strlen(DEVICE_SPEC_SERIAL));
+
+    if (!strncmp(spec, DEVICE_SPEC_SN, strlen(DEVICE_SPEC_SN)))
+        return device_open_sn(spec + strlen(DEVICE_SPEC_SN), timeout);
+
+    if (!strncmp(spec, DEVICE_SPEC_TTY, strlen(DEVICE_SPEC_TTY)))
+        return device_open_tty(spec + strlen(DEVICE_SPEC_TTY));
+
+    if (!strncmp(spec, DEVICE_SPEC_TCP, strlen(DEVICE_SPEC_TCP)))
+        return device_open_tcp(spec + strlen(DEVICE_SPEC_TCP), timeout);
+
+    return voltronic_usb_create_path(spec);
+}
+
+void device_close(voltronic_dev_t dev)
+{
+    cache_forget(dev);
+    voltronic_dev_close(dev);
+}
+
+/* Prints every device found, along with its series number if it answers. */
+int device_list(int timeout, print_format_t format)
+{
+    device_info_list_t devices;
+    char sn[sizeof(((p18_series_number_msg_t *)0)->id)];
+
+    device_enumerate(&devices);
+    if (!devices.count) {
+        ERROR("no devices found\n");
+        return QUERY_OK;
+    }
+
+    print_begin(format);
+    for (size_t i = 0; i < devices.count; i++) {
+        device_info_t *info = &devices.list[i];
+        bool have_sn = false;
+
+        voltronic_dev_t dev = voltronic_usb_create_path(info->path);
+        if (dev) {
+            have_sn = device_series_number(dev, timeout, sn);
+            device_close(dev);
+        } else {
+            LOG("%s: could not open %s: %s\n", __func__, info->path, strerror(errno));
+        }
+
+        print_section(info->path, format);
+        print_device(info->path, info->serial, info->manufacturer, info->product,
+                     have_sn ? sn : NULL, format);
+    }
+    print_end(format);
+
+    return QUERY_OK;
+}
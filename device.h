@@ -0,0 +1,49 @@
+/**
+ * Copyright (C) 2020  Evgeny Zinoviev
+ * This file is part of isv <https://github.com/gch1p/isv>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ISV_DEVICE_H
+#define ISV_DEVICE_H
+
+#include <stddef.h>
+
+#include "print.h"
+#include "libvoltronic/voltronic_dev.h"
+
+#define DEVICE_VENDOR_ID   0x0665
+#define DEVICE_PRODUCT_ID  0x5161
+#define DEVICE_MAX         64
+
+/* prefixes of --device specs */
+#define DEVICE_SPEC_SERIAL "serial:" /* USB serial number */
+#define DEVICE_SPEC_SN     "sn:"     /* inverter's series number */
+#define DEVICE_SPEC_TTY    "tty:"    /* RS-232 port, optionally followed by :BAUD */
+#define DEVICE_SPEC_TCP    "tcp:"    /* HOST:PORT of a serial-to-Ethernet bridge */
+
+#define DEVICE_SERIAL_BAUD 2400
+
+typedef struct {
+    voltronic_dev_t dev;
+    const char *name; /* prefixes section names when several devices are used */
+} device_t;
+
+voltronic_dev_t device_open(const char *spec, int timeout);
+/* closes a device opened by device_open(), and forgets its cached responses */
+void device_close(voltronic_dev_t dev);
+int device_list(int timeout, print_format_t format);
+
+#endif //ISV_DEVICE_H
@@ -0,0 +1,340 @@
+/**
+ * Copyright (C) 2020  Evgeny Zinoviev
+ * This file is part of isv <https://github.com/gch1p/isv>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/epoll.h>
+#else
+#include <poll.h>
+#endif
+
+#include "engine.h"
+#include "cache.h"
+#include "p18.h"
+#include "util.h"
+
+/*
+ * Runs queries on many devices from one thread. Every device has at most one
+ * command in flight: its frame is sent, then the device's file descriptor is
+ * watched (with epoll on Linux, poll elsewhere) until a matching response
+ * arrives or the timeout expires, and then the next job for the device is
+ * started. Devices that don't have a file descriptor, like with the hidapi
+ * backend, are checked every ENGINE_POLL_INTERVAL ms instead.
+ */
+
+typedef struct {
+    voltronic_dev_t dev;
+    int fd;
+    engine_job_t *job;          /* in flight, NULL when the device is done */
+    size_t index;               /* of the job in engine_t.jobs */
+    unsigned long long deadline;
+    char command[COMMAND_BUF_LENGTH];
+} engine_device_t;
+
+typedef struct {
+    engine_job_t *jobs;
+    size_t count;
+    int timeout;
+    engine_device_t devices[ENGINE_MAX_DEVICES];
+    size_t devices_count;
+    size_t active;
+#if defined(__linux__)
+    int epfd;
+#endif
+} engine_t;
+
+static void engine_fail(engine_job_t *job, const char *command)
+{
+    int saved_errno = errno;
+    snprintf(job->error, sizeof(job->error), "failed to execute %s: %s", command, strerror(errno));
+    job->err = saved_errno;
+    job->result = QUERY_ERR_COMM;
+}
+
+static void engine_watch(engine_t *e, engine_device_t *d)
+{
+#if defined(__linux__)
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = d;
+    if (d->fd >= 0 && (e->epfd < 0 || epoll_ctl(e->epfd, EPOLL_CTL_ADD, d->fd, &ev) == -1)) {
+        LOG("%s: can't watch fd %d, will check it periodically\n", __func__, d->fd);
+        d->fd = -1;
+    }
+#else
+    UNUSED(e);
+    UNUSED(d);
+#endif
+}
+
+static void engine_unwatch(engine_t *e, engine_device_t *d)
+{
+#if defined(__linux__)
+    if (d->fd >= 0)
+        epoll_ctl(e->epfd, EPOLL_CTL_DEL, d->fd, NULL);
+#else
+    UNUSED(e);
+    UNUSED(d);
+#endif
+}
+
+/* Sends the command of the job, unless it fails right away or the response
+   is cached. Returns true if there's a response to wait for. */
+static bool engine_start(engine_t *e, engine_device_t *d, size_t index)
+{
+    engine_job_t *job = &e->jobs[index];
+    p18_frame_t frame_buf;
+
+    d->index = index;
+    job->received = 0;
+
+    const p18_frame_t *frame = query_prepare(job->command_key, job->args, job->args_size, &frame_buf,
+                                             d->command, job->error, sizeof(job->error));
+    if (frame == NULL) {
+        job->result = QUERY_ERR_INPUT;
+        job->err = EINVAL;
+        return false;
+    }
+
+    if (job->command_key < P18_SET_CMDS_ENUM_OFFSET
+        && cache_get(d->dev, job->command_key, d->command, job->buf, sizeof(job->buf), &job->received)) {
+        job->result = query_complete(d->dev, job->command_key, d->command, job->buf, job->received,
+                                     true, job->error, sizeof(job->error));
+        job->err = job->result != QUERY_OK ? errno : 0;
+        return false;
+    }
+
+    if (!voltronic_dev_send(d->dev, WRITE_FRAMED_VOLTRONIC_INPUT, frame->data, frame->size,
+                            (unsigned int)e->timeout)) {
+        engine_fail(job, d->command);
+        return false;
+    }
+
+    d->job = job;
+    d->deadline = monotonic_ms() + (unsigned long long)e->timeout;
+    return true;
+}
+
+/* Starts the next job for the device that has something to wait for. */
+static void engine_advance(engine_t *e, engine_device_t *d)
+{
+    d->job = NULL;
+    for (size_t i = d->index + 1; i < e->count; i++) {
+        if (e->jobs[i].dev == d->dev && engine_start(e, d, i))
+            return;
+    }
+
+    engine_unwatch(e, d);
+    e->active--;
+}
+
+/* Handles the result of voltronic_dev_receive_available() or
+   voltronic_dev_receive(). Returns false if there's nothing more to read. */
+static bool engine_handle(engine_t *e, engine_device_t *d, int result)
+{
+    engine_job_t *job = d->job;
+
+    if (result > 0 && p18_response_matches(job->command_key, job->buf, job->received)) {
+        job->result = query_complete(d->dev, job->command_key, d->command, job->buf, job->received,
+                                     false, job->error, sizeof(job->error));
+        job->err = job->result != QUERY_OK ? errno : 0;
+        engine_advance(e, d);
+        return false;
+    }
+
+    /* same as in query_exchange(): skip whatever doesn't look like a response
+       to this command, like a late response to an earlier one */
+    if (result > 0 || errno == EBADMSG) {
+        LOG("%s: skipping a frame that isn't a response to %s\n", __func__, d->command);
+        return true;
+    }
+
+    engine_fail(job, d->command);
+    engine_advance(e, d);
+    return false;
+}
+
+static void engine_receive(engine_t *e, engine_device_t *d)
+{
+    while (d->job != NULL) {
+        engine_job_t *job = d->job;
+        int result = voltronic_dev_receive_available(d->dev, 0, job->buf, sizeof(job->buf),
+                                                     &job->received);
+        if (result == 0 || !engine_handle(e, d, result))
+            break;
+    }
+}
+
+static void engine_expire(engine_t *e, engine_device_t *d, unsigned long long now)
+{
+    while (d->job != NULL && now >= d->deadline) {
+        engine_job_t *job = d->job;
+        /* with a zero timeout this only looks at what's been read already,
+           and marks the device stale so that a late response is discarded */
+        int result = voltronic_dev_receive(d->dev, 0, job->buf, sizeof(job->buf),
+                                           &job->received, 0);
+        if (!engine_handle(e, d, result > 0 ? result : -1))
+            break;
+    }
+}
+
+/* Waits for input on the watched devices for up to timeout ms, and reads it. */
+static void engine_wait(engine_t *e, int timeout)
+{
+#if defined(__linux__)
+    struct epoll_event events[ENGINE_MAX_DEVICES];
+    int n = e->epfd >= 0 ? epoll_wait(e->epfd, events, ARRAY_SIZE(events), timeout) : -1;
+    if (n < 0) {
+        if (e->epfd < 0 || errno == EINTR)
+            sleep_ms((unsigned int)timeout);
+        return;
+    }
+    for (int i = 0; i < n; i++)
+        engine_receive(e, (engine_device_t *)events[i].data.ptr);
+#else
+    struct pollfd fds[ENGINE_MAX_DEVICES];
+    engine_device_t *watched[ENGINE_MAX_DEVICES];
+    nfds_t nfds = 0;
+    for (size_t i = 0; i < e->devices_count; i++) {
+        engine_device_t *d = &e->devices[i];
+        if (d->job == NULL || d->fd < 0)
+            continue;
+        fds[nfds].fd = d->fd;
+        fds[nfds].events = POLLIN;
+        fds[nfds].revents = 0;
+        watched[nfds++] = d;
+    }
+    if (!nfds) {
+        sleep_ms((unsigned int)timeout);
+        return;
+    }
+    if (poll(fds, nfds, timeout) <= 0)
+        return;
+    for (nfds_t i = 0; i < nfds; i++) {
+        if (fds[i].revents)
+            engine_receive(e, watched[i]);
+    }
+#endif
+}
+
+static engine_device_t *engine_device(engine_t *e, voltronic_dev_t dev)
+{
+    for (size_t i = 0; i < e->devices_count; i++) {
+        if (e->devices[i].dev == dev)
+            return &e->devices[i];
+    }
+
+    if (e->devices_count == ARRAY_SIZE(e->devices))
+        return NULL;
+
+    engine_device_t *d = &e->devices[e->devices_count++];
+    d->dev = dev;
+    d->fd = voltronic_dev_fd(dev);
+    d->job = NULL;
+    return d;
+}
+
+int engine_run(engine_job_t *jobs, size_t count, int timeout)
+{
+    engine_t e;
+    int worst = QUERY_OK;
+
+    e.jobs = jobs;
+    e.count = count;
+    e.timeout = timeout;
+    e.devices_count = 0;
+    e.active = 0;
+#if defined(__linux__)
+    e.epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (e.epfd < 0)
+        LOG("%s: epoll_create1: %s\n", __func__, strerror(errno));
+#endif
+
+    /* starting a device may finish some of its jobs right away, so all of
+       them are reset before any is started */
+    for (size_t i = 0; i < count; i++) {
+        jobs[i].result = QUERY_OK;
+        jobs[i].err = 0;
+        jobs[i].error[0] = '\0';
+    }
+
+    /* start the first job of every device */
+    for (size_t i = 0; i < count; i++) {
+        engine_job_t *job = &jobs[i];
+        size_t devices_count = e.devices_count;
+        engine_device_t *d = engine_device(&e, job->dev);
+
+        if (d == NULL) {
+            snprintf(job->error, sizeof(job->error), "too many devices");
+            job->result = QUERY_ERR_INPUT;
+            job->err = EINVAL;
+            continue;
+        }
+        if (e.devices_count == devices_count)
+            continue;
+
+        engine_watch(&e, d);
+        e.active++;
+        d->index = i;
+        if (!engine_start(&e, d, i))
+            engine_advance(&e, d);
+    }
+
+    while (e.active > 0) {
+        unsigned long long now = monotonic_ms();
+        unsigned long long next = now + (unsigned long long)timeout;
+        bool unwatched = false;
+
+        for (size_t i = 0; i < e.devices_count; i++) {
+            engine_device_t *d = &e.devices[i];
+            if (d->job == NULL)
+                continue;
+            next = MIN(next, d->deadline);
+            if (d->fd < 0)
+                unwatched = true;
+        }
+
+        int wait = next > now ? (int)(next - now) : 0;
+        if (unwatched)
+            wait = MIN(wait, ENGINE_POLL_INTERVAL);
+        engine_wait(&e, wait);
+
+        now = monotonic_ms();
+        for (size_t i = 0; i < e.devices_count; i++) {
+            engine_device_t *d = &e.devices[i];
+            if (d->job != NULL && d->fd < 0)
+                engine_receive(&e, d);
+            engine_expire(&e, d, now);
+        }
+    }
+
+#if defined(__linux__)
+    if (e.epfd >= 0)
+        close(e.epfd);
+#endif
+
+    for (size_t i = 0; i < count; i++)
+        worst = MAX(worst, jobs[i].result);
+    return worst;
+}
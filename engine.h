@@ -0,0 +1,51 @@
+/**
+ * Copyright (C) 2020  Evgeny Zinoviev
+ * This file is part of isv <https://github.com/gch1p/isv>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ISV_ENGINE_H
+#define ISV_ENGINE_H
+
+#include <stddef.h>
+
+#include "query.h"
+#include "device.h"
+#include "libvoltronic/voltronic_dev.h"
+
+#define ENGINE_MAX_DEVICES    DEVICE_MAX
+#define ENGINE_POLL_INTERVAL  5 /* ms, for devices without a file descriptor */
+
+typedef struct {
+    /* set by the caller */
+    voltronic_dev_t dev;
+    int command_key;
+    const char **args;
+    size_t args_size;
+
+    /* filled by engine_run() */
+    int result;                     /* QUERY_* code */
+    int err;                        /* errno, if result isn't QUERY_OK */
+    char error[QUERY_ERROR_LENGTH];
+    char buf[RESPONSE_BUF_LENGTH];
+    size_t received;
+} engine_job_t;
+
+/* Runs the jobs, each like query_exchange() would. Jobs for the same device
+   are run in order, jobs for different devices at the same time. Returns
+   the worst of the results. */
+int engine_run(engine_job_t *jobs, size_t count, int timeout);
+
+#endif //ISV_ENGINE_H
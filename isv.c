@@ -28,21 +28,18 @@
 #include "p18.h"
 #include "util.h"
 #include "print.h"
-#include "libvoltronic/voltronic_dev_usb.h"
-
-#define COMMAND_BUF_LENGTH  128
-#define RESPONSE_BUF_LENGTH 128
-
-#define PRINT(msg_type) \
-    { \
-        P18_MSG_T(msg_type) m = P18_UNPACK_FN_NAME(msg_type)(buffer+5); \
-        PRINT_FN_NAME(msg_type)(&m, g_format); \
-    }
+#include "query.h"
+#include "daemon.h"
+#include "server.h"
+#include "cache.h"
+#include "record.h"
+#include "delta.h"
+#include "scan.h"
+#include "device.h"
 
 #define GET_ARGS(len) \
     get_args(argc, (const char **)argv, a, (len))
 
-bool g_verbose = false;
 print_format_t g_format = PRINT_FORMAT_TABLE;
 
 static void usageintlist(const int *list, size_t size)
@@ -87,8 +84,69 @@ static void usage(const char *progname)
            "                         but output some debug info\n"
            "    -f <FORMAT>,\n"
            "    --format <FORMAT>:   output format for --get and --set options, see below\n"
+           "    --fields <LIST>:     decode and print only these comma-separated\n"
+           "                         fields of get queries, as they're named in\n"
+           "                         JSON output. Queries that have none of them\n"
+           "                         are printed in full.\n"
+           "                         Example: --fields battery_voltage,pv1_input_power\n"
+           "    --list-devices:      print connected devices and their series numbers\n"
+           "    --device <DEVICE>:   use DEVICE instead of the first one found. DEVICE\n"
+           "                         is a path (e.g. /dev/hidraw0), serial:<USB SERIAL>,\n"
+           "                         sn:<SERIES NUMBER>, tty:<PORT[:BAUD]> or\n"
+           "                         tcp:<HOST:PORT>. Can be specified multiple times\n"
+           "                         for get and set queries and --scan-parallel,\n"
+           "                         section names are then prefixed with DEVICE\n"
+           "    --serial <PORT[:BAUD]>:\n"
+           "                         use the inverter connected to RS-232 port PORT,\n"
+           "                         at BAUD baud (2400 by default). Same as\n"
+           "                         --device tty:PORT[:BAUD]\n"
+           "                         Example: --serial /dev/ttyUSB0:2400\n"
+           "    --tcp <HOST:PORT>:   use the inverter behind a transparent serial-to-\n"
+           "                         Ethernet bridge listening on HOST:PORT. Same as\n"
+           "                         --device tcp:HOST:PORT\n"
            "\n"
-           "Options to get data from inverter:\n"
+           "Daemon mode:\n"
+           "    --daemon:            keep the device open and run queries scheduled\n"
+           "                         with --poll until interrupted; reopens the\n"
+           "                         device if it gets disconnected\n"
+           "    --watch <INTERVAL>:  run the get queries every INTERVAL\n"
+           "                         milliseconds with the device kept open, like\n"
+           "                         --daemon with a --poll for each of them\n"
+           "    --poll <QUERY> <INTERVAL>:\n"
+           "                         run --get-QUERY every INTERVAL milliseconds,\n"
+           "                         can be specified multiple times. Arguments go\n"
+           "                         after the query name, in the same argument.\n"
+           "                         Example: --poll general-status 1000\n"
+           "                                  --poll 'parallel-general-status 1' 1000\n"
+           "    --record <FILE>:     append polled general-status and\n"
+           "                         parallel-general-status samples to FILE in\n"
+           "                         a compact binary format instead of printing\n"
+           "    --replay <FILE>:     print samples recorded with --record\n"
+           "    --delta:             print only values that changed since they were\n"
+           "                         printed last time; in JSON formats, each line\n"
+           "                         is a merge patch to the previous state. Works\n"
+           "                         with --replay too\n"
+           "    --deadband <FIELD> <VALUE>:\n"
+           "                         in delta mode, consider numeric FIELD changed\n"
+           "                         only if it differs from the last printed value\n"
+           "                         by more than VALUE, in the units it's printed in.\n"
+           "                         Example: --deadband battery_voltage 0.2\n"
+           "    --cache-ttl <QUERY> <TTL>:\n"
+           "                         reuse the response to --get-QUERY for TTL\n"
+           "                         milliseconds, 0 disables caching of QUERY.\n"
+           "                         Static data like rated-information is cached\n"
+           "                         for a minute by default, energy counters for\n"
+           "                         10 seconds, the rest is not cached\n"
+           "\n"
+           "Server mode:\n"
+           "    --serve <PATH>:      keep the device open and answer get queries\n"
+           "                         from clients connected to unix socket PATH.\n"
+           "                         Clients send one query per line, e.g.\n"
+           "                         \"general-status\" or \"year-generated 2020\",\n"
+           "                         and receive one line of JSON per query\n"
+           "\n"
+           "Options to get data from inverter (several can be combined, they will\n"
+           "be executed one after another and printed as one document):\n"
            "    --get-protocol-id\n"
            "    --get-date-time\n"
            "    --get-total-generated\n"
@@ -114,6 +172,10 @@ static void usage(const char *progname)
            "    --get-ac-charge-time-bucket\n"
            "    --get-ac-supply-load-time-bucket\n"
            "\n"
+           "    --scan-parallel:     read the number of parallel machines from\n"
+           "                         rated information and get general status of\n"
+           "                         each of them, printed as one document\n"
+           "\n"
            "Options to set inverter's configuration:\n"
            "    --set-loads-supply 0|1\n"
            "    --set-flag <FLAG> 0|1\n"
@@ -248,6 +310,16 @@ static void usage(const char *progname)
            "    json           JSON object, like {\"ac_output_voltage\":230}\n"
            "    json-w-units   JSON object with units, like:\n"
            "                   {\"ac_output_voltage\":[230,\"V\"]}\n"
+           "    ndjson         JSON, one object per line; with --watch and --daemon\n"
+           "                   each line starts with a sample section holding the\n"
+           "                   wall-clock and monotonic time in milliseconds\n"
+           "    csv            comma-separated values, a header and then a row per\n"
+           "                   message or document; rows with other columns than\n"
+           "                   the header are skipped\n"
+           "    tsv            tab-separated values, same as csv\n"
+           "    influx         InfluxDB line protocol, a point per section of a\n"
+           "                   document, tagged with the device and timestamped\n"
+           "                   with --watch, --daemon and --replay\n"
     );
 
     exit(1);
@@ -255,20 +327,14 @@ static void usage(const char *progname)
 
 static void exit_with_error(int code, char *fmt, ...)
 {
-    static const size_t buf_size = 256;
+    enum { buf_size = 256 };
     char buf[buf_size];
     va_list args;
     va_start(args, fmt);
     size_t len = vsnprintf(buf, buf_size, fmt, args);
     va_end(args);
     buf[MIN(len, buf_size-1)] = '\0';
-    ERROR("error: %s\n", buf);
-    if (g_format == PRINT_FORMAT_JSON || g_format == PRINT_FORMAT_JSON_W_UNITS) {
-        print_item_t items[] = {
-            {.key= "error", .value= variant_string(buf)}
-        };
-        print_json(items, 1, false);
-    }
+    print_error(g_format, "%s", buf);
     exit(code);
 }
 
@@ -295,87 +361,6 @@ static void execute_raw(voltronic_dev_t dev, const char *command, int timeout)
     printf("%s\n", buffer);
 }
 
-static void query(voltronic_dev_t dev,
-          int command_key,
-          int timeout,
-          const char **args,
-          size_t args_size,
-          bool pretend)
-{
-    char buffer[RESPONSE_BUF_LENGTH];
-    char command[COMMAND_BUF_LENGTH];
-
-    if (!p18_build_command(command_key, args, args_size, command))
-        exit_with_error(1, "invalid query command %d", command_key);
-
-    if (pretend) {
-        size_t command_len = strlen(command);
-        LOG("would write %zu+3 %s:\n",
-            command_len, (command_len > 1 ? "bytes" : "byte"));
-        HEXDUMP(command, command_len);
-        return;
-    }
-
-    size_t received;
-    int result = voltronic_dev_execute(dev, 0, command, strlen(command),
-                                           buffer, sizeof(buffer), &received,
-                                           timeout);
-    if (result <= 0)
-        exit_with_error(2, "failed to execute %s: %s", command, strerror(errno));
-
-    if (command_key < P18_SET_CMDS_ENUM_OFFSET) {
-        size_t data_size;
-        if (!p18_validate_query_response(buffer, received, &data_size))
-            exit_with_error(2, "invalid response");
-
-        if (command_key == P18_QUERY_PROTOCOL_ID)
-            PRINT(protocol_id)
-        else if (command_key == P18_QUERY_CURRENT_TIME)
-            PRINT(current_time)
-        else if (command_key == P18_QUERY_TOTAL_GENERATED)
-            PRINT(total_generated)
-        else if (command_key == P18_QUERY_YEAR_GENERATED)
-            PRINT(year_generated)
-        else if (command_key == P18_QUERY_MONTH_GENERATED)
-            PRINT(month_generated)
-        else if (command_key == P18_QUERY_DAY_GENERATED)
-            PRINT(day_generated)
-        else if (command_key == P18_QUERY_SERIES_NUMBER)
-            PRINT(series_number)
-        else if (command_key == P18_QUERY_CPU_VERSION)
-            PRINT(cpu_version)
-        else if (command_key == P18_QUERY_RATED_INFORMATION)
-            PRINT(rated_information)
-        else if (command_key == P18_QUERY_GENERAL_STATUS)
-            PRINT(general_status)
-        else if (command_key == P18_QUERY_WORKING_MODE)
-            PRINT(working_mode)
-        else if (command_key == P18_QUERY_FAULTS_WARNINGS)
-            PRINT(faults_warnings)
-        else if (command_key == P18_QUERY_FLAGS_STATUSES)
-            PRINT(flags_statuses)
-        else if (command_key == P18_QUERY_DEFAULTS)
-            PRINT(defaults)
-        else if (command_key == P18_QUERY_MAX_CHARGING_CURRENT_SELECTABLE_VALUES)
-            PRINT(max_charging_current_selectable_values)
-        else if (command_key == P18_QUERY_MAX_AC_CHARGING_CURRENT_SELECTABLE_VALUES)
-            PRINT(max_ac_charging_current_selectable_values)
-        else if (command_key == P18_QUERY_PARALLEL_RATED_INFORMATION)
-            PRINT(parallel_rated_information)
-        else if (command_key == P18_QUERY_PARALLEL_GENERAL_STATUS)
-            PRINT(parallel_general_status)
-        else if (command_key == P18_QUERY_AC_CHARGE_TIME_BUCKET)
-            PRINT(ac_charge_time_bucket)
-        else if (command_key == P18_QUERY_AC_SUPPLY_LOAD_TIME_BUCKET)
-            PRINT(ac_supply_load_time_bucket)
-    } else {
-        bool success = p18_set_result(buffer, received);
-        print_set_result(success, g_format);
-        if (!success)
-            exit(2);
-    }
-}
-
 static void validate_date_args(const char *ys, const char *ms, const char *ds)
 {
     static char *err_year = "invalid year";
@@ -471,11 +456,27 @@ static bool is_valid_parallel_id(const char *s)
     return isnumeric(s) && strlen(s) == 1;
 }
 
+#define PREFIXED_SPEC_LENGTH 256
+
+/* the first --device, reopened by the daemon and the server */
+static const char *device_spec = NULL;
+static int device_timeout = 1000;
+
+static voltronic_dev_t open_device(void)
+{
+    return device_open(device_spec, device_timeout);
+}
+
 enum action {
     ACTION_HELP,
     ACTION_DUMP,
     ACTION_EXECUTE,
     ACTION_QUERY,
+    ACTION_DAEMON,
+    ACTION_SERVE,
+    ACTION_REPLAY,
+    ACTION_SCAN,
+    ACTION_LIST_DEVICES,
 };
 
 enum {
@@ -486,6 +487,21 @@ enum {
     OPT_PREDENT = 'p',
     OPT_TIMEOUT = 't',
     OPT_FORMAT = 'f',
+    OPT_DAEMON = 200,
+    OPT_POLL,
+    OPT_SERVE,
+    OPT_CACHE_TTL,
+    OPT_RECORD,
+    OPT_REPLAY,
+    OPT_DELTA,
+    OPT_DEADBAND,
+    OPT_SCAN_PARALLEL,
+    OPT_DEVICE,
+    OPT_LIST_DEVICES,
+    OPT_FIELDS,
+    OPT_SERIAL,
+    OPT_TCP,
+    OPT_WATCH,
 };
 
 int main(int argc, char *argv[])
@@ -495,9 +511,20 @@ int main(int argc, char *argv[])
 
     enum action act = ACTION_HELP;
     int opt;
-    int command_no = 0, timeout = 1000;
+    int timeout = 1000;
     bool pretend = false;
-    const char *a[6] = {0}; /* p18 command arguments */
+    const char *a[QUERY_MAX_ARGS] = {0}; /* p18 command arguments */
+    query_request_t queries[QUERY_MAX_BATCH];
+    size_t queries_count = 0;
+    daemon_task_t tasks[DAEMON_MAX_TASKS];
+    size_t tasks_count = 0;
+    const char *socket_path = NULL;
+    const char *device_specs[DEVICE_MAX];
+    size_t device_specs_count = 0;
+    char prefixed_specs[DEVICE_MAX][PREFIXED_SPEC_LENGTH]; /* --serial and --tcp, as tty: and tcp: specs */
+    const char *record_path = NULL;
+    unsigned int watch_interval = 0;
+    query_fields_t fields = {0}; /* --fields, of every get query */
     static struct option long_options[] = {
         {"help",    no_argument,       0, OPT_HELP},
         {"dump",    no_argument,       0, OPT_DUMP},
@@ -506,6 +533,21 @@ int main(int argc, char *argv[])
         {"pretend", required_argument, 0, OPT_PREDENT},
         {"timeout", required_argument, 0, OPT_TIMEOUT},
         {"format",  required_argument, 0, OPT_FORMAT},
+        {"daemon",  no_argument,       0, OPT_DAEMON},
+        {"poll",    required_argument, 0, OPT_POLL},
+        {"serve",   required_argument, 0, OPT_SERVE},
+        {"cache-ttl", required_argument, 0, OPT_CACHE_TTL},
+        {"record",  required_argument, 0, OPT_RECORD},
+        {"replay",  required_argument, 0, OPT_REPLAY},
+        {"delta",   no_argument,       0, OPT_DELTA},
+        {"deadband", required_argument, 0, OPT_DEADBAND},
+        {"scan-parallel", no_argument, 0, OPT_SCAN_PARALLEL},
+        {"device",  required_argument, 0, OPT_DEVICE},
+        {"list-devices", no_argument,  0, OPT_LIST_DEVICES},
+        {"fields",  required_argument, 0, OPT_FIELDS},
+        {"serial",  required_argument, 0, OPT_SERIAL},
+        {"tcp",     required_argument, 0, OPT_TCP},
+        {"watch",   required_argument, 0, OPT_WATCH},
 
         /* get queries */
         {"get-protocol-id",                               no_argument,       0, P18_QUERY_PROTOCOL_ID},
@@ -584,6 +626,14 @@ int main(int argc, char *argv[])
                 g_format = PRINT_FORMAT_TABLE;
             else if (!strcmp(optarg, "parsable-table"))
                 g_format = PRINT_FORMAT_PARSABLE_TABLE;
+            else if (!strcmp(optarg, "ndjson"))
+                g_format = PRINT_FORMAT_NDJSON;
+            else if (!strcmp(optarg, "csv"))
+                g_format = PRINT_FORMAT_CSV;
+            else if (!strcmp(optarg, "tsv"))
+                g_format = PRINT_FORMAT_TSV;
+            else if (!strcmp(optarg, "influx"))
+                g_format = PRINT_FORMAT_INFLUX;
             else
                 exit_with_error(1, "invalid format");
         }
@@ -595,6 +645,100 @@ int main(int argc, char *argv[])
             act = ACTION_EXECUTE;
         }
 
+        else if (opt == OPT_DAEMON)
+            act = ACTION_DAEMON;
+
+        else if (opt == OPT_SERVE) {
+            socket_path = optarg;
+            act = ACTION_SERVE;
+        }
+
+        else if (opt == OPT_CACHE_TTL) {
+            GET_ARGS(2);
+            int command = query_find(a[0], NULL);
+            if (!command)
+                exit_with_error(1, "unknown query %s", a[0]);
+
+            unsigned int ttl;
+            if (!get_uint(a[1], &ttl))
+                exit_with_error(1, "invalid ttl");
+            cache_set_ttl(command, ttl);
+        }
+
+        else if (opt == OPT_SCAN_PARALLEL)
+            act = ACTION_SCAN;
+
+        else if (opt == OPT_DEVICE || opt == OPT_SERIAL || opt == OPT_TCP) {
+            const char *spec = optarg;
+            if (device_specs_count >= ARRAY_SIZE(device_specs))
+                exit_with_error(1, "too many devices");
+            if (opt != OPT_DEVICE) {
+                char *prefixed = prefixed_specs[device_specs_count];
+                if (snprintf(prefixed, PREFIXED_SPEC_LENGTH, "%s%s",
+                             opt == OPT_SERIAL ? DEVICE_SPEC_TTY : DEVICE_SPEC_TCP,
+                             optarg) >= PREFIXED_SPEC_LENGTH)
+                    exit_with_error(1, "device name is too long");
+                spec = prefixed;
+            }
+            for (size_t i = 0; i < device_specs_count; i++) {
+                if (!strcmp(device_specs[i], spec))
+                    exit_with_error(1, "duplicate device");
+            }
+            device_specs[device_specs_count++] = spec;
+        }
+
+        else if (opt == OPT_LIST_DEVICES)
+            act = ACTION_LIST_DEVICES;
+
+        else if (opt == OPT_FIELDS) {
+            if (query_parse_fields(optarg, &fields) != QUERY_OK)
+                exit_with_error(1, "invalid fields list, up to %d fields are supported",
+                                QUERY_MAX_FIELDS);
+        }
+
+        else if (opt == OPT_DELTA)
+            delta_enable();
+
+        else if (opt == OPT_DEADBAND) {
+            GET_ARGS(2);
+            char *endptr;
+            double deadband = strtod(a[1], &endptr);
+            if (endptr == a[1] || *endptr != '\0' || deadband < 0)
+                exit_with_error(1, "invalid deadband");
+            if (!delta_set_deadband(a[0], deadband))
+                exit_with_error(1, "too many deadbands");
+        }
+
+        else if (opt == OPT_POLL) {
+            GET_ARGS(2);
+            if (tasks_count >= ARRAY_SIZE(tasks))
+                exit_with_error(1, "too many queries to poll");
+
+            daemon_task_t *task = &tasks[tasks_count];
+            const char *error = query_parse(a[0], &task->request, task->buf);
+            if (error != NULL)
+                exit_with_error(1, "%s: %s", a[0], error);
+            task->request.fields = &fields;
+
+            if (!get_uint(a[1], &task->interval) || task->interval == 0)
+                exit_with_error(1, "invalid interval");
+
+            tasks_count++;
+        }
+
+        else if (opt == OPT_WATCH) {
+            if (!get_uint(optarg, &watch_interval) || watch_interval == 0)
+                exit_with_error(1, "invalid interval");
+        }
+
+        else if (opt == OPT_RECORD)
+            record_path = optarg;
+
+        else if (opt == OPT_REPLAY) {
+            record_path = optarg;
+            act = ACTION_REPLAY;
+        }
+
         else if (opt == OPT_TIMEOUT) {
             timeout = atoi(optarg);
             if (timeout <= 0 || timeout > 60000)
@@ -602,14 +746,22 @@ int main(int argc, char *argv[])
         }
 
         else if (opt >= P18_QUERY_CMDS_ENUM_OFFSET) {
-            if (act == ACTION_QUERY)
-                exit_with_error(1, "one query at a time, please");
-
-            if (opt >= P18_QUERY_CMDS_ENUM_OFFSET) {
-                act = ACTION_QUERY;
-                command_no = opt;
+            if (act == ACTION_QUERY) {
+                /* several get queries can be batched, set commands can't */
+                if (opt >= P18_SET_CMDS_ENUM_OFFSET
+                    || queries[0].command_key >= P18_SET_CMDS_ENUM_OFFSET)
+                    exit_with_error(1, "set commands can't be combined with other queries");
+                for (size_t i = 0; i < queries_count; i++) {
+                    if (queries[i].command_key == opt)
+                        exit_with_error(1, "duplicate query");
+                }
+                if (queries_count >= ARRAY_SIZE(queries))
+                    exit_with_error(1, "too many queries");
             }
 
+            act = ACTION_QUERY;
+            memset(a, 0, sizeof(a));
+
             switch (opt) {
                 case P18_QUERY_YEAR_GENERATED:
                     GET_ARGS(1);
@@ -824,6 +976,11 @@ int main(int argc, char *argv[])
                     a[3] = end_m_ptr;
                     break;
             }
+
+            queries[queries_count].command_key = opt;
+            memcpy(queries[queries_count].args, a, sizeof(a));
+            queries[queries_count].fields = &fields;
+            queries_count++;
         }
     }
 
@@ -833,29 +990,133 @@ int main(int argc, char *argv[])
     if (getopt_err)
         exit(1);
 
+    if (watch_interval) {
+        /* the same as --daemon with a --poll for each query */
+        if (act != ACTION_QUERY || queries[0].command_key >= P18_SET_CMDS_ENUM_OFFSET)
+            exit_with_error(1, "--watch requires get queries");
+        if (tasks_count)
+            exit_with_error(1, "--watch can't be combined with --poll");
+        if (queries_count > ARRAY_SIZE(tasks))
+            exit_with_error(1, "too many queries to watch");
+        for (size_t i = 0; i < queries_count; i++) {
+            tasks[i].request = queries[i];
+            tasks[i].interval = watch_interval;
+        }
+        tasks_count = queries_count;
+        act = ACTION_DAEMON;
+    }
+
+    if (tasks_count && act != ACTION_DAEMON)
+        exit_with_error(1, "--poll requires --daemon");
+
+    if (record_path != NULL && act != ACTION_DAEMON && act != ACTION_REPLAY)
+        exit_with_error(1, "--record requires --daemon");
+
+    if (delta_enabled() && act != ACTION_DAEMON && act != ACTION_REPLAY)
+        exit_with_error(1, "--delta requires --daemon or --replay");
+
+    if (delta_enabled() && print_is_delimited_format(g_format))
+        exit_with_error(1, "--delta can't be used with csv and tsv");
+
     if (act == ACTION_HELP)
         usage(argv[0]);
 
-    voltronic_dev_t dev = voltronic_usb_create(0x0665, 0x5161);
+    /* the default device is the first USB inverter found; with --replay,
+       --device names the one the log was recorded from */
+    print_set_device(device_specs_count ? device_specs[0] : "usb");
+
+    if (act == ACTION_REPLAY)
+        return record_replay(record_path, g_format);
+
+    if (act == ACTION_LIST_DEVICES)
+        return device_list(timeout, g_format);
 
-    if (!pretend && !dev)
-        exit_with_error(1, "could not open USB device: %s", strerror(errno));
+    if (device_specs_count > 1 && act != ACTION_QUERY && act != ACTION_SCAN)
+        exit_with_error(1, "several devices are supported only by get and set queries and --scan-parallel");
+
+    device_spec = device_specs_count ? device_specs[0] : NULL;
+    device_timeout = timeout;
+
+    if (act == ACTION_DAEMON) {
+        if (!tasks_count)
+            exit_with_error(1, "nothing to poll, use --poll");
+        if (pretend)
+            exit_with_error(1, "--pretend is not supported in daemon mode");
+        if (record_path == NULL && print_is_delimited_format(g_format)) {
+            /* each row must hold the same sections */
+            for (size_t i = 1; i < tasks_count; i++) {
+                if (tasks[i].interval != tasks[0].interval)
+                    exit_with_error(1, "csv and tsv require the same interval for every --poll");
+            }
+        }
+
+        record_t *record = NULL;
+        if (record_path != NULL) {
+            for (size_t i = 0; i < tasks_count; i++) {
+                if (!record_supports(tasks[i].request.command_key))
+                    exit_with_error(1, "only general-status and parallel-general-status can be recorded");
+            }
+            record = record_open(record_path);
+            if (record == NULL)
+                exit(1);
+        }
+
+        int result = daemon_run(tasks, tasks_count, open_device, timeout, g_format, record);
+        if (record != NULL)
+            record_close(record);
+        return result;
+    }
+
+    if (act == ACTION_SERVE) {
+        if (pretend)
+            exit_with_error(1, "--pretend is not supported in server mode");
+        return server_run(socket_path, open_device, timeout, g_format);
+    }
+
+    if (act == ACTION_SCAN && pretend)
+        exit_with_error(1, "--pretend is not supported with --scan-parallel");
+
+    device_t devices[DEVICE_MAX];
+    size_t devices_count = MAX(device_specs_count, 1);
+
+    for (size_t i = 0; i < devices_count; i++) {
+        const char *spec = device_specs_count ? device_specs[i] : NULL;
+        devices[i].name = spec;
+        devices[i].dev = device_open(spec, timeout);
+        if (!pretend && !devices[i].dev) {
+            if (spec != NULL)
+                exit_with_error(1, "could not open device %s: %s", spec, strerror(errno));
+            exit_with_error(1, "could not open USB device: %s", strerror(errno));
+        }
+    }
+
+    voltronic_dev_t dev = devices[0].dev;
+    int result = QUERY_OK;
 
     switch (act) {
         case ACTION_EXECUTE:
             execute_raw(dev, a[0], timeout);
             break;
 
+        case ACTION_SCAN:
+            result = scan_parallel(devices, devices_count, timeout, g_format);
+            break;
+
         case ACTION_QUERY:
-            query(dev, command_no, timeout, a, sizeof(a), pretend);
+            result = query_batch(devices, devices_count, queries, queries_count, timeout, pretend, g_format);
             break;
 
         default:
             exit_with_error(1, "unexpected act %d", act);
     }
 
-    if (dev)
-        voltronic_dev_close(dev);
+    for (size_t i = 0; i < devices_count; i++) {
+        if (devices[i].dev)
+            device_close(devices[i].dev);
+    }
+
+    if (result != QUERY_OK)
+        exit(result);
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,254 @@
+/**
+ * Copyright (C) 2020  Evgeny Zinoviev
+ * This file is part of isv <https://github.com/gch1p/isv>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "libisv.h"
+#include "device.h"
+#include "query.h"
+#include "util.h"
+
+#define MK_LIBISV_UNPACK_FN_NAME(msg_type) libisv_unpack_ ## msg_type
+#define MK_LIBISV_PRINT_FN_NAME(msg_type)  libisv_print_ ## msg_type
+#define LIBISV_UNPACK_FN_NAME(msg_type)    MK_LIBISV_UNPACK_FN_NAME(msg_type)
+#define LIBISV_PRINT_FN_NAME(msg_type)     MK_LIBISV_PRINT_FN_NAME(msg_type)
+
+/* untyped wrappers around p18_unpack_..._msg() and print_..._msg() */
+#define LIBISV_FNS(msg_type) \
+    static void LIBISV_UNPACK_FN_NAME(msg_type)(const char *data, void *msg) \
+    { \
+        *(P18_MSG_T(msg_type) *)msg = P18_UNPACK_FN_NAME(msg_type)(data); \
+    } \
+    static void LIBISV_PRINT_FN_NAME(msg_type)(print_t *p, const void *msg, print_format_t format) \
+    { \
+        PRINT_FN_NAME(msg_type)(p, (const P18_MSG_T(msg_type) *)msg, format); \
+    }
+
+#define LIBISV_HANDLER(command_key, msg_type) \
+    [(command_key) - P18_QUERY_CMDS_ENUM_OFFSET] = { \
+        sizeof(P18_MSG_T(msg_type)), \
+        LIBISV_UNPACK_FN_NAME(msg_type), \
+        LIBISV_PRINT_FN_NAME(msg_type) \
+    }
+
+typedef struct {
+    size_t msg_size;
+    void (*unpack)(const char *data, void *msg);
+    void (*print)(print_t *p, const void *msg, print_format_t format);
+} libisv_handler_t;
+
+struct isv_dev {
+    voltronic_dev_t dev;
+    int timeout;
+    char error[QUERY_ERROR_LENGTH];
+};
+
+LIBISV_FNS(protocol_id)
+LIBISV_FNS(current_time)
+LIBISV_FNS(total_generated)
+LIBISV_FNS(year_generated)
+LIBISV_FNS(month_generated)
+LIBISV_FNS(day_generated)
+LIBISV_FNS(series_number)
+LIBISV_FNS(cpu_version)
+LIBISV_FNS(rated_information)
+LIBISV_FNS(general_status)
+LIBISV_FNS(working_mode)
+LIBISV_FNS(faults_warnings)
+LIBISV_FNS(flags_statuses)
+LIBISV_FNS(defaults)
+LIBISV_FNS(max_charging_current_selectable_values)
+LIBISV_FNS(max_ac_charging_current_selectable_values)
+LIBISV_FNS(parallel_rated_information)
+LIBISV_FNS(parallel_general_status)
+LIBISV_FNS(ac_charge_time_bucket)
+LIBISV_FNS(ac_supply_load_time_bucket)
+
+static const libisv_handler_t libisv_handlers[] = {
+    LIBISV_HANDLER(P18_QUERY_PROTOCOL_ID,                               protocol_id),
+    LIBISV_HANDLER(P18_QUERY_CURRENT_TIME,                              current_time),
+    LIBISV_HANDLER(P18_QUERY_TOTAL_GENERATED,                           total_generated),
+    LIBISV_HANDLER(P18_QUERY_YEAR_GENERATED,                            year_generated),
+    LIBISV_HANDLER(P18_QUERY_MONTH_GENERATED,                           month_generated),
+    LIBISV_HANDLER(P18_QUERY_DAY_GENERATED,                             day_generated),
+    LIBISV_HANDLER(P18_QUERY_SERIES_NUMBER,                             series_number),
+    LIBISV_HANDLER(P18_QUERY_CPU_VERSION,                               cpu_version),
+    LIBISV_HANDLER(P18_QUERY_RATED_INFORMATION,                         rated_information),
+    LIBISV_HANDLER(P18_QUERY_GENERAL_STATUS,                            general_status),
+    LIBISV_HANDLER(P18_QUERY_WORKING_MODE,                              working_mode),
+    LIBISV_HANDLER(P18_QUERY_FAULTS_WARNINGS,                           faults_warnings),
+    LIBISV_HANDLER(P18_QUERY_FLAGS_STATUSES,                            flags_statuses),
+    LIBISV_HANDLER(P18_QUERY_DEFAULTS,                                  defaults),
+    LIBISV_HANDLER(P18_QUERY_MAX_CHARGING_CURRENT_SELECTABLE_VALUES,    max_charging_current_selectable_values),
+    LIBISV_HANDLER(P18_QUERY_MAX_AC_CHARGING_CURRENT_SELECTABLE_VALUES, max_ac_charging_current_selectable_values),
+    LIBISV_HANDLER(P18_QUERY_PARALLEL_RATED_INFORMATION,                parallel_rated_information),
+    LIBISV_HANDLER(P18_QUERY_PARALLEL_GENERAL_STATUS,                   parallel_general_status),
+    LIBISV_HANDLER(P18_QUERY_AC_CHARGE_TIME_BUCKET,                     ac_charge_time_bucket),
+    LIBISV_HANDLER(P18_QUERY_AC_SUPPLY_LOAD_TIME_BUCKET,                ac_supply_load_time_bucket),
+};
+
+static const libisv_handler_t *libisv_handler(int command_key)
+{
+    int index = command_key - P18_QUERY_CMDS_ENUM_OFFSET;
+    if (index < 0 || index >= (int)ARRAY_SIZE(libisv_handlers))
+        return NULL;
+    return &libisv_handlers[index];
+}
+
+int isv_open(const char *spec, int timeout, isv_dev_t **dev)
+{
+    *dev = NULL;
+
+    isv_dev_t *d = calloc(1, sizeof(isv_dev_t));
+    if (d == NULL)
+        return ISV_ERR_COMM;
+
+    d->dev = device_open(spec, timeout);
+    if (d->dev == NULL) {
+        int saved_errno = errno;
+        free(d);
+        errno = saved_errno;
+        return ISV_ERR_COMM;
+    }
+
+    d->timeout = timeout;
+    *dev = d;
+    return ISV_OK;
+}
+
+void isv_close(isv_dev_t *dev)
+{
+    if (dev == NULL)
+        return;
+    voltronic_dev_close(dev->dev);
+    free(dev);
+}
+
+const char *isv_error(const isv_dev_t *dev)
+{
+    return dev->error;
+}
+
+/* Like query_exchange(), but bypasses the cache, which is shared by the
+   whole process. */
+static int libisv_exchange(isv_dev_t *dev,
+                           int command_key,
+                           const char **args,
+                           size_t args_size,
+                           char *buf,
+                           size_t bufsize,
+                           size_t *received)
+{
+    p18_frame_t frame_buf;
+    char command[COMMAND_BUF_LENGTH];
+
+    dev->error[0] = '\0';
+    const p18_frame_t *frame = query_prepare(command_key, args, args_size, &frame_buf,
+                                             command, dev->error, sizeof(dev->error));
+    if (frame == NULL)
+        return ISV_ERR_INPUT;
+
+    return query_transfer(dev->dev, command_key, frame, command, dev->timeout,
+                          buf, bufsize, received, dev->error, sizeof(dev->error));
+}
+
+int isv_get(isv_dev_t *dev,
+            int command_key,
+            const char **args,
+            size_t args_size,
+            void *msg,
+            size_t msg_size)
+{
+    char buf[RESPONSE_BUF_LENGTH];
+    size_t received, data_size;
+
+    const libisv_handler_t *handler = libisv_handler(command_key);
+    if (handler == NULL) {
+        snprintf(dev->error, sizeof(dev->error), "invalid query command %d", command_key);
+        return ISV_ERR_INPUT;
+    }
+    if (handler->msg_size != msg_size) {
+        snprintf(dev->error, sizeof(dev->error), "wrong message type for query command %d", command_key);
+        return ISV_ERR_INPUT;
+    }
+
+    int result = libisv_exchange(dev, command_key, args, args_size,
+                                 buf, sizeof(buf), &received);
+    if (result != ISV_OK)
+        return result;
+
+    if (!p18_validate_query_response(buf, received, &data_size)) {
+        snprintf(dev->error, sizeof(dev->error), "invalid response");
+        errno = EBADMSG;
+        return ISV_ERR_COMM;
+    }
+
+    handler->unpack(buf+5, msg);
+    return ISV_OK;
+}
+
+int isv_set(isv_dev_t *dev,
+            int command_key,
+            const char **args,
+            size_t args_size)
+{
+    char buf[RESPONSE_BUF_LENGTH];
+    size_t received;
+
+    if (command_key < P18_SET_CMDS_ENUM_OFFSET) {
+        snprintf(dev->error, sizeof(dev->error), "invalid set command %d", command_key);
+        return ISV_ERR_INPUT;
+    }
+
+    int result = libisv_exchange(dev, command_key, args, args_size,
+                                 buf, sizeof(buf), &received);
+    if (result != ISV_OK)
+        return result;
+
+    if (!p18_set_result(buf, received)) {
+        snprintf(dev->error, sizeof(dev->error), "the inverter refused the command");
+        return ISV_ERR_COMM;
+    }
+
+    return ISV_OK;
+}
+
+int isv_format(int command_key,
+               const void *msg,
+               print_format_t format,
+               char *buf,
+               size_t bufsize,
+               size_t *len)
+{
+    const libisv_handler_t *handler = libisv_handler(command_key);
+    if (handler == NULL)
+        return ISV_ERR_INPUT;
+
+    print_t p;
+    print_init_buffer(&p, buf, bufsize);
+    handler->print(&p, msg, format);
+
+    if (len != NULL)
+        *len = p.len;
+    return p.len < bufsize ? ISV_OK : ISV_ERR_NOSPACE;
+}
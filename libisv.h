@@ -0,0 +1,79 @@
+/**
+ * Copyright (C) 2020  Evgeny Zinoviev
+ * This file is part of isv <https://github.com/gch1p/isv>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ISV_LIBISV_H
+#define ISV_LIBISV_H
+
+#include <stddef.h>
+
+#include "p18.h"
+#include "print.h"
+
+/*
+ * Embeddable interface to the inverter, built as libisv.a and libisv.so.
+ *
+ * Everything a call needs is either in its arguments or in the handle, so
+ * different handles can be used from different threads at once; a single
+ * handle must not be used by two threads at the same time. Nothing here
+ * prints, exits or depends on the command line options of isv.
+ */
+
+/* return codes, the first three are the same as the isv exit codes */
+#define ISV_OK           0
+#define ISV_ERR_INPUT    1  /* invalid command, arguments or message type */
+#define ISV_ERR_COMM     2  /* the device failed or refused a set command */
+#define ISV_ERR_NOSPACE  3  /* the output didn't fit into the buffer */
+
+typedef struct isv_dev isv_dev_t;
+
+/* Opens a device by the same spec as isv --device. On failure, returns
+   ISV_ERR_COMM with errno set, and *dev is NULL. */
+int isv_open(const char *spec, int timeout, isv_dev_t **dev);
+void isv_close(isv_dev_t *dev);
+
+/* Message of the last failed call on dev, an empty string if there was none. */
+const char *isv_error(const isv_dev_t *dev);
+
+/* Executes a get query (a P18_QUERY_* key) and unpacks the response into msg,
+   which must point to its p18_..._msg_t of msg_size bytes. Responses are not
+   cached. */
+int isv_get(isv_dev_t *dev,
+            int command_key,
+            const char **args,
+            size_t args_size,
+            void *msg,
+            size_t msg_size);
+
+/* Executes a set command (a P18_SET_* key). Returns ISV_ERR_COMM if the
+   inverter refused it. */
+int isv_set(isv_dev_t *dev,
+            int command_key,
+            const char **args,
+            size_t args_size);
+
+/* Formats msg, as filled by isv_get() for command_key, the way isv prints it.
+   The output is NUL-terminated and its length, even if it didn't fit, goes
+   to *len if it's not NULL. */
+int isv_format(int command_key,
+               const void *msg,
+               print_format_t format,
+               char *buf,
+               size_t bufsize,
+               size_t *len);
+
+#endif //ISV_LIBISV_H
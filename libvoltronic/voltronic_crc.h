@@ -68,4 +68,30 @@
     const char* buffer,
     size_t buffer_length);
 
+  /**
+   * Continue calculating the CRC over more bytes, so that the CRC of
+   * a constant prefix can be calculated once and reused
+   *
+   * crc - Value returned by a previous call, 0 to start
+   * buffer - Buffer to read from
+   * buffer_length - Number of bytes in the buffer
+   *
+   * Returns the intermediate CRC, to be passed to finish_voltronic_crc
+   */
+  voltronic_crc_t update_voltronic_crc(
+    voltronic_crc_t crc,
+    const char* buffer,
+    size_t buffer_length);
+
+  /**
+   * Turn an intermediate CRC into the Voltronic CRC, which never
+   * contains reserved bytes
+   *
+   * crc - Value returned by update_voltronic_crc
+   *
+   * Returns the CRC to be written with write_voltronic_crc
+   */
+  voltronic_crc_t finish_voltronic_crc(
+    voltronic_crc_t crc);
+
 #endif
@@ -57,9 +57,33 @@
 #define END_OF_INPUT '\r'
 #define END_OF_INPUT_SIZE sizeof(char)
 #define NON_DATA_SIZE (sizeof(voltronic_crc_t) + END_OF_INPUT_SIZE)
+#define SEND_FRAME_SIZE 256
+#define INPUT_BUFFER_SIZE 512
+#define DRAIN_TIMEOUT 1
+#define DRAIN_MAX_READS 64
+
+/**
+ * Bytes are read from the device in reports, which don't follow frame
+ * boundaries: whatever follows the end of a frame is kept in the input
+ * buffer for the next read.
+ */
+typedef struct {
+    void* impl_ptr;
+    const voltronic_dev_impl_t* impl;
+    int stale;                      /* a late response might be on its way */
+    size_t input_start;
+    size_t input_size;
+    char input[INPUT_BUFFER_SIZE];
+} voltronic_dev_internal_t;
+
+#define GET_INTERNAL_DEV(_voltronic_dev_t_) \
+    ((voltronic_dev_internal_t*) (_voltronic_dev_t_))
 
 #define GET_IMPL_DEV(_voltronic_dev_t_) \
-    ((void*) (_voltronic_dev_t_))
+    (GET_INTERNAL_DEV(_voltronic_dev_t_)->impl_ptr)
+
+#define GET_IMPL(_voltronic_dev_t_) \
+    (GET_INTERNAL_DEV(_voltronic_dev_t_)->impl)
 
 #if defined(_WIN32) || defined(WIN32)
 
@@ -87,7 +111,19 @@ int voltronic_dev_read(
     const unsigned int timeout_milliseconds) {
 
     if (buffer_size > 0) {
-        const int result = voltronic_dev_impl_read(
+        voltronic_dev_internal_t* internal = GET_INTERNAL_DEV(dev);
+        if (internal->input_size > 0) {
+            const size_t size = buffer_size < internal->input_size
+                ? buffer_size
+                : internal->input_size;
+
+            COPY_MEMORY(buffer, &internal->input[internal->input_start], size);
+            internal->input_start += size;
+            internal->input_size -= size;
+            return size;
+        }
+
+        const int result = GET_IMPL(dev)->read(
             GET_IMPL_DEV(dev),
             buffer,
             buffer_size,
@@ -106,7 +142,7 @@ int voltronic_dev_write(
     const unsigned int timeout_milliseconds) {
 
     if (buffer_size > 0) {
-        const int result = voltronic_dev_impl_write(
+        const int result = GET_IMPL(dev)->write(
             GET_IMPL_DEV(dev),
             buffer,
             buffer_size,
@@ -120,7 +156,8 @@ int voltronic_dev_write(
 
 int voltronic_dev_close(voltronic_dev_t dev) {
     if (dev != 0) {
-        const int result = voltronic_dev_impl_close(GET_IMPL_DEV(dev));
+        const int result = GET_IMPL(dev)->close(GET_IMPL_DEV(dev));
+        FREE_MEMORY(GET_INTERNAL_DEV(dev));
         return result > 0 ? 1 : 0;
     } else {
         SET_INVALID_INPUT();
@@ -128,66 +165,139 @@ int voltronic_dev_close(voltronic_dev_t dev) {
     }
 }
 
+/* Appends whatever the device sends to the input buffer. */
+static int voltronic_fill_input(
+    voltronic_dev_internal_t* internal,
+    const unsigned int timeout_milliseconds) {
+
+    if (internal->input_start > 0) {
+        memmove(internal->input, &internal->input[internal->input_start], internal->input_size);
+        internal->input_start = 0;
+    }
+
+    const int bytes_read = internal->impl->read(
+        internal->impl_ptr,
+        &internal->input[internal->input_size],
+        sizeof(internal->input) - internal->input_size,
+        timeout_milliseconds);
+
+    if (bytes_read > 0) {
+        internal->input_size += bytes_read;
+    }
+
+    return bytes_read >= 0 ? bytes_read : -1;
+}
+
+/* The last report of a frame is padded with zeroes. */
+static void voltronic_skip_padding(voltronic_dev_internal_t* internal) {
+    while (internal->input_size > 0 && internal->input[internal->input_start] == 0) {
+        ++internal->input_start;
+        --internal->input_size;
+    }
+}
+
+/* Discards leftovers of previous exchanges, e.g. a response that came after
+   its command had timed out, so that it's not taken for the next one. */
+static void voltronic_drain_input(voltronic_dev_internal_t* internal) {
+    if (!internal->stale && internal->input_size == 0) {
+        return;
+    }
+
+    const last_error_t last_error = GET_LAST_ERROR();
+    for (int i = 0; i < DRAIN_MAX_READS; i++) {
+        if (internal->input_size > 0) {
+            LOG("%s: discarding %zu stale %s:\n",
+                __func__, internal->input_size, (internal->input_size > 1 ? "bytes" : "byte"));
+            HEXDUMP(&internal->input[internal->input_start], internal->input_size);
+            internal->input_start = 0;
+            internal->input_size = 0;
+        }
+
+        if (voltronic_fill_input(internal, DRAIN_TIMEOUT) <= 0) {
+            break;
+        }
+    }
+    SET_LAST_ERROR(last_error);
+
+    internal->stale = 0;
+}
+
+/* Moves the first complete frame from the input buffer to buffer.
+   Returns its size, 0 if there's no complete frame yet, -1 on overflow. */
+static int voltronic_take_frame(
+    voltronic_dev_internal_t* internal,
+    char* buffer,
+    size_t buffer_length) {
+
+    voltronic_skip_padding(internal);
+
+    const char* input = &internal->input[internal->input_start];
+    const char* end = memchr(input, END_OF_INPUT, internal->input_size);
+
+    if (end != 0) {
+        const size_t size = end - input + END_OF_INPUT_SIZE;
+        internal->input_start += size;
+        internal->input_size -= size;
+        voltronic_skip_padding(internal);
+
+        if (size > buffer_length) {
+            SET_BUFFER_OVERFLOW();
+            return -1;
+        }
+
+        COPY_MEMORY(buffer, input, size);
+        return size;
+    }
+
+    if (internal->input_size == sizeof(internal->input)) {
+        internal->input_start = 0;
+        internal->input_size = 0;
+        internal->stale = 1;
+        SET_BUFFER_OVERFLOW();
+        return -1;
+    }
+
+    return 0;
+}
+
 static int voltronic_read_data_loop(
     const voltronic_dev_t dev,
     char* buffer,
     size_t buffer_length,
     const unsigned int timeout_milliseconds) {
 
-    unsigned int size = 0;
+    voltronic_dev_internal_t* internal = GET_INTERNAL_DEV(dev);
 
     const millisecond_timestamp_t start_time = get_millisecond_timestamp();
     millisecond_timestamp_t elapsed = 0;
 
     while(1) {
-        int bytes_read = voltronic_dev_read(
-            dev,
-            buffer,
-            buffer_length,
-            timeout_milliseconds - elapsed);
-
-        if (bytes_read >= 0) {
-            while(bytes_read) {
-                --bytes_read;
-                ++size;
-
-                if (*buffer == END_OF_INPUT) {
-                    return size;
-                }
-
-                buffer += sizeof(char);
-                --buffer_length;
-            }
+        const int frame_size = voltronic_take_frame(internal, buffer, buffer_length);
+        if (frame_size != 0) {
+            return frame_size;
+        }
 
-            elapsed = get_millisecond_timestamp() - start_time;
-            if (elapsed >= timeout_milliseconds) {
-                SET_TIMEOUT_REACHED();
-                return -1;
-            }
+        if (elapsed >= timeout_milliseconds) {
+            internal->stale = 1;
+            SET_TIMEOUT_REACHED();
+            return -1;
+        }
 
-            if (buffer_length <= 0) {
-                SET_BUFFER_OVERFLOW();
-                return -1;
-            }
-        } else {
-            return bytes_read;
+        if (voltronic_fill_input(internal, timeout_milliseconds - elapsed) < 0) {
+            internal->stale = 1;
+            return -1;
         }
+
+        elapsed = get_millisecond_timestamp() - start_time;
     }
 }
 
-static int voltronic_receive_data(
-    const voltronic_dev_t dev,
+/* Checks and strips the CRC and the end of input of a received frame. */
+static int voltronic_parse_frame(
     const unsigned int options,
     char *buffer,
-    const size_t buffer_length,
-    size_t *received,
-    const unsigned int timeout_milliseconds) {
-
-    const int result = voltronic_read_data_loop(
-        dev,
-        buffer,
-        buffer_length,
-        timeout_milliseconds);
+    const int result,
+    size_t *received) {
 
     if (result >= 0) {
         if (received)
@@ -204,7 +314,7 @@ static int voltronic_receive_data(
                 const voltronic_crc_t calculated_crc = calculate_voltronic_crc(buffer, data_size);
                 buffer[data_size] = 0;
 
-                if (((options & DISABLE_VERIFY_VOLTRONIC_CRC) == 0) ||
+                if (((options & DISABLE_VERIFY_VOLTRONIC_CRC) != 0) ||
                         (read_crc == calculated_crc)) {
 
                     return data_size;
@@ -229,6 +339,23 @@ static int voltronic_receive_data(
     return -1;
 }
 
+static int voltronic_receive_data(
+    const voltronic_dev_t dev,
+    const unsigned int options,
+    char *buffer,
+    const size_t buffer_length,
+    size_t *received,
+    const unsigned int timeout_milliseconds) {
+
+    const int result = voltronic_read_data_loop(
+        dev,
+        buffer,
+        buffer_length,
+        timeout_milliseconds);
+
+    return voltronic_parse_frame(options, buffer, result, received);
+}
+
 static int voltronic_write_data_loop(
     const voltronic_dev_t dev,
     const char* buffer,
@@ -268,37 +395,84 @@ static int voltronic_send_data(
     const size_t buffer_length,
     const unsigned int timeout_milliseconds) {
 
-    size_t copy_length;
-    char* copy;
-    if ((options & DISABLE_WRITE_VOLTRONIC_CRC) == 0) {
-        const voltronic_crc_t crc = calculate_voltronic_crc(buffer, buffer_length);
+    if ((options & WRITE_FRAMED_VOLTRONIC_INPUT) != 0) {
+        LOG("%s: writing %zu %s:\n",
+            __func__, buffer_length, (buffer_length > 1 ? "bytes" : "byte"));
+        HEXDUMP(buffer, buffer_length);
+
+        return voltronic_write_data_loop(
+            dev,
+            buffer,
+            buffer_length,
+            timeout_milliseconds);
+    }
 
-        copy_length = buffer_length + NON_DATA_SIZE;
-        copy = (char*) ALLOCATE_MEMORY(copy_length * sizeof(char));
+    /* P18 commands are short, so the frame is normally built on the stack;
+       the heap is used only for unusually long commands */
+    char stack_frame[SEND_FRAME_SIZE];
+    char* frame = stack_frame;
+    size_t frame_length;
 
-        write_voltronic_crc(crc, &copy[buffer_length]);
+    if ((options & DISABLE_WRITE_VOLTRONIC_CRC) == 0) {
+        frame_length = buffer_length + NON_DATA_SIZE;
     } else {
-        copy_length = buffer_length + END_OF_INPUT_SIZE;
-        copy = (char*) ALLOCATE_MEMORY(copy_length * sizeof(char));
+        frame_length = buffer_length + END_OF_INPUT_SIZE;
     }
 
-    COPY_MEMORY(copy, buffer, buffer_length * sizeof(char));
-    copy[copy_length - 1] = END_OF_INPUT;
+    if (frame_length > sizeof(stack_frame)) {
+        frame = (char*) ALLOCATE_MEMORY(frame_length * sizeof(char));
+        if (frame == 0) {
+            SET_LAST_ERROR(ENOMEM);
+            return -1;
+        }
+    }
+
+    COPY_MEMORY(frame, buffer, buffer_length * sizeof(char));
+    if ((options & DISABLE_WRITE_VOLTRONIC_CRC) == 0) {
+        const voltronic_crc_t crc = calculate_voltronic_crc(buffer, buffer_length);
+        write_voltronic_crc(crc, &frame[buffer_length]);
+    }
+    frame[frame_length - 1] = END_OF_INPUT;
 
     LOG("%s: writing %zu %s:\n",
-        __func__, copy_length, (copy_length > 1 ? "bytes" : "byte"));
-    HEXDUMP(copy, copy_length);
+        __func__, frame_length, (frame_length > 1 ? "bytes" : "byte"));
+    HEXDUMP(frame, frame_length);
 
     const int result = voltronic_write_data_loop(
         dev,
-        copy,
-        copy_length,
+        frame,
+        frame_length,
         timeout_milliseconds);
 
-    FREE_MEMORY(copy);
+    if (frame != stack_frame) {
+        FREE_MEMORY(frame);
+    }
 
     return result;
+}
+
+int voltronic_dev_send(
+    const voltronic_dev_t dev,
+    const unsigned int options,
+    const char *send_buffer,
+    size_t send_buffer_length,
+    const unsigned int timeout_milliseconds) {
+
+    voltronic_drain_input(GET_INTERNAL_DEV(dev));
 
+    const int result = voltronic_send_data(
+        dev,
+        options,
+        send_buffer,
+        send_buffer_length,
+        timeout_milliseconds);
+
+    if (result > 0) {
+        return 1;
+    }
+
+    GET_INTERNAL_DEV(dev)->stale = 1;
+    return 0;
 }
 
 int voltronic_dev_execute(
@@ -315,6 +489,8 @@ int voltronic_dev_execute(
     millisecond_timestamp_t elapsed = 0;
     int result;
 
+    voltronic_drain_input(GET_INTERNAL_DEV(dev));
+
     result = voltronic_send_data(
         dev,
         options,
@@ -337,6 +513,7 @@ int voltronic_dev_execute(
                 return result;
             }
         } else {
+            GET_INTERNAL_DEV(dev)->stale = 1;
             SET_TIMEOUT_REACHED();
         }
     }
@@ -344,15 +521,83 @@ int voltronic_dev_execute(
     return 0;
 }
 
-voltronic_dev_t voltronic_dev_internal_create(void* impl_ptr) {
+int voltronic_dev_receive(
+    const voltronic_dev_t dev,
+    const unsigned int options,
+    char *receive_buffer,
+    size_t receive_buffer_length,
+    size_t *received,
+    const unsigned int timeout_milliseconds) {
+
+    const int result = voltronic_receive_data(
+        dev,
+        options,
+        receive_buffer,
+        receive_buffer_length,
+        received,
+        timeout_milliseconds);
+
+    return result > 0 ? result : 0;
+}
+
+int voltronic_dev_receive_available(
+    const voltronic_dev_t dev,
+    const unsigned int options,
+    char *receive_buffer,
+    size_t receive_buffer_length,
+    size_t *received) {
+
+    voltronic_dev_internal_t* internal = GET_INTERNAL_DEV(dev);
+
+    int result = voltronic_take_frame(internal, receive_buffer, receive_buffer_length);
+    while (result == 0) {
+        const int bytes_read = voltronic_fill_input(internal, 0);
+        if (bytes_read < 0) {
+            internal->stale = 1;
+            result = -1;
+            break;
+        }
+        if (bytes_read == 0) {
+            if (received)
+                *received = 0;
+            SET_LAST_ERROR(EAGAIN);
+            return 0;
+        }
+        result = voltronic_take_frame(internal, receive_buffer, receive_buffer_length);
+    }
+
+    result = voltronic_parse_frame(options, receive_buffer, result, received);
+    return result > 0 ? result : -1;
+}
+
+int voltronic_dev_fd(const voltronic_dev_t dev) {
+    const voltronic_dev_impl_t* impl = GET_IMPL(dev);
+    return impl->fd != 0 ? impl->fd(GET_IMPL_DEV(dev)) : -1;
+}
+
+voltronic_dev_t voltronic_dev_internal_create(
+    void* impl_ptr,
+    const voltronic_dev_impl_t* impl) {
+
     if (is_platform_supported_by_libvoltronic()) {
         if (impl_ptr != 0) {
-            return ((voltronic_dev_t) (impl_ptr));
+            voltronic_dev_internal_t* internal = (voltronic_dev_internal_t*)
+                ALLOCATE_MEMORY(sizeof(voltronic_dev_internal_t));
+
+            if (internal != 0) {
+                internal->impl_ptr = impl_ptr;
+                internal->impl = impl;
+                /* there may be something left from whoever used the device before */
+                internal->stale = 1;
+                internal->input_start = 0;
+                internal->input_size = 0;
+                return ((voltronic_dev_t) (internal));
+            }
         }
     }
 
     if (impl_ptr != 0) {
-        voltronic_dev_impl_close(impl_ptr);
+        impl->close(impl_ptr);
     }
 
     return 0;
@@ -383,17 +628,12 @@ voltronic_dev_t voltronic_dev_internal_create(void* impl_ptr) {
 
         #if defined(CLOCK_MONOTONIC)
 
-        static int monotonic_clock_error = 0;
-        if (monotonic_clock_error == 0) {
-            struct timespec ts;
-            if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
-                milliseconds = (millisecond_timestamp_t) ts.tv_sec;
-                milliseconds *= 1000;
-                milliseconds += (millisecond_timestamp_t) (ts.tv_nsec / 1000000);
-                return milliseconds;
-            } else {
-                monotonic_clock_error = 1;
-            }
+        struct timespec ts;
+        if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+            milliseconds = (millisecond_timestamp_t) ts.tv_sec;
+            milliseconds *= 1000;
+            milliseconds += (millisecond_timestamp_t) (ts.tv_nsec / 1000000);
+            return milliseconds;
         }
 
         #endif
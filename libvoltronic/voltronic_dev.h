@@ -72,6 +72,25 @@ int voltronic_dev_write(
 #define DISABLE_WRITE_VOLTRONIC_CRC                (1 << 0)
 #define DISABLE_PARSE_VOLTRONIC_CRC                (1 << 1)
 #define DISABLE_VERIFY_VOLTRONIC_CRC             (1 << 2)
+#define WRITE_FRAMED_VOLTRONIC_INPUT             (1 << 3) /* send_buffer already ends with the CRC and '\r' */
+
+/**
+ * Write a command to the device without waiting for a response, which can
+ * then be picked up with voltronic_dev_receive_available or
+ * voltronic_dev_receive
+ *
+ * Arguments are the same as of voltronic_dev_execute
+ *
+ * Returns 1 on success and 0 on failure
+ *
+ * Function sets errno (POSIX)/LastError (Windows) to approriate error on failure
+ */
+int voltronic_dev_send(
+    const voltronic_dev_t dev,
+    const unsigned int options,
+    const char *send_buffer,
+    size_t send_buffer_length,
+    const unsigned int timeout_milliseconds);
 
 /**
  * Write a command to the device and wait for a response from the device
@@ -98,6 +117,50 @@ int voltronic_dev_execute(
     size_t *received,
     const unsigned int timeout_milliseconds);
 
+/**
+ * Wait for one more response from the device, e.g. after the one returned by
+ * voltronic_dev_execute turned out to belong to an earlier command
+ *
+ * Arguments and return value are the same as of voltronic_dev_execute
+ *
+ * Function sets errno (POSIX)/LastError (Windows) to approriate error on failure
+ */
+int voltronic_dev_receive(
+    const voltronic_dev_t dev,
+    const unsigned int options,
+    char *receive_buffer,
+    size_t receive_buffer_length,
+    size_t *received,
+    const unsigned int timeout_milliseconds);
+
+/**
+ * Take a response if the device has sent a complete one, without waiting
+ *
+ * Arguments are the same as of voltronic_dev_execute
+ *
+ * Returns the size of the response
+ * Returns 0 if there's no complete response yet, errno is then EAGAIN
+ * Returns -1 on error
+ *
+ * Function sets errno (POSIX)/LastError (Windows) to approriate error on failure
+ */
+int voltronic_dev_receive_available(
+    const voltronic_dev_t dev,
+    const unsigned int options,
+    char *receive_buffer,
+    size_t receive_buffer_length,
+    size_t *received);
+
+/**
+ * File descriptor that becomes readable when the device sends something,
+ * for use with poll/epoll and voltronic_dev_receive_available
+ *
+ * Returns -1 if the implementation doesn't have one, the device then has
+ * to be checked periodically
+ */
+int voltronic_dev_fd(
+    const voltronic_dev_t dev);
+
 /**
  * Close the connection to the device
  *
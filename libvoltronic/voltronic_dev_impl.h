@@ -30,62 +30,79 @@
   #include "voltronic_dev.h"
 
   /**
-   * Read up to buffer_size bytes from the device
-   *
-   * impl_ptr -> The underlying implementation's device pointer
-   * buffer -> The buffer to store data from the device
-   * buffer_size -> The maximum number of bytes to read
-   * timeout_milliseconds -> Number of milliseconds before giving up
-   *
-   * Return the number of bytes successfully read from the device.
-   * On failure returns < 0
-   *
-   * On failure set the appropriate error using SET_LAST_ERROR
+   * Functions of an implementation, voltronic_dev.c calls them through this
+   * table so that several implementations can be linked in at once
    */
-  int voltronic_dev_impl_read(
-    void* impl_ptr,
-    char* buffer,
-    const size_t buffer_size,
-    const unsigned int timeout_milliseconds);
-
-  /**
-   * Write the provided buffer data to the device
-   *
-   * impl_ptr -> The underlying implementation's device pointer
-   * buffer -> The data to write to the device
-   * buffer_size -> Number of bytes to write to the device
-   * timeout_milliseconds -> Number of milliseconds before giving up
-   *
-   * Return the number of bytes successfully written to the device.
-   * On failure returns < 0
-   *
-   * On failure set the appropriate error using SET_LAST_ERROR
-   */
-  int voltronic_dev_impl_write(
-    void* impl_ptr,
-    const char* buffer,
-    const size_t buffer_size,
-    const unsigned int timeout_milliseconds);
-
-  /**
-   * Accept the implementation pointer and close the underlying device connection
-   *
-   * Returns 0 on failure, anything else is considered success
-   *
-   * On failure set the appropriate error using SET_LAST_ERROR
-   */
-  int voltronic_dev_impl_close(
-    void* impl_ptr);
+  typedef struct {
+    /**
+     * Read up to buffer_size bytes from the device
+     *
+     * impl_ptr -> The underlying implementation's device pointer
+     * buffer -> The buffer to store data from the device
+     * buffer_size -> The maximum number of bytes to read
+     * timeout_milliseconds -> Number of milliseconds before giving up
+     *
+     * Return the number of bytes successfully read from the device.
+     * On failure returns < 0
+     *
+     * On failure set the appropriate error using SET_LAST_ERROR
+     */
+    int (*read)(
+      void* impl_ptr,
+      char* buffer,
+      const size_t buffer_size,
+      const unsigned int timeout_milliseconds);
+
+    /**
+     * Write the provided buffer data to the device
+     *
+     * impl_ptr -> The underlying implementation's device pointer
+     * buffer -> The data to write to the device
+     * buffer_size -> Number of bytes to write to the device
+     * timeout_milliseconds -> Number of milliseconds before giving up
+     *
+     * Return the number of bytes successfully written to the device.
+     * On failure returns < 0
+     *
+     * On failure set the appropriate error using SET_LAST_ERROR
+     */
+    int (*write)(
+      void* impl_ptr,
+      const char* buffer,
+      const size_t buffer_size,
+      const unsigned int timeout_milliseconds);
+
+    /**
+     * Accept the implementation pointer and close the underlying device connection
+     *
+     * Returns 0 on failure, anything else is considered success
+     *
+     * On failure set the appropriate error using SET_LAST_ERROR
+     */
+    int (*close)(
+      void* impl_ptr);
+
+    /**
+     * Return a file descriptor that becomes readable when there's something
+     * to read, see voltronic_dev_fd
+     *
+     * May be 0 if there's no such descriptor
+     */
+    int (*fd)(
+      void* impl_ptr);
+  } voltronic_dev_impl_t;
 
   /**
    * Create the opaque pointer representing a connection to a physical voltronic device
    *
    * impl_ptr -> The underlying implementation's device pointer
+   * impl -> The implementation's functions, closes impl_ptr on failure
    *
    * On failure sets the appropriate error using SET_LAST_ERROR
    */
   voltronic_dev_t voltronic_dev_internal_create(
-    void* impl_ptr);
+    void* impl_ptr,
+    const voltronic_dev_impl_t* impl);
 
   /**
    * May change if operating system requires it.
@@ -21,6 +21,29 @@
 
 #define VOLTRONIC_DEV_SP(_impl_ptr_) ((struct sp_port*) (_impl_ptr_))
 
+static int voltronic_serial_read(
+  void* impl_ptr,
+  char* buffer,
+  const size_t buffer_size,
+  const unsigned int timeout_milliseconds);
+
+static int voltronic_serial_write(
+  void* impl_ptr,
+  const char* buffer,
+  const size_t buffer_size,
+  const unsigned int timeout_milliseconds);
+
+static int voltronic_serial_close(void* impl_ptr);
+
+static int voltronic_serial_fd(void* impl_ptr);
+
+static const voltronic_dev_impl_t voltronic_serial_impl = {
+  voltronic_serial_read,
+  voltronic_serial_write,
+  voltronic_serial_close,
+  voltronic_serial_fd
+};
+
 static int voltronic_dev_serial_configure(
   struct sp_port* port,
   const baud_rate_t baud_rate,
@@ -52,7 +75,7 @@ voltronic_dev_t voltronic_serial_create(
       if (voltronic_dev_serial_configure(port, baud_rate, data_bits, stop_bits, parity) > 0) {
         sp_flush(port, SP_BUF_BOTH);
         SET_LAST_ERROR(0);
-        return voltronic_dev_internal_create((void*) port);
+        return voltronic_dev_internal_create((void*) port, &voltronic_serial_impl);
       }
     }
 
@@ -64,7 +87,7 @@ voltronic_dev_t voltronic_serial_create(
   return 0;
 }
 
-inline int voltronic_dev_impl_read(
+static int voltronic_serial_read(
     void* impl_ptr,
     char* buffer,
     const size_t buffer_size,
@@ -78,7 +101,7 @@ inline int voltronic_dev_impl_read(
     (unsigned int) timeout_milliseconds);
 }
 
-inline int voltronic_dev_impl_write(
+static int voltronic_serial_write(
     void* impl_ptr,
     const char* buffer,
     const size_t buffer_size,
@@ -92,7 +115,7 @@ inline int voltronic_dev_impl_write(
     (unsigned int) timeout_milliseconds);
 }
 
-inline int voltronic_dev_impl_close(void* impl_ptr) {
+static int voltronic_serial_close(void* impl_ptr) {
   struct sp_port* sp_port = VOLTRONIC_DEV_SP(impl_ptr);
   SET_LAST_ERROR(0);
   const enum sp_return result = sp_close(sp_port);
@@ -104,6 +127,19 @@ inline int voltronic_dev_impl_close(void* impl_ptr) {
   }
 }
 
+static int voltronic_serial_fd(void* impl_ptr) {
+#if defined(_WIN32) || defined(WIN32)
+  (void) impl_ptr;
+  return -1;
+#else
+  int fd = -1;
+  if (sp_get_port_handle(VOLTRONIC_DEV_SP(impl_ptr), &fd) != SP_OK) {
+    return -1;
+  }
+  return fd;
+#endif
+}
+
 static inline int voltronic_dev_baud_rate(
   const baud_rate_t baud_rate) {
 
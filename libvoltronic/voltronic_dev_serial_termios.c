@@ -0,0 +1,319 @@
+/**
+ * Copyright (C) 2020  Evgeny Zinoviev
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * POSIX serial implementation on top of termios, without libserialport.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <time.h>
+#include "voltronic_dev_impl.h"
+#include "voltronic_dev_serial.h"
+
+/* responses end with it, and the CRC never contains it */
+#define END_OF_INPUT '\r'
+
+#define VOLTRONIC_DEV_TERMIOS(_impl_ptr_) \
+  ((voltronic_termios_t*) (_impl_ptr_))
+
+typedef struct {
+  int fd;
+} voltronic_termios_t;
+
+static int voltronic_serial_read(
+  void* impl_ptr,
+  char* buffer,
+  const size_t buffer_size,
+  const unsigned int timeout_milliseconds);
+
+static int voltronic_serial_write(
+  void* impl_ptr,
+  const char* buffer,
+  const size_t buffer_size,
+  const unsigned int timeout_milliseconds);
+
+static int voltronic_serial_close(void* impl_ptr);
+
+static int voltronic_serial_fd(void* impl_ptr);
+
+static const voltronic_dev_impl_t voltronic_serial_impl = {
+  voltronic_serial_read,
+  voltronic_serial_write,
+  voltronic_serial_close,
+  voltronic_serial_fd
+};
+
+static int voltronic_termios_configure(
+  const int fd,
+  const baud_rate_t baud_rate,
+  const data_bits_t data_bits,
+  const stop_bits_t stop_bits,
+  const serial_parity_t parity);
+
+voltronic_dev_t voltronic_serial_create(
+    const char* name,
+    const baud_rate_t baud_rate,
+    const data_bits_t data_bits,
+    const stop_bits_t stop_bits,
+    const serial_parity_t parity) {
+
+  if (name == 0) {
+    SET_INVALID_INPUT();
+    return 0;
+  }
+
+  SET_LAST_ERROR(0);
+  const int fd = open(name, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+  if (fd < 0) {
+    return 0;
+  }
+
+  if (voltronic_termios_configure(fd, baud_rate, data_bits, stop_bits, parity) > 0) {
+    voltronic_termios_t* dev = (voltronic_termios_t*)
+      ALLOCATE_MEMORY(sizeof(voltronic_termios_t));
+
+    if (dev != 0) {
+      tcflush(fd, TCIOFLUSH);
+      dev->fd = fd;
+      SET_LAST_ERROR(0);
+      return voltronic_dev_internal_create((void*) dev, &voltronic_serial_impl);
+    }
+
+    SET_LAST_ERROR(ENOMEM);
+  }
+
+  const last_error_t last_error = GET_LAST_ERROR();
+  close(fd);
+  SET_LAST_ERROR(last_error);
+
+  return 0;
+}
+
+static long long voltronic_termios_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Waits for events on fd until the deadline, returns 0 on timeout. */
+static int voltronic_termios_poll(
+  const int fd,
+  const short events,
+  const long long deadline) {
+
+  struct pollfd pfd = { fd, events, 0 };
+  while (1) {
+    long long timeout = deadline - voltronic_termios_now();
+    if (timeout < 0) {
+      timeout = 0;
+    }
+
+    const int result = poll(&pfd, 1, (int) timeout);
+    if (result < 0 && errno == EINTR) {
+      continue;
+    }
+    if (result > 0 && (pfd.revents & (POLLERR | POLLHUP | POLLNVAL))) {
+      SET_LAST_ERROR(ENODEV);
+      return -1;
+    }
+    return result;
+  }
+}
+
+/**
+ * Takes everything the tty has buffered with each read(), and keeps waiting
+ * until the end of a frame is seen, so that a whole response is normally
+ * returned by one call even at 2400 baud
+ */
+static int voltronic_serial_read(
+  void* impl_ptr,
+  char* buffer,
+  const size_t buffer_size,
+  const unsigned int timeout_milliseconds) {
+
+  const int fd = VOLTRONIC_DEV_TERMIOS(impl_ptr)->fd;
+  const long long deadline = voltronic_termios_now() + timeout_milliseconds;
+  size_t size = 0;
+
+  SET_LAST_ERROR(0);
+  while (size < buffer_size) {
+    const ssize_t bytes_read = read(fd, &buffer[size], buffer_size - size);
+    if (bytes_read > 0) {
+      const int complete = memchr(&buffer[size], END_OF_INPUT, (size_t) bytes_read) != 0;
+      size += (size_t) bytes_read;
+      if (complete) {
+        break;
+      }
+      continue;
+    }
+
+    /* with VMIN and VTIME at 0, a tty returns 0 when there's nothing to read */
+    if (bytes_read < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        return -1;
+      }
+    }
+
+    const int poll_result = voltronic_termios_poll(fd, POLLIN, deadline);
+    if (poll_result < 0) {
+      return -1;
+    }
+    if (poll_result == 0) {
+      /* the caller gets what has arrived so far */
+      SET_LAST_ERROR(0);
+      break;
+    }
+  }
+
+  return (int) size;
+}
+
+static int voltronic_serial_write(
+  void* impl_ptr,
+  const char* buffer,
+  const size_t buffer_size,
+  const unsigned int timeout_milliseconds) {
+
+  const int fd = VOLTRONIC_DEV_TERMIOS(impl_ptr)->fd;
+  const long long deadline = voltronic_termios_now() + timeout_milliseconds;
+  size_t written = 0;
+
+  SET_LAST_ERROR(0);
+  while (written < buffer_size) {
+    const ssize_t result = write(fd, &buffer[written], buffer_size - written);
+    if (result >= 0) {
+      written += (size_t) result;
+      continue;
+    }
+
+    if (errno == EINTR) {
+      continue;
+    }
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      return written > 0 ? (int) written : -1;
+    }
+
+    const int poll_result = voltronic_termios_poll(fd, POLLOUT, deadline);
+    if (poll_result <= 0) {
+      break;
+    }
+  }
+
+  return (int) written;
+}
+
+static int voltronic_serial_close(void* impl_ptr) {
+  voltronic_termios_t* dev = VOLTRONIC_DEV_TERMIOS(impl_ptr);
+  const int result = close(dev->fd);
+  FREE_MEMORY(dev);
+  return result == 0 ? 1 : 0;
+}
+
+static int voltronic_serial_fd(void* impl_ptr) {
+  return VOLTRONIC_DEV_TERMIOS(impl_ptr)->fd;
+}
+
+static speed_t voltronic_termios_speed(
+  const baud_rate_t baud_rate) {
+
+  switch (baud_rate) {
+    case 1200: return B1200;
+    case 2400: return B2400;
+    case 4800: return B4800;
+    case 9600: return B9600;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    case 115200: return B115200;
+    default: return B0;
+  }
+}
+
+static int voltronic_termios_configure(
+  const int fd,
+  const baud_rate_t baud_rate,
+  const data_bits_t data_bits,
+  const stop_bits_t stop_bits,
+  const serial_parity_t parity) {
+
+  const speed_t speed = voltronic_termios_speed(baud_rate);
+  struct termios tio;
+
+  SET_LAST_ERROR(0);
+  if (tcgetattr(fd, &tio) != 0) {
+    return 0;
+  }
+
+  cfmakeraw(&tio);
+  tio.c_cflag |= CLOCAL | CREAD;
+  tio.c_cflag &= ~(CSIZE | CSTOPB | PARENB | PARODD | CRTSCTS);
+  tio.c_iflag &= ~(IXON | IXOFF | IXANY | INPCK);
+#if defined(CMSPAR)
+  tio.c_cflag &= ~CMSPAR;
+#endif
+
+  switch (data_bits) {
+    case DATA_BITS_FIVE: tio.c_cflag |= CS5; break;
+    case DATA_BITS_SIX: tio.c_cflag |= CS6; break;
+    case DATA_BITS_SEVEN: tio.c_cflag |= CS7; break;
+    case DATA_BITS_EIGHT: tio.c_cflag |= CS8; break;
+    default: SET_INVALID_INPUT(); return 0;
+  }
+
+  switch (stop_bits) {
+    case STOP_BITS_ONE: break;
+    case STOP_BITS_TWO: tio.c_cflag |= CSTOPB; break;
+    default: SET_INVALID_INPUT(); return 0;
+  }
+
+  switch (parity) {
+    case SERIAL_PARITY_NONE: break;
+    case SERIAL_PARITY_ODD: tio.c_cflag |= PARENB | PARODD; tio.c_iflag |= INPCK; break;
+    case SERIAL_PARITY_EVEN: tio.c_cflag |= PARENB; tio.c_iflag |= INPCK; break;
+#if defined(CMSPAR)
+    case SERIAL_PARITY_MARK: tio.c_cflag |= PARENB | PARODD | CMSPAR; break;
+    case SERIAL_PARITY_SPACE: tio.c_cflag |= PARENB | CMSPAR; break;
+#endif
+    default: SET_INVALID_INPUT(); return 0;
+  }
+
+  /* reads never block, waiting is done with poll() */
+  tio.c_cc[VMIN] = 0;
+  tio.c_cc[VTIME] = 0;
+
+  if (speed == B0 || cfsetispeed(&tio, speed) != 0 || cfsetospeed(&tio, speed) != 0) {
+    SET_INVALID_INPUT();
+    return 0;
+  }
+
+  if (tcsetattr(fd, TCSANOW, &tio) != 0) {
+    return 0;
+  }
+
+  return 1;
+}
@@ -0,0 +1,340 @@
+/**
+ * Copyright (C) 2020  Evgeny Zinoviev
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * POSIX implementation for devices behind transparent serial-to-Ethernet
+ * bridges: P18 frames are sent and received over TCP as they are.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <time.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "voltronic_dev_impl.h"
+#include "voltronic_dev_tcp.h"
+
+/* responses end with it, and the CRC never contains it */
+#define END_OF_INPUT '\r'
+
+/* a dead connection is noticed after about KEEPALIVE_IDLE + KEEPALIVE_INTERVAL * KEEPALIVE_COUNT seconds */
+#define KEEPALIVE_IDLE 10
+#define KEEPALIVE_INTERVAL 5
+#define KEEPALIVE_COUNT 3
+
+#if defined(MSG_NOSIGNAL)
+  #define SEND_FLAGS MSG_NOSIGNAL
+#else
+  #define SEND_FLAGS 0
+#endif
+
+#define VOLTRONIC_DEV_TCP(_impl_ptr_) \
+  ((voltronic_tcp_t*) (_impl_ptr_))
+
+typedef struct {
+  int fd;
+} voltronic_tcp_t;
+
+static int voltronic_tcp_read(
+  void* impl_ptr,
+  char* buffer,
+  const size_t buffer_size,
+  const unsigned int timeout_milliseconds);
+
+static int voltronic_tcp_write(
+  void* impl_ptr,
+  const char* buffer,
+  const size_t buffer_size,
+  const unsigned int timeout_milliseconds);
+
+static int voltronic_tcp_close(void* impl_ptr);
+
+static int voltronic_tcp_fd(void* impl_ptr);
+
+static const voltronic_dev_impl_t voltronic_tcp_impl = {
+  voltronic_tcp_read,
+  voltronic_tcp_write,
+  voltronic_tcp_close,
+  voltronic_tcp_fd
+};
+
+static int voltronic_tcp_connect(
+  const struct addrinfo* addr,
+  const long long deadline);
+
+static long long voltronic_tcp_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+voltronic_dev_t voltronic_tcp_create(
+    const char* host,
+    const char* port,
+    const unsigned int timeout_milliseconds) {
+
+  const long long deadline = voltronic_tcp_now() + timeout_milliseconds;
+  struct addrinfo hints;
+  struct addrinfo* addrs = 0;
+  int fd = -1;
+
+  if (host == 0 || port == 0) {
+    SET_INVALID_INPUT();
+    return 0;
+  }
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+
+  const int gai_result = getaddrinfo(host, port, &hints, &addrs);
+  if (gai_result != 0) {
+    if (gai_result != EAI_SYSTEM) {
+      SET_LAST_ERROR(ENXIO);
+    }
+    return 0;
+  }
+
+  SET_LAST_ERROR(ECONNREFUSED);
+  for (const struct addrinfo* addr = addrs; addr != 0 && fd < 0; addr = addr->ai_next) {
+    fd = voltronic_tcp_connect(addr, deadline);
+  }
+
+  const last_error_t last_error = GET_LAST_ERROR();
+  freeaddrinfo(addrs);
+  SET_LAST_ERROR(last_error);
+
+  if (fd < 0) {
+    return 0;
+  }
+
+  voltronic_tcp_t* dev = (voltronic_tcp_t*)
+    ALLOCATE_MEMORY(sizeof(voltronic_tcp_t));
+  if (dev == 0) {
+    close(fd);
+    SET_LAST_ERROR(ENOMEM);
+    return 0;
+  }
+
+  dev->fd = fd;
+  SET_LAST_ERROR(0);
+  return voltronic_dev_internal_create((void*) dev, &voltronic_tcp_impl);
+}
+
+/* Waits for events on fd until the deadline, returns 0 on timeout. */
+static int voltronic_tcp_poll(
+  const int fd,
+  const short events,
+  const long long deadline) {
+
+  struct pollfd pfd = { fd, events, 0 };
+  while (1) {
+    long long timeout = deadline - voltronic_tcp_now();
+    if (timeout < 0) {
+      timeout = 0;
+    }
+
+    const int result = poll(&pfd, 1, (int) timeout);
+    if (result < 0 && errno == EINTR) {
+      continue;
+    }
+    return result;
+  }
+}
+
+static void voltronic_tcp_set_options(const int fd) {
+  int on = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+  setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+#if defined(SO_NOSIGPIPE)
+  setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+
+  int idle = KEEPALIVE_IDLE;
+#if defined(TCP_KEEPIDLE)
+  setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+#elif defined(TCP_KEEPALIVE)
+  setsockopt(fd, IPPROTO_TCP, TCP_KEEPALIVE, &idle, sizeof(idle));
+#else
+  (void) idle;
+#endif
+
+#if defined(TCP_KEEPINTVL) && defined(TCP_KEEPCNT)
+  int interval = KEEPALIVE_INTERVAL;
+  int count = KEEPALIVE_COUNT;
+  setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+  setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count));
+#endif
+}
+
+/* Returns a connected non-blocking socket, or -1. */
+static int voltronic_tcp_connect(
+  const struct addrinfo* addr,
+  const long long deadline) {
+
+  const int fd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+  if (fd < 0) {
+    return -1;
+  }
+
+  if (fcntl(fd, F_SETFD, FD_CLOEXEC) == -1
+      || fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) == -1) {
+    const last_error_t last_error = GET_LAST_ERROR();
+    close(fd);
+    SET_LAST_ERROR(last_error);
+    return -1;
+  }
+
+  if (connect(fd, addr->ai_addr, addr->ai_addrlen) != 0) {
+    if (errno != EINPROGRESS) {
+      const last_error_t last_error = GET_LAST_ERROR();
+      close(fd);
+      SET_LAST_ERROR(last_error);
+      return -1;
+    }
+
+    int error = 0;
+    socklen_t error_size = sizeof(error);
+    const int poll_result = voltronic_tcp_poll(fd, POLLOUT, deadline);
+    if (poll_result <= 0) {
+      close(fd);
+      SET_LAST_ERROR(poll_result == 0 ? ETIMEDOUT : GET_LAST_ERROR());
+      return -1;
+    }
+
+    if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &error_size) != 0 || error != 0) {
+      close(fd);
+      SET_LAST_ERROR(error != 0 ? error : GET_LAST_ERROR());
+      return -1;
+    }
+  }
+
+  voltronic_tcp_set_options(fd);
+  return fd;
+}
+
+/**
+ * Takes everything that's there with each read(), and keeps waiting until
+ * the end of a frame is seen or the timeout is reached
+ */
+static int voltronic_tcp_read(
+  void* impl_ptr,
+  char* buffer,
+  const size_t buffer_size,
+  const unsigned int timeout_milliseconds) {
+
+  const int fd = VOLTRONIC_DEV_TCP(impl_ptr)->fd;
+  const long long deadline = voltronic_tcp_now() + timeout_milliseconds;
+  size_t size = 0;
+
+  SET_LAST_ERROR(0);
+  while (size < buffer_size) {
+    const ssize_t bytes_read = recv(fd, &buffer[size], buffer_size - size, 0);
+    if (bytes_read > 0) {
+      const int complete = memchr(&buffer[size], END_OF_INPUT, (size_t) bytes_read) != 0;
+      size += (size_t) bytes_read;
+      if (complete) {
+        break;
+      }
+      continue;
+    }
+
+    /* the bridge has closed the connection */
+    if (bytes_read == 0) {
+      SET_LAST_ERROR(ENOTCONN);
+      return -1;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      /* that's what keepalive fails with, and it's not a response timeout */
+      if (errno == ETIMEDOUT) {
+        SET_LAST_ERROR(ENOTCONN);
+      }
+      return -1;
+    }
+
+    const int poll_result = voltronic_tcp_poll(fd, POLLIN, deadline);
+    if (poll_result < 0) {
+      return -1;
+    }
+    if (poll_result == 0) {
+      SET_LAST_ERROR(0);
+      break;
+    }
+  }
+
+  return (int) size;
+}
+
+static int voltronic_tcp_write(
+  void* impl_ptr,
+  const char* buffer,
+  const size_t buffer_size,
+  const unsigned int timeout_milliseconds) {
+
+  const int fd = VOLTRONIC_DEV_TCP(impl_ptr)->fd;
+  const long long deadline = voltronic_tcp_now() + timeout_milliseconds;
+  size_t written = 0;
+
+  SET_LAST_ERROR(0);
+  while (written < buffer_size) {
+    const ssize_t result = send(fd, &buffer[written], buffer_size - written, SEND_FLAGS);
+    if (result >= 0) {
+      written += (size_t) result;
+      continue;
+    }
+
+    if (errno == EINTR) {
+      continue;
+    }
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      if (errno == ETIMEDOUT) {
+        SET_LAST_ERROR(ENOTCONN);
+      }
+      return written > 0 ? (int) written : -1;
+    }
+
+    const int poll_result = voltronic_tcp_poll(fd, POLLOUT, deadline);
+    if (poll_result <= 0) {
+      break;
+    }
+  }
+
+  return (int) written;
+}
+
+static int voltronic_tcp_close(void* impl_ptr) {
+  voltronic_tcp_t* dev = VOLTRONIC_DEV_TCP(impl_ptr);
+  const int result = close(dev->fd);
+  FREE_MEMORY(dev);
+  return result == 0 ? 1 : 0;
+}
+
+static int voltronic_tcp_fd(void* impl_ptr) {
+  return VOLTRONIC_DEV_TCP(impl_ptr)->fd;
+}
@@ -0,0 +1,43 @@
+/**
+ * Copyright (C) 2020  Evgeny Zinoviev
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __VOLTRONIC__DEV__TCP__H__
+#define __VOLTRONIC__DEV__TCP__H__
+
+  #include "voltronic_dev.h"
+
+  /**
+   * Create an opaque pointer to a voltronic device behind a transparent
+   * serial-to-Ethernet bridge, which passes frames as they are
+   *
+   * host - Host name or address of the bridge, ie. 192.168.1.10
+   * port - TCP port or service name, ie. 8899
+   * timeout_milliseconds - Number of milliseconds to wait for the connection
+   *
+   * TCP keepalive is enabled on the connection, so if the bridge goes away
+   * reads fail with ENOTCONN, and the device has to be closed and created again
+   *
+   * Returns an opaque pointer to a voltronic device or 0 if an error occurred
+   *
+   * Function sets errno (POSIX)/LastError (Windows) to approriate error on failure
+   */
+  voltronic_dev_t voltronic_tcp_create(
+    const char* host,
+    const char* port,
+    const unsigned int timeout_milliseconds);
+
+#endif
@@ -34,4 +34,59 @@
     const unsigned int vendor_id,
     const unsigned int product_id);
 
+  /**
+   * Create an opaque pointer to a voltronic device connected over USB
+   * with the specified serial number
+   *
+   * vendor_id - Device vendor id to search for. ie. 0x0665
+   * product_id - Device product id to search for. ie. 0x5161
+   * serial_number - USB serial number of the device
+   *
+   * Returns an opaque pointer to a voltronic device or 0 if an error occurred
+   *
+   * Function sets errno (POSIX)/LastError (Windows) to approriate error on failure
+   */
+  voltronic_dev_t voltronic_usb_create_serial(
+    const unsigned int vendor_id,
+    const unsigned int product_id,
+    const char* serial_number);
+
+  /**
+   * Create an opaque pointer to a voltronic device connected over USB
+   * by its platform specific path, ie. /dev/hidraw0 on Linux
+   *
+   * Returns an opaque pointer to a voltronic device or 0 if an error occurred
+   *
+   * Function sets errno (POSIX)/LastError (Windows) to approriate error on failure
+   */
+  voltronic_dev_t voltronic_usb_create_path(const char* path);
+
+  /**
+   * Called for every device found by voltronic_usb_enumerate
+   *
+   * Strings are only valid during the call and may be empty, but never 0
+   */
+  typedef void (*voltronic_usb_enumerate_fn_t)(
+    const char* path,
+    const char* serial_number,
+    const char* manufacturer,
+    const char* product,
+    void* ctx);
+
+  /**
+   * Find voltronic devices connected over USB
+   *
+   * vendor_id - Device vendor id to search for. ie. 0x0665
+   * product_id - Device product id to search for. ie. 0x5161
+   * callback - Called for every device found
+   * ctx - Passed to callback as is
+   *
+   * Returns the number of devices found
+   */
+  int voltronic_usb_enumerate(
+    const unsigned int vendor_id,
+    const unsigned int product_id,
+    voltronic_usb_enumerate_fn_t callback,
+    void* ctx);
+
 #endif
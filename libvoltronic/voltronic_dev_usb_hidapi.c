@@ -17,11 +17,14 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <wchar.h>
+#include <errno.h>
 #include "voltronic_dev_impl.h"
 #include "voltronic_dev_usb.h"
 #include "hidapi.h"
 
 #define HID_REPORT_SIZE 8
+#define VOLTRONIC_USB_STRING_SIZE 128
 
 #define VOLTRONIC_DEV_USB(_impl_ptr_) \
   ((hid_device*) (_impl_ptr_))
@@ -29,6 +32,27 @@
 #define GET_REPORT_SIZE(_val_) \
   (((_val_) > HID_REPORT_SIZE) ? HID_REPORT_SIZE : (_val_))
 
+static int voltronic_usb_read(
+  void* impl_ptr,
+  char* buffer,
+  const size_t buffer_size,
+  const unsigned int timeout_milliseconds);
+
+static int voltronic_usb_write(
+  void* impl_ptr,
+  const char* buffer,
+  const size_t buffer_size,
+  const unsigned int timeout_milliseconds);
+
+static int voltronic_usb_close(void* impl_ptr);
+
+static const voltronic_dev_impl_t voltronic_usb_impl = {
+  voltronic_usb_read,
+  voltronic_usb_write,
+  voltronic_usb_close,
+  0 /* hidapi doesn't expose the file descriptor */
+};
+
 static inline void voltronic_usb_init_hidapi(void);
 
 voltronic_dev_t voltronic_usb_create(
@@ -45,13 +69,102 @@ voltronic_dev_t voltronic_usb_create(
 
   if (dev != 0) {
     SET_LAST_ERROR(0);
-    return voltronic_dev_internal_create((void*) dev);
+    return voltronic_dev_internal_create((void*) dev, &voltronic_usb_impl);
+  }
+
+  return 0;
+}
+
+voltronic_dev_t voltronic_usb_create_serial(
+  const unsigned int vendor_id,
+  const unsigned int product_id,
+  const char* serial_number) {
+
+  wchar_t wserial[VOLTRONIC_USB_STRING_SIZE];
+  if (mbstowcs(wserial, serial_number, VOLTRONIC_USB_STRING_SIZE) >= VOLTRONIC_USB_STRING_SIZE) {
+    SET_LAST_ERROR(EINVAL);
+    return 0;
+  }
+
+  voltronic_usb_init_hidapi();
+
+  SET_LAST_ERROR(0);
+  hid_device* dev = hid_open(
+    (unsigned short) vendor_id,
+    (unsigned short) product_id,
+    wserial);
+
+  if (dev != 0) {
+    SET_LAST_ERROR(0);
+    return voltronic_dev_internal_create((void*) dev, &voltronic_usb_impl);
+  }
+
+  if (GET_LAST_ERROR() == 0) {
+    SET_LAST_ERROR(ENODEV);
+  }
+
+  return 0;
+}
+
+voltronic_dev_t voltronic_usb_create_path(const char* path) {
+  voltronic_usb_init_hidapi();
+
+  SET_LAST_ERROR(0);
+  hid_device* dev = hid_open_path(path);
+
+  if (dev != 0) {
+    SET_LAST_ERROR(0);
+    return voltronic_dev_internal_create((void*) dev, &voltronic_usb_impl);
+  }
+
+  if (GET_LAST_ERROR() == 0) {
+    SET_LAST_ERROR(ENODEV);
   }
 
   return 0;
 }
 
-inline int voltronic_dev_impl_read(
+static void voltronic_usb_wcstombs(
+  char* buffer,
+  const wchar_t* str) {
+
+  buffer[0] = 0;
+  if (str != 0 && wcstombs(buffer, str, VOLTRONIC_USB_STRING_SIZE) >= VOLTRONIC_USB_STRING_SIZE) {
+    buffer[0] = 0;
+  }
+}
+
+int voltronic_usb_enumerate(
+  const unsigned int vendor_id,
+  const unsigned int product_id,
+  voltronic_usb_enumerate_fn_t callback,
+  void* ctx) {
+
+  char serial_number[VOLTRONIC_USB_STRING_SIZE];
+  char manufacturer[VOLTRONIC_USB_STRING_SIZE];
+  char product[VOLTRONIC_USB_STRING_SIZE];
+  int count = 0;
+
+  voltronic_usb_init_hidapi();
+
+  struct hid_device_info* devs = hid_enumerate(
+    (unsigned short) vendor_id,
+    (unsigned short) product_id);
+
+  for (struct hid_device_info* cur = devs; cur != 0; cur = cur->next) {
+    voltronic_usb_wcstombs(serial_number, cur->serial_number);
+    voltronic_usb_wcstombs(manufacturer, cur->manufacturer_string);
+    voltronic_usb_wcstombs(product, cur->product_string);
+
+    callback(cur->path, serial_number, manufacturer, product, ctx);
+    ++count;
+  }
+
+  hid_free_enumeration(devs);
+  return count;
+}
+
+static int voltronic_usb_read(
   void* impl_ptr,
   char* buffer,
   const size_t buffer_size,
@@ -65,7 +178,7 @@ inline int voltronic_dev_impl_read(
     (int) timeout_milliseconds);
 }
 
-inline int voltronic_dev_impl_write(
+static int voltronic_usb_write(
   void* impl_ptr,
   const char* buffer,
   const size_t buffer_size,
@@ -85,7 +198,7 @@ inline int voltronic_dev_impl_write(
   return GET_REPORT_SIZE(bytes_written);
 }
 
-inline int voltronic_dev_impl_close(void* impl_ptr) {
+static int voltronic_usb_close(void* impl_ptr) {
   hid_close(VOLTRONIC_DEV_USB(impl_ptr));
   return 1;
 }
@@ -0,0 +1,407 @@
+/**
+ * Copyright (C) 2020  Evgeny Zinoviev
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Linux-only USB implementation that talks to /dev/hidrawN directly,
+ * without hidapi. Devices are found through sysfs.
+ */
+
+#define _GNU_SOURCE
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <time.h>
+#include "voltronic_dev_impl.h"
+#include "voltronic_dev_usb.h"
+
+#define HID_REPORT_SIZE 8
+#define VOLTRONIC_USB_STRING_SIZE 128
+#define VOLTRONIC_USB_PATH_SIZE 64
+
+#define HIDRAW_SYSFS_DIR "/sys/class/hidraw"
+#define HIDRAW_DEV_DIR "/dev"
+
+#define VOLTRONIC_DEV_HIDRAW(_impl_ptr_) \
+  ((voltronic_hidraw_t*) (_impl_ptr_))
+
+typedef struct {
+  int fd;
+} voltronic_hidraw_t;
+
+typedef struct {
+  const char* serial_number; /* 0 to match any */
+  char path[VOLTRONIC_USB_PATH_SIZE];
+  int found;
+} voltronic_hidraw_match_t;
+
+static int voltronic_usb_read(
+  void* impl_ptr,
+  char* buffer,
+  const size_t buffer_size,
+  const unsigned int timeout_milliseconds);
+
+static int voltronic_usb_write(
+  void* impl_ptr,
+  const char* buffer,
+  const size_t buffer_size,
+  const unsigned int timeout_milliseconds);
+
+static int voltronic_usb_close(void* impl_ptr);
+
+static int voltronic_usb_fd(void* impl_ptr);
+
+static const voltronic_dev_impl_t voltronic_usb_impl = {
+  voltronic_usb_read,
+  voltronic_usb_write,
+  voltronic_usb_close,
+  voltronic_usb_fd
+};
+
+static long long voltronic_hidraw_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Waits for events on fd until the deadline, returns 0 on timeout. */
+static int voltronic_hidraw_poll(
+  const int fd,
+  const short events,
+  const long long deadline) {
+
+  struct pollfd pfd = { fd, events, 0 };
+  while (1) {
+    long long timeout = deadline - voltronic_hidraw_now();
+    if (timeout < 0) {
+      timeout = 0;
+    }
+
+    const int result = poll(&pfd, 1, (int) timeout);
+    if (result < 0 && errno == EINTR) {
+      continue;
+    }
+    if (result > 0 && (pfd.revents & (POLLERR | POLLHUP | POLLNVAL))) {
+      SET_LAST_ERROR(ENODEV);
+      return -1;
+    }
+    return result;
+  }
+}
+
+voltronic_dev_t voltronic_usb_create_path(const char* path) {
+  SET_LAST_ERROR(0);
+  const int fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+  if (fd < 0) {
+    return 0;
+  }
+
+  voltronic_hidraw_t* dev = (voltronic_hidraw_t*)
+    ALLOCATE_MEMORY(sizeof(voltronic_hidraw_t));
+  if (dev == 0) {
+    close(fd);
+    SET_LAST_ERROR(ENOMEM);
+    return 0;
+  }
+
+  dev->fd = fd;
+  return voltronic_dev_internal_create((void*) dev, &voltronic_usb_impl);
+}
+
+/* Reads a sysfs attribute into buffer, without the trailing newline. */
+static void voltronic_hidraw_read_attr(
+  const char* dir,
+  const char* name,
+  char* buffer,
+  const size_t buffer_size) {
+
+  char path[256];
+  buffer[0] = 0;
+
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  FILE* f = fopen(path, "r");
+  if (f == 0) {
+    return;
+  }
+
+  if (fgets(buffer, (int) buffer_size, f) != 0) {
+    buffer[strcspn(buffer, "\n")] = 0;
+  }
+  fclose(f);
+}
+
+/* Looks for KEY=value in the uevent file of the hid device. */
+static int voltronic_hidraw_uevent(
+  const char* dir,
+  const char* key,
+  char* buffer,
+  const size_t buffer_size) {
+
+  char path[256];
+  char line[VOLTRONIC_USB_STRING_SIZE + 16];
+  const size_t key_length = strlen(key);
+  int found = 0;
+  buffer[0] = 0;
+
+  snprintf(path, sizeof(path), "%s/uevent", dir);
+  FILE* f = fopen(path, "r");
+  if (f == 0) {
+    return 0;
+  }
+
+  while (fgets(line, sizeof(line), f) != 0) {
+    if (strncmp(line, key, key_length) == 0 && line[key_length] == '=') {
+      line[strcspn(line, "\n")] = 0;
+      snprintf(buffer, buffer_size, "%s", &line[key_length + 1]);
+      found = 1;
+      break;
+    }
+  }
+  fclose(f);
+
+  return found;
+}
+
+int voltronic_usb_enumerate(
+  const unsigned int vendor_id,
+  const unsigned int product_id,
+  voltronic_usb_enumerate_fn_t callback,
+  void* ctx) {
+
+  char hid_dir[256];
+  char usb_dir[256];
+  char path[VOLTRONIC_USB_PATH_SIZE];
+  char hid_id[32];
+  char serial_number[VOLTRONIC_USB_STRING_SIZE];
+  char manufacturer[VOLTRONIC_USB_STRING_SIZE];
+  char product[VOLTRONIC_USB_STRING_SIZE];
+  unsigned int bus, vendor, product_number;
+  struct dirent** entries;
+  int count = 0;
+
+  const int entries_count = scandir(HIDRAW_SYSFS_DIR, &entries, 0, versionsort);
+  if (entries_count < 0) {
+    return 0;
+  }
+
+  for (int i = 0; i < entries_count; i++) {
+    const char* name = entries[i]->d_name;
+    if (strncmp(name, "hidraw", 6) != 0) {
+      continue;
+    }
+
+    if (snprintf(hid_dir, sizeof(hid_dir), "%s/%s/device", HIDRAW_SYSFS_DIR, name) >= (int) sizeof(hid_dir)
+        || snprintf(usb_dir, sizeof(usb_dir), "%s/../..", hid_dir) >= (int) sizeof(usb_dir)
+        || snprintf(path, sizeof(path), "%s/%s", HIDRAW_DEV_DIR, name) >= (int) sizeof(path)) {
+      continue;
+    }
+
+    /* e.g. HID_ID=0003:00000665:00005161, the bus is USB */
+    if (!voltronic_hidraw_uevent(hid_dir, "HID_ID", hid_id, sizeof(hid_id))
+        || sscanf(hid_id, "%x:%x:%x", &bus, &vendor, &product_number) != 3
+        || bus != 0x03
+        || vendor != vendor_id
+        || product_number != product_id) {
+      continue;
+    }
+
+    /* strings are attributes of the USB device, two levels above */
+    voltronic_hidraw_uevent(hid_dir, "HID_UNIQ", serial_number, sizeof(serial_number));
+    voltronic_hidraw_read_attr(usb_dir, "manufacturer", manufacturer, sizeof(manufacturer));
+    voltronic_hidraw_read_attr(usb_dir, "product", product, sizeof(product));
+
+    callback(path, serial_number, manufacturer, product, ctx);
+    ++count;
+  }
+
+  for (int i = 0; i < entries_count; i++) {
+    free(entries[i]);
+  }
+  free(entries);
+
+  return count;
+}
+
+static void voltronic_hidraw_match_cb(
+  const char* path,
+  const char* serial_number,
+  const char* manufacturer,
+  const char* product,
+  void* ctx) {
+
+  voltronic_hidraw_match_t* match = (voltronic_hidraw_match_t*) ctx;
+  (void) manufacturer;
+  (void) product;
+
+  if (match->found) {
+    return;
+  }
+
+  if (match->serial_number == 0 || strcmp(match->serial_number, serial_number) == 0) {
+    snprintf(match->path, sizeof(match->path), "%s", path);
+    match->found = 1;
+  }
+}
+
+static voltronic_dev_t voltronic_hidraw_create_matching(
+  const unsigned int vendor_id,
+  const unsigned int product_id,
+  const char* serial_number) {
+
+  voltronic_hidraw_match_t match = { serial_number, { 0 }, 0 };
+  voltronic_usb_enumerate(vendor_id, product_id, voltronic_hidraw_match_cb, &match);
+
+  if (!match.found) {
+    SET_LAST_ERROR(ENODEV);
+    return 0;
+  }
+
+  return voltronic_usb_create_path(match.path);
+}
+
+voltronic_dev_t voltronic_usb_create(
+  const unsigned int vendor_id,
+  const unsigned int product_id) {
+
+  return voltronic_hidraw_create_matching(vendor_id, product_id, 0);
+}
+
+voltronic_dev_t voltronic_usb_create_serial(
+  const unsigned int vendor_id,
+  const unsigned int product_id,
+  const char* serial_number) {
+
+  return voltronic_hidraw_create_matching(vendor_id, product_id, serial_number);
+}
+
+/**
+ * Waits for the first report until the timeout, then takes whatever other
+ * reports are already there, as long as they fit into the buffer
+ */
+static int voltronic_usb_read(
+  void* impl_ptr,
+  char* buffer,
+  const size_t buffer_size,
+  const unsigned int timeout_milliseconds) {
+
+  const int fd = VOLTRONIC_DEV_HIDRAW(impl_ptr)->fd;
+  const long long deadline = voltronic_hidraw_now() + timeout_milliseconds;
+  char report[HID_REPORT_SIZE];
+  size_t size = 0;
+
+  SET_LAST_ERROR(0);
+  while (size < buffer_size) {
+    const size_t left = buffer_size - size;
+    char* dst = left >= HID_REPORT_SIZE ? &buffer[size] : report;
+
+    const ssize_t bytes_read = read(fd, dst, HID_REPORT_SIZE);
+    if (bytes_read > 0) {
+      const size_t n = (size_t) bytes_read < left ? (size_t) bytes_read : left;
+      if (dst == report) {
+        COPY_MEMORY(&buffer[size], report, n);
+      }
+      size += n;
+      continue;
+    }
+
+    if (bytes_read == 0) {
+      SET_LAST_ERROR(ENODEV);
+      return -1;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      return -1;
+    }
+
+    /* nothing more for now */
+    if (size > 0) {
+      break;
+    }
+
+    const int poll_result = voltronic_hidraw_poll(fd, POLLIN, deadline);
+    if (poll_result < 0) {
+      return -1;
+    }
+    if (poll_result == 0) {
+      SET_LAST_ERROR(0);
+      return 0;
+    }
+  }
+
+  return (int) size;
+}
+
+/**
+ * Writes the whole buffer, one report at a time, each prefixed with
+ * the report number 0, giving up when the timeout is reached
+ */
+static int voltronic_usb_write(
+  void* impl_ptr,
+  const char* buffer,
+  const size_t buffer_size,
+  const unsigned int timeout_milliseconds) {
+
+  const int fd = VOLTRONIC_DEV_HIDRAW(impl_ptr)->fd;
+  const long long deadline = voltronic_hidraw_now() + timeout_milliseconds;
+  size_t written = 0;
+
+  SET_LAST_ERROR(0);
+  while (written < buffer_size) {
+    unsigned char report[HID_REPORT_SIZE + 1] = { 0 };
+    const size_t left = buffer_size - written;
+    const size_t size = left > HID_REPORT_SIZE ? HID_REPORT_SIZE : left;
+    COPY_MEMORY(&report[1], &buffer[written], size);
+
+    const ssize_t result = write(fd, report, sizeof(report));
+    if (result >= 0) {
+      written += size;
+      continue;
+    }
+
+    if (errno == EINTR) {
+      continue;
+    }
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      return written > 0 ? (int) written : -1;
+    }
+
+    const int poll_result = voltronic_hidraw_poll(fd, POLLOUT, deadline);
+    if (poll_result <= 0) {
+      break;
+    }
+  }
+
+  return (int) written;
+}
+
+static int voltronic_usb_close(void* impl_ptr) {
+  voltronic_hidraw_t* dev = VOLTRONIC_DEV_HIDRAW(impl_ptr);
+  const int result = close(dev->fd);
+  FREE_MEMORY(dev);
+  return result == 0 ? 1 : 0;
+}
+
+static int voltronic_usb_fd(void* impl_ptr) {
+  return VOLTRONIC_DEV_HIDRAW(impl_ptr)->fd;
+}
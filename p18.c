@@ -20,10 +20,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <math.h>
+#include <pthread.h>
 
 #include "p18.h"
 #include "util.h"
+#include "libvoltronic/voltronic_crc.h"
 
 const char *p18_query_cmds[] = {
     "PI",      /* Protocol ID */
@@ -437,6 +441,133 @@ bool p18_build_command(int command, const char **args, size_t args_size, char *b
     return true;
 }
 
+/*
+ * Get queries are framed once: argument-free ones completely, the rest up to
+ * their arguments, with the CRC of that prefix calculated in advance. Queries
+ * with arguments then only need the argument bytes written and added to the CRC.
+ */
+
+typedef struct {
+    p18_frame_t frame;      /* complete, or just the prefix if args_size != 0 */
+    size_t args_size;
+    voltronic_crc_t crc;    /* intermediate CRC of the prefix */
+} p18_frame_template_t;
+
+static p18_frame_template_t p18_query_frames[ARRAY_SIZE(p18_query_cmds)];
+static pthread_once_t p18_query_frames_once = PTHREAD_ONCE_INIT;
+
+/* All arguments of get queries are fixed-width numbers. */
+static size_t p18_query_args_size(int command)
+{
+    switch (command) {
+        case P18_QUERY_YEAR_GENERATED:             return 4; /* YYYY */
+        case P18_QUERY_MONTH_GENERATED:            return 6; /* YYYYMM */
+        case P18_QUERY_DAY_GENERATED:              return 8; /* YYYYMMDD */
+        case P18_QUERY_PARALLEL_RATED_INFORMATION:
+        case P18_QUERY_PARALLEL_GENERAL_STATUS:    return 1; /* N */
+        default:                                   return 0;
+    }
+}
+
+static void p18_finish_frame(p18_frame_t *frame, voltronic_crc_t crc)
+{
+    char *p = frame->data + frame->command_size;
+    p += write_voltronic_crc(finish_voltronic_crc(crc), p);
+    *p++ = '\r';
+    frame->size = p - frame->data;
+}
+
+static void p18_init_query_frames(void)
+{
+    for (size_t i = 0; i < ARRAY_SIZE(p18_query_frames); i++) {
+        p18_frame_template_t *t = &p18_query_frames[i];
+        t->args_size = p18_query_args_size(P18_QUERY_CMDS_ENUM_OFFSET + (int)i);
+
+        int len = sprintf(t->frame.data, "^P%03zu%s",
+                          strlen(p18_query_cmds[i]) + t->args_size + 3,
+                          p18_query_cmds[i]);
+        t->frame.command_size = len;
+        t->crc = update_voltronic_crc(0, t->frame.data, len);
+        if (!t->args_size)
+            p18_finish_frame(&t->frame, t->crc);
+    }
+}
+
+static bool p18_put_number(char *buf, const char *s, size_t width)
+{
+    if (s == NULL)
+        return false;
+
+    int n = atoi(s);
+    if (n < 0)
+        return false;
+
+    for (size_t i = width; i > 0; i--) {
+        buf[i-1] = (char)('0' + n % 10);
+        n /= 10;
+    }
+    return n == 0;
+}
+
+/* Writes arguments of a get query the same way p18_append_arguments() does,
+   or returns false if they don't fit into the fixed width. */
+static bool p18_put_query_arguments(int command, char *buf, const char **a)
+{
+    switch (command) {
+        case P18_QUERY_DAY_GENERATED:
+            if (!p18_put_number(buf+6, a[2], 2))
+                return false;
+            /* fallthrough */
+        case P18_QUERY_MONTH_GENERATED:
+            if (!p18_put_number(buf+4, a[1], 2))
+                return false;
+            /* fallthrough */
+        case P18_QUERY_YEAR_GENERATED:
+            if (a[0] == NULL || strlen(a[0]) != 4)
+                return false;
+            memcpy(buf, a[0], 4);
+            return true;
+
+        case P18_QUERY_PARALLEL_RATED_INFORMATION:
+        case P18_QUERY_PARALLEL_GENERAL_STATUS:
+            return p18_put_number(buf, a[0], 1);
+
+        default:
+            return false;
+    }
+}
+
+/*
+ * Returns the command framed with the CRC and '\r', either a prebuilt one or
+ * built in buf, or NULL if the command is invalid.
+ */
+const p18_frame_t *p18_build_frame(int command, const char **args, size_t args_size, p18_frame_t *buf)
+{
+    int query_index = command - P18_QUERY_CMDS_ENUM_OFFSET;
+    if (query_index >= 0 && query_index < (int)ARRAY_SIZE(p18_query_frames)) {
+        pthread_once(&p18_query_frames_once, p18_init_query_frames);
+
+        const p18_frame_template_t *t = &p18_query_frames[query_index];
+        if (!t->args_size)
+            return &t->frame;
+
+        char *args_p = buf->data + t->frame.command_size;
+        if (p18_put_query_arguments(command, args_p, args)) {
+            memcpy(buf->data, t->frame.data, t->frame.command_size);
+            buf->command_size = t->frame.command_size + t->args_size;
+            p18_finish_frame(buf, update_voltronic_crc(t->crc, args_p, t->args_size));
+            return buf;
+        }
+    }
+
+    if (!p18_build_command(command, args, args_size, buf->data))
+        return NULL;
+
+    buf->command_size = strlen(buf->data);
+    p18_finish_frame(buf, update_voltronic_crc(0, buf->data, buf->command_size));
+    return buf;
+}
+
 bool p18_validate_query_response(const char *buf, size_t size, size_t *data_size)
 {
     if (buf[0] != '^' || buf[1] != 'D')
@@ -455,6 +586,19 @@ bool p18_validate_query_response(const char *buf, size_t size, size_t *data_size
     return true;
 }
 
+/*
+ * Responses don't name the command they're for, so this only checks that
+ * the response is of the right kind: data for get queries, ^0 or ^1 for set
+ * commands. Anything else is a leftover of an earlier exchange.
+ */
+bool p18_response_matches(int command, const char *buf, size_t size)
+{
+    if (command < P18_SET_CMDS_ENUM_OFFSET)
+        return size >= 5 && p18_validate_query_response(buf, size, NULL);
+
+    return size >= 2 && buf[0] == '^' && (buf[1] == '0' || buf[1] == '1');
+}
+
 bool p18_set_result(const char *buf, size_t size)
 {
     if (size < 2) {
@@ -468,901 +612,617 @@ bool p18_set_result(const char *buf, size_t size)
     return buf[1] == '1';
 }
 
-static void p18_parse_list(
-        const char *data,
-        void *message_ptr,
-        int expected_items_count, /* -1 means no fixed limit */
-        p18_parse_cb_t callback)
-{
-    int data_size = (int)strlen(data);
-    static const int buf_size = 64;
-    char buf[buf_size];
-    char *c = (char *)data;
-
-    for (int i = 0, char_index = 0, item_index = 0;
-         i < data_size;
-         i++) {
-
-        if (*c != ',' && i < data_size-1) {
-            if (char_index < buf_size-1)
-                buf[char_index++] = *c;
-            c++;
-            continue;
-        }
+/*
+ * Responses are either a single fixed-width value or lists of comma-separated
+ * items. Each message is described by a table of fields, sorted by item index.
+ * An item can hold several fields, like HHMM. Fields are read up to their
+ * width, except numbers that take a whole list item: these are read up to
+ * the comma, so that values wider than documented are still read correctly.
+ * Items are decoded in place, without copying them anywhere first.
+ */
 
-        /* last character */
-        if (*c != ',' && char_index < buf_size-1)
-            buf[char_index++] = *c;
+typedef enum {
+    P18_FIELD_NUMBER, /* any integer or enum type, parsed like atoi() does */
+    P18_FIELD_BOOL,   /* true if the number is 1 */
+    P18_FIELD_FLAG,   /* true if the number is positive */
+    P18_FIELD_STRING, /* up to width characters */
+} p18_field_type_t;
+
+typedef struct {
+    const char *key;      /* as printed, see print.c */
+    unsigned char index;  /* of the item in the list */
+    unsigned char pos;    /* of the first character in the item */
+    unsigned char width;  /* expected length, 0 means variable */
+    unsigned char type;   /* p18_field_type_t */
+    unsigned short offset;
+    unsigned short size;
+} p18_field_t;
+
+#define P18_FIELD(msg_type, member, _key, _index, _pos, _width, _type) \
+    { \
+        .key= (_key), \
+        .index= (_index), \
+        .pos= (_pos), \
+        .width= (_width), \
+        .type= (_type), \
+        .offset= offsetof(P18_MSG_T(msg_type), member), \
+        .size= sizeof(((P18_MSG_T(msg_type) *)0)->member) \
+    }
 
-        if (expected_items_count != -1 && item_index >= expected_items_count)
-            ERROR("warning: item %d is not expected\n", item_index);
-        else {
-            buf[char_index] = '\0';
-            callback((const char *)buf, char_index, item_index, message_ptr);
-        }
+#define P18_NUMBER(msg_type, member, index, width) \
+    P18_FIELD(msg_type, member, #member, (index), 0, (width), P18_FIELD_NUMBER)
 
-        char_index = 0;
-        c++;
-        item_index++;
-    }
-}
+#define P18_BOOL(msg_type, member, index, width) \
+    P18_FIELD(msg_type, member, #member, (index), 0, (width), P18_FIELD_BOOL)
 
-static void p18_expect_listitem_length(const char *f,
-                                       int index,
-                                       size_t expected_len,
-                                       size_t actual_len) {
-    if (actual_len != expected_len) {
-        LOG("%s: length of item %d is %zu != %zu\n",
-            f, index, actual_len, expected_len);
-    }
-}
+#define P18_FLAG(msg_type, member, index, width) \
+    P18_FIELD(msg_type, member, #member, (index), 0, (width), P18_FIELD_FLAG)
 
-/* ------------------------------------------ */
-/* Command-specific methods */
+#define P18_STRING(msg_type, member, index, width) \
+    P18_FIELD(msg_type, member, #member, (index), 0, (width), P18_FIELD_STRING)
 
-P18_UNPACK_FN(protocol_id)
-{
-    char s[4];
-    strncpy(s, data, 2);
-    s[2] = '\0';
+/* a part of the item, starting at pos */
+#define P18_SUBNUMBER(msg_type, member, key, index, pos, width) \
+    P18_FIELD(msg_type, member, (key), (index), (pos), (width), P18_FIELD_NUMBER)
 
-    p18_protocol_id_msg_t m;
-    m.id = atoi(s);
+#define P18_FIXED_MAX_ITEMS 32
 
-    return m;
-}
+#define P18_ALL_FIELDS      UINT32_MAX
 
-P18_UNPACK_FN(current_time)
-{
-    char s[4];
-    int n;
-    p18_current_time_msg_t m;
-
-    substr_copy(s, data, 4);
-    m.year = atoi(s);
-
-    for (int i = 0; i < 5; i++) {
-        substr_copy(s, data + 4 + (i * 2), 2);
-        n = atoi(s);
-        switch (i) {
-            case 0: m.month = n; break;
-            case 1: m.day = n; break;
-            case 2: m.hour = n; break;
-            case 3: m.minute = n; break;
-            case 4: m.second = n; break;
-            default:
-                ERROR("%s: warning: unexpected code path, i=%d\n",
-                      __func__, i);
-                break;
-        }
-    }
+/* fields past the 32nd can't be deselected */
+#define P18_FIELD_SELECTED(mask, f) ((f) >= 32 || ((mask) & ((uint32_t)1 << (f))))
 
-    return m;
-}
+#define P18_FIELDS_NAME(msg_type)   p18_fields_ ## msg_type
 
-static long parse_generated(const char *buf)
-{
-    char s[16];
-    strncpy(s, buf, 8);
-    s[8] = '\0';
-    return atol(s);
-}
+#define P18_FIELDS(msg_type) \
+    static const p18_field_t P18_FIELDS_NAME(msg_type)[]
 
-P18_UNPACK_FN(total_generated)
-{
-    p18_total_generated_msg_t m = {
-        .kwh = parse_generated(data)
-    };
-    return m;
-}
+/* the mask of fields printed under the given keys */
+#define P18_SELECTED(msg_type, keys, count) \
+    p18_selected(P18_FIELDS_NAME(msg_type), ARRAY_SIZE(P18_FIELDS_NAME(msg_type)), (keys), (count))
 
-P18_UNPACK_FN(year_generated)
-{
-    p18_year_generated_msg_t m = {
-        .kwh = parse_generated(data)
-    };
-    return m;
-}
+#define P18_DECODE(msg_type, m, items_count, mask) \
+    p18_decode(data, &(m), P18_FIELDS_NAME(msg_type), \
+               ARRAY_SIZE(P18_FIELDS_NAME(msg_type)), (items_count), (mask))
+
+/* defines both p18_unpack_..._msg() and p18_unpack_..._msg_selected() */
+#define P18_UNPACK_FNS(msg_type, items_count) \
+    P18_UNPACK_FN(msg_type) \
+    { \
+        P18_MSG_T(msg_type) m = {0}; \
+        P18_DECODE(msg_type, m, (items_count), P18_ALL_FIELDS); \
+        return m; \
+    } \
+    P18_UNPACK_SELECTED_FN(msg_type) \
+    { \
+        P18_MSG_T(msg_type) m = {0}; \
+        P18_DECODE(msg_type, m, (items_count), P18_SELECTED(msg_type, keys, count)); \
+        return m; \
+    }
 
-P18_UNPACK_FN(month_generated)
+/* Selects fields printed under any of the keys, or all of them if none is
+   or there are no keys. Fields past the 32nd are always selected. */
+static uint32_t p18_selected(const p18_field_t *fields,
+                             size_t fields_count,
+                             const char *const *keys,
+                             size_t count)
 {
-    p18_month_generated_msg_t m = {
-        .kwh = parse_generated(data)
-    };
-    return m;
+    uint32_t mask = 0;
+    for (size_t f = 0; f < fields_count && f < 32; f++) {
+        for (size_t k = 0; k < count; k++) {
+            if (!strcmp(fields[f].key, keys[k])) {
+                mask |= (uint32_t)1 << f;
+                break;
+            }
+        }
+    }
+    return mask ? mask : P18_ALL_FIELDS;
 }
 
-P18_UNPACK_FN(day_generated)
+/* Same as atoi() on the first len characters of s. */
+static long p18_parse_number(const char *s, size_t len)
 {
-    p18_day_generated_msg_t m = {
-        .kwh = parse_generated(data)
-    };
-    return m;
+    size_t i = 0;
+    bool negative = false;
+    long n = 0;
+
+    while (i < len && (s[i] == ' ' || (s[i] >= '\t' && s[i] <= '\r')))
+        i++;
+    if (i < len && (s[i] == '-' || s[i] == '+'))
+        negative = s[i++] == '-';
+    for (; i < len && s[i] >= '0' && s[i] <= '9'; i++)
+        n = n * 10 + (s[i] - '0');
+
+    return negative ? -n : n;
 }
 
-P18_UNPACK_FN(series_number)
+static void p18_store_number(void *dst, size_t size, long n)
 {
-    p18_series_number_msg_t m;
-
-    /* read length, reuse the already available id datafer */
-    substr_copy(m.id, data, 2);
-    m.length = atoi(m.id);
-
-    /* read id of given length */
-    substr_copy(m.id, data + 2, m.length);
-
-    return m;
+    switch (size) {
+        case sizeof(int8_t):  { int8_t v = (int8_t)n;   memcpy(dst, &v, size); break; }
+        case sizeof(int16_t): { int16_t v = (int16_t)n; memcpy(dst, &v, size); break; }
+        case sizeof(int32_t): { int32_t v = (int32_t)n; memcpy(dst, &v, size); break; }
+        case sizeof(int64_t): { int64_t v = (int64_t)n; memcpy(dst, &v, size); break; }
+        default:
+            ERROR("%s: unexpected size %zu\n", __func__, size);
+            break;
+    }
 }
 
-P18_PARSE_CB_FN(cpu_version)
+static void p18_store_field(const p18_field_t *field, void *message_ptr, long n)
 {
-    //LOG("%s: value=%s, value_len=%d\n", __func__, value, value_len);
-
-    p18_cpu_version_msg_t *m = (p18_cpu_version_msg_t *)message_ptr;
-    P18_EXPECT_LISTITEM_LENGTH(5);
+    char *dst = (char *)message_ptr + field->offset;
 
-    switch (index) {
-        case 0:
-            substr_copy(m->main_cpu_version, value, 5);
+    switch (field->type) {
+        case P18_FIELD_NUMBER:
+            p18_store_number(dst, field->size, n);
             break;
 
-        case 1:
-            substr_copy(m->slave1_cpu_version, value, 5);
+        case P18_FIELD_BOOL:
+            *(bool *)dst = n == 1;
             break;
 
-        case 2:
-            substr_copy(m->slave2_cpu_version, value, 5);
+        case P18_FIELD_FLAG:
+            *(bool *)dst = n > 0;
             break;
     }
 }
-P18_UNPACK_FN(cpu_version)
-{
-    P18_PARSE_LIST_AND_RETURN(cpu_version, 3);
-}
 
-P18_PARSE_CB_FN(rated_information)
+static void p18_decode_field(const p18_field_t *field,
+                             const char *item,
+                             size_t item_len,
+                             bool last,
+                             void *message_ptr)
 {
-    p18_rated_information_msg_t *m = (p18_rated_information_msg_t *)message_ptr;
-    int num = atoi(value);
-    switch (index) {
-        case 0: /* AAAA */
-            P18_EXPECT_LISTITEM_LENGTH(4);
-            m->ac_input_rating_voltage = num;
-            break;
-        case 1: /* BBB */
-            P18_EXPECT_LISTITEM_LENGTH(3);
-            m->ac_input_rating_current = num;
-            break;
-        case 2: /* CCCC */
-            P18_EXPECT_LISTITEM_LENGTH(4);
-            m->ac_output_rating_voltage = num;
-            break;
-        case 3: /* DDD */
-            P18_EXPECT_LISTITEM_LENGTH(3);
-            m->ac_output_rating_freq = num;
-            break;
-        case 4: /* EEE */
-            P18_EXPECT_LISTITEM_LENGTH(3);
-            m->ac_output_rating_current = num;
-            break;
-        case 5: /* FFFF */
-            P18_EXPECT_LISTITEM_LENGTH(4);
-            m->ac_output_rating_apparent_power = num;
-            break;
-        case 6: /* GGGG */
-            P18_EXPECT_LISTITEM_LENGTH(4);
-            m->ac_output_rating_active_power = num;
-            break;
-        case 7: /* HHH */
-            P18_EXPECT_LISTITEM_LENGTH(3);
-            m->battery_rating_voltage = num;
-            break;
-        case 8: /* III */
-            P18_EXPECT_LISTITEM_LENGTH(3);
-            m->battery_recharge_voltage = num;
-            break;
-        case 9: /* JJJ */
-            P18_EXPECT_LISTITEM_LENGTH(3);
-            m->battery_redischarge_voltage = num;
-            break;
-        case 10: /* KKK */
-            P18_EXPECT_LISTITEM_LENGTH(3);
-            m->battery_under_voltage = num;
-            break;
-        case 11: /* LLL */
-            P18_EXPECT_LISTITEM_LENGTH(3);
-            m->battery_bulk_voltage = num;
-            break;
-        case 12: /* MMM */
-            P18_EXPECT_LISTITEM_LENGTH(3);
-            m->battery_float_voltage = num;
-            break;
-        case 13: /* N */
-            P18_EXPECT_LISTITEM_LENGTH(1);
-            m->battery_type = num;
-            break;
-        case 14: /* OO */
-            P18_EXPECT_LISTITEM_LENGTH(2);
-            m->max_ac_charging_current = num;
-            break;
-        case 15: /* PPP */
-            P18_EXPECT_LISTITEM_LENGTH(3);
-            m->max_charging_current = num;
-            break;
-        case 16: /* Q */
-            P18_EXPECT_LISTITEM_LENGTH(1);
-            m->input_voltage_range = num;
-            break;
-        case 17: /* R */
-            P18_EXPECT_LISTITEM_LENGTH(1);
-            m->output_source_priority = num;
-            break;
-        case 18: /* S */
-            P18_EXPECT_LISTITEM_LENGTH(1);
-            m->charger_source_priority = num;
-            break;
-        case 19: /* T */
-            P18_EXPECT_LISTITEM_LENGTH(1);
-            m->parallel_max_num = num;
-            break;
-        case 20: /* U */
-            P18_EXPECT_LISTITEM_LENGTH(1);
-            m->machine_type = num;
-            break;
-        case 21: /* V */
-            P18_EXPECT_LISTITEM_LENGTH(1);
-            m->topology = num;
-            break;
-        case 22: /* W */
-            P18_EXPECT_LISTITEM_LENGTH(1);
-            m->output_model_setting = num;
-            break;
-        case 23: /* Z */
-            P18_EXPECT_LISTITEM_LENGTH(1);
-            m->solar_power_priority = num;
-            break;
-        case 24: /* a */
-            P18_EXPECT_LISTITEM_LENGTH(1);
-            substr_copy(m->mppt, value, 1);
-            break;
+    char *dst = (char *)message_ptr + field->offset;
+    size_t len = 0;
+
+    if (field->pos < item_len) {
+        len = item_len - field->pos;
+        if (field->width && !last)
+            len = MIN(len, field->width);
     }
-}
-P18_UNPACK_FN(rated_information)
-{
-    P18_PARSE_LIST_AND_RETURN(rated_information, 25)
-}
+    item += MIN(field->pos, item_len);
 
-P18_PARSE_CB_FN(general_status)
-{
-    p18_general_status_msg_t *m = (p18_general_status_msg_t *)message_ptr;
-    int num = atoi(value);
-    switch (index) {
-        case 0: /* AAAA */
-            P18_EXPECT_LISTITEM_LENGTH(4);
-            m->grid_voltage = num;
-            break;
-        case 1: /* BBB */
-            P18_EXPECT_LISTITEM_LENGTH(3);
-            m->grid_freq = num;
-            break;
-        case 2: /* CCCC */
-            P18_EXPECT_LISTITEM_LENGTH(4);
-            m->ac_output_voltage = num;
-            break;
-        case 3: /* DDD */
-            P18_EXPECT_LISTITEM_LENGTH(3);
-            m->ac_output_freq = num;
-            break;
-        case 4: /* EEEE */
-            P18_EXPECT_LISTITEM_LENGTH(4);
-            m->ac_output_apparent_power = num;
-            break;
-        case 5: /* FFFF */
-            P18_EXPECT_LISTITEM_LENGTH(4);
-            m->ac_output_active_power = num;
-            break;
-        case 6: /* GGG */
-            P18_EXPECT_LISTITEM_LENGTH(3);
-            m->output_load_percent = num;
-            break;
-        case 7: /* HHH */
-            P18_EXPECT_LISTITEM_LENGTH(3);
-            m->battery_voltage = num;
-            break;
-        case 8: /* III */
-            P18_EXPECT_LISTITEM_LENGTH(3);
-            m->battery_voltage_scc = num;
-            break;
-        case 9: /* JJJ */
-            P18_EXPECT_LISTITEM_LENGTH(3);
-            m->battery_voltage_scc2 = num;
-            break;
-        case 10: /* KKK */
-            P18_EXPECT_LISTITEM_LENGTH(3);
-            m->battery_discharge_current = num;
-            break;
-        case 11: /* LLL */
-            P18_EXPECT_LISTITEM_LENGTH(3);
-            m->battery_charging_current = num;
-            break;
-        case 12: /* MMM */
-            P18_EXPECT_LISTITEM_LENGTH(3);
-            m->battery_capacity = num;
-            break;
-        case 13: /* NNN */
-            P18_EXPECT_LISTITEM_LENGTH(3);
-            m->inverter_heat_sink_temp = num;
-            break;
-        case 14: /* OOO */
-            P18_EXPECT_LISTITEM_LENGTH(3);
-            m->mppt1_charger_temp = num;
-            break;
-        case 15: /* PPP */
-            P18_EXPECT_LISTITEM_LENGTH(3);
-            m->mppt2_charger_temp = num;
-            break;
-        case 16: /* QQQQ */
-            P18_EXPECT_LISTITEM_LENGTH(4);
-            m->pv1_input_power = num;
-            break;
-        case 17: /* RRRR */
-            P18_EXPECT_LISTITEM_LENGTH(4);
-            m->pv2_input_power = num;
-            break;
-        case 18: /* SSSS */
-            P18_EXPECT_LISTITEM_LENGTH(4);
-            m->pv1_input_voltage = num;
-            break;
-        case 19: /* TTTT */
-            P18_EXPECT_LISTITEM_LENGTH(4);
-            m->pv2_input_voltage = num;
-            break;
-        case 20: /* U */
-            P18_EXPECT_LISTITEM_LENGTH(1);
-            m->settings_values_changed = num == 1;
-            break;
-        case 21: /* V */
-            P18_EXPECT_LISTITEM_LENGTH(1);
-            m->mppt1_charger_status = num;
-            break;
-        case 22: /* W */
-            P18_EXPECT_LISTITEM_LENGTH(1);
-            m->mppt2_charger_status = num;
-            break;
-        case 23: /* X */
-            P18_EXPECT_LISTITEM_LENGTH(1);
-            m->load_connected = num == 1;
-            break;
-        case 24: /* Y */
-            P18_EXPECT_LISTITEM_LENGTH(1);
-            m->battery_power_direction = num;
-            break;
-        case 25: /* Z */
-            P18_EXPECT_LISTITEM_LENGTH(1);
-            m->dc_ac_power_direction = num;
-            break;
-        case 26: /* a */
-            P18_EXPECT_LISTITEM_LENGTH(1);
-            m->line_power_direction = num;
-            break;
-        case 27: /* b */
-            P18_EXPECT_LISTITEM_LENGTH(1);
-            m->local_parallel_id = num;
-            break;
+    if (field->type == P18_FIELD_STRING) {
+        len = MIN(len, (size_t)field->size - 1);
+        memcpy(dst, item, len);
+        dst[len] = '\0';
+    } else {
+        p18_store_field(field, message_ptr, p18_parse_number(item, len));
     }
 }
-P18_UNPACK_FN(general_status)
+
+/* Returns false if any of the characters is not a digit, including the
+   terminating NUL, so it never reads past the end of the data. */
+static inline bool p18_parse_digits(const char *s, size_t len, long *n)
 {
-    P18_PARSE_LIST_AND_RETURN(general_status, 28)
+    long v = 0;
+    for (size_t i = 0; i < len; i++) {
+        unsigned int d = (unsigned char)s[i] - '0';
+        if (d > 9)
+            return false;
+        v = v * 10 + d;
+    }
+    *n = v;
+    return true;
 }
 
-P18_UNPACK_FN(working_mode)
+/*
+ * Fast path for lists like GS and PGS, where every item is a single number
+ * of a known width. It's taken only if the response matches the table exactly:
+ * all items are present and have expected widths, and contain only digits.
+ */
+static bool p18_decode_fixed(const char *data,
+                             void *message_ptr,
+                             const p18_field_t *fields,
+                             size_t fields_count,
+                             int items_count,
+                             uint32_t mask)
 {
-    char s[4];
-    strncpy(s, data, 2);
-    s[2] = '\0';
+    long values[P18_FIXED_MAX_ITEMS];
+    const char *item = data;
 
-    p18_working_mode_msg_t m;
-    m.mode = atoi(s);
+    if (fields_count != (size_t)items_count || fields_count > ARRAY_SIZE(values))
+        return false;
 
-    return m;
-}
+    for (size_t f = 0; f < fields_count; f++) {
+        const p18_field_t *field = &fields[f];
+        if (field->index != f
+            || field->pos != 0
+            || field->width == 0
+            || field->type == P18_FIELD_STRING)
+            return false;
 
-P18_PARSE_CB_FN(faults_warnings)
-{
-    p18_faults_warnings_msg_t *m = (p18_faults_warnings_msg_t *)message_ptr;
-    int num = atoi(value);
-    P18_EXPECT_LISTITEM_LENGTH(index == 0 ? 2 : 1);
-    switch (index) {
-        case 0:
-            m->fault_code = num;
-            break;
-        case 1:
-            m->line_fail = num > 0;
-            break;
-        case 2:
-            m->output_circuit_short = num > 0;
-            break;
-        case 3:
-            m->inverter_over_temperature = num > 0;
-            break;
-        case 4:
-            m->fan_lock = num > 0;
-            break;
-        case 5:
-            m->battery_voltage_high = num > 0;
-            break;
-        case 6:
-            m->battery_low = num > 0;
-            break;
-        case 7:
-            m->battery_under = num > 0;
-            break;
-        case 8:
-            m->over_load = num > 0;
-            break;
-        case 9:
-            m->eeprom_fail = num > 0;
-            break;
-        case 10:
-            m->power_limit = num > 0;
-            break;
-        case 11:
-            m->pv1_voltage_high = num > 0;
-            break;
-        case 12:
-            m->pv2_voltage_high = num > 0;
-            break;
-        case 13:
-            m->mppt1_overload_warning = num > 0;
-            break;
-        case 14:
-            m->mppt2_overload_warning = num > 0;
-            break;
-        case 15:
-            m->battery_too_low_to_charge_for_scc1 = num > 0;
-            break;
-        case 16:
-            m->battery_too_low_to_charge_for_scc2 = num > 0;
-            break;
-    }
-}
-P18_UNPACK_FN(faults_warnings)
-{
-    P18_PARSE_LIST_AND_RETURN(faults_warnings, 17)
-}
+        if (!p18_parse_digits(item, field->width, &values[f])
+            || item[field->width] != (f + 1 == fields_count ? '\0' : ','))
+            return false;
 
-P18_PARSE_CB_FN(flags_statuses)
-{
-    p18_flags_statuses_msg_t *m = (p18_flags_statuses_msg_t *)message_ptr;
-    int num = atoi(value);
-    P18_EXPECT_LISTITEM_LENGTH(1);
-    switch (index) {
-        case 0:
-            m->buzzer = num > 0;
-            break;
-        case 1:
-            m->overload_bypass = num > 0;
-            break;
-        case 2:
-            m->lcd_escape_to_default_page_after_1min_timeout = num > 0;
-            break;
-        case 3:
-            m->overload_restart = num > 0;
-            break;
-        case 4:
-            m->over_temp_restart = num > 0;
-            break;
-        case 5:
-            m->backlight_on = num > 0;
-            break;
-        case 6:
-            m->alarm_on_primary_source_interrupt = num > 0;
-            break;
-        case 7:
-            m->fault_code_record = num > 0;
-            break;
+        item += field->width + 1;
     }
-}
-P18_UNPACK_FN(flags_statuses)
-{
-    P18_PARSE_LIST_AND_RETURN(flags_statuses, 9)
-}
 
-P18_PARSE_CB_FN(defaults)
-{
-    p18_defaults_msg_t *m = (p18_defaults_msg_t *)message_ptr;
-    int num = atoi(value);
-    switch (index) {
-        case 0: /* AAAA */
-            P18_EXPECT_LISTITEM_LENGTH(4);
-            m->ac_output_voltage = num;
-            break;
-        case 1: /* BBB */
-            P18_EXPECT_LISTITEM_LENGTH(3);
-            m->ac_output_freq = num;
-            break;
-        case 2: /* C */
-            P18_EXPECT_LISTITEM_LENGTH(1);
-            m->ac_input_voltage_range = num;
-            break;
-        case 3: /* DDD */
-            P18_EXPECT_LISTITEM_LENGTH(3);
-            m->battery_under_voltage = num;
-            break;
-        case 4: /* EEE */
-            P18_EXPECT_LISTITEM_LENGTH(3);
-            m->charging_float_voltage = num;
-            break;
-        case 5: /* FFF */
-            P18_EXPECT_LISTITEM_LENGTH(3);
-            m->charging_bulk_voltage = num;
-            break;
-        case 6: /* GGG */
-            P18_EXPECT_LISTITEM_LENGTH(3);
-            m->battery_recharge_voltage = num;
-            break;
-        case 7: /* HHH */
-            P18_EXPECT_LISTITEM_LENGTH(3);
-            m->battery_redischarge_voltage = num;
-            break;
-        case 8: /* III */
-            P18_EXPECT_LISTITEM_LENGTH(3);
-            m->max_charging_current = num;
-            break;
-        case 9: /* JJ */
-            P18_EXPECT_LISTITEM_LENGTH(2);
-            m->max_ac_charging_current = num;
-            break;
-        case 10: /* K */
-            P18_EXPECT_LISTITEM_LENGTH(1);
-            m->battery_type = num;
-            break;
-        case 11: /* L */
-            P18_EXPECT_LISTITEM_LENGTH(1);
-            m->output_source_priority = num;
-            break;
-        case 12: /* M */
-            P18_EXPECT_LISTITEM_LENGTH(1);
-            m->charger_source_priority = num;
-            break;
-        case 13: /* N */
-            P18_EXPECT_LISTITEM_LENGTH(1);
-            m->solar_power_priority = num;
-            break;
-        case 14: /* O */
-            P18_EXPECT_LISTITEM_LENGTH(1);
-            m->machine_type = num;
-            break;
-        case 15: /* P */
-            P18_EXPECT_LISTITEM_LENGTH(1);
-            m->output_model_setting = num;
-            break;
-        case 16: /* S */
-            P18_EXPECT_LISTITEM_LENGTH(1);
-            m->flag_buzzer = num > 0;
-            break;
-        case 17: /* T */
-            P18_EXPECT_LISTITEM_LENGTH(1);
-            m->flag_overload_restart = num > 0;
-            break;
-        case 18: /* U */
-            P18_EXPECT_LISTITEM_LENGTH(1);
-            m->flag_over_temp_restart = num > 0;
-            break;
-        case 19: /* V */
-            P18_EXPECT_LISTITEM_LENGTH(1);
-            m->flag_backlight_on = num > 0;
-            break;
-        case 20: /* W */
-            P18_EXPECT_LISTITEM_LENGTH(1);
-            m->flag_alarm_on_primary_source_interrupt = num > 0;
-            break;
-        case 21: /* X */
-            P18_EXPECT_LISTITEM_LENGTH(1);
-            m->flag_fault_code_record = num > 0;
-            break;
-        case 22: /* Y */
-            P18_EXPECT_LISTITEM_LENGTH(1);
-            m->flag_overload_bypass = num > 0;
-            break;
-        case 23: /* Z */
-            P18_EXPECT_LISTITEM_LENGTH(1);
-            m->flag_lcd_escape_to_default_page_after_1min_timeout = num > 0;
-            break;
+    for (size_t f = 0; f < fields_count; f++) {
+        if (P18_FIELD_SELECTED(mask, f))
+            p18_store_field(&fields[f], message_ptr, values[f]);
     }
-}
-P18_UNPACK_FN(defaults)
-{
-    P18_PARSE_LIST_AND_RETURN(defaults, 24)
-}
 
-P18_PARSE_CB_FN(max_charging_current_selectable_values)
-{
-    UNUSED(value_len);
-    p18_max_charging_current_selectable_values_msg_t *m =
-        (p18_max_charging_current_selectable_values_msg_t *)message_ptr;
-    if (m->len >= ARRAY_SIZE(m->amps))
-        ERROR("warning: %dth item, ignoring as we accepting up to %zu values\n",
-              index, ARRAY_SIZE(m->amps));
-    else
-        m->amps[m->len++] = atoi(value);
-}
-P18_UNPACK_FN(max_charging_current_selectable_values)
-{
-    P18_PARSE_LIST_AND_RETURN(max_charging_current_selectable_values, -1)
+    return true;
 }
 
-P18_PARSE_CB_FN(max_ac_charging_current_selectable_values)
-{
-    UNUSED(value_len);
-    p18_max_ac_charging_current_selectable_values_msg_t *m =
-            (p18_max_ac_charging_current_selectable_values_msg_t *)message_ptr;
-    if (m->len >= ARRAY_SIZE(m->amps))
-        ERROR("warning: %dth item, ignoring as we accepting up to %zu values\n",
-              index, ARRAY_SIZE(m->amps));
-    else
-        m->amps[m->len++] = atoi(value);
-}
-P18_UNPACK_FN(max_ac_charging_current_selectable_values)
+static void p18_decode(const char *data,
+                       void *message_ptr,
+                       const p18_field_t *fields,
+                       size_t fields_count,
+                       int items_count, /* 0 if it's not a list */
+                       uint32_t mask)   /* fields to store */
 {
-    P18_PARSE_LIST_AND_RETURN(max_ac_charging_current_selectable_values, -1)
-}
+    const char *item = data;
+    size_t f = 0;
+
+    if (items_count && p18_decode_fixed(data, message_ptr, fields, fields_count, items_count, mask))
+        return;
+
+    for (int index = 0; *item != '\0'; index++) {
+        const char *end = item;
+        while ((*end != ',' || !items_count) && *end != '\0')
+            end++;
+        size_t item_len = end - item;
+
+        if (items_count && index >= items_count) {
+            ERROR("warning: item %d is not expected\n", index);
+        } else {
+            const p18_field_t *field = NULL;
+            for (; f < fields_count && fields[f].index == index; f++) {
+                field = &fields[f];
+                bool last = items_count
+                            && field->type != P18_FIELD_STRING
+                            && field->pos == 0
+                            && (f + 1 == fields_count || fields[f+1].index != index);
+                if (P18_FIELD_SELECTED(mask, f))
+                    p18_decode_field(field, item, item_len, last, message_ptr);
+            }
 
-P18_PARSE_CB_FN(parallel_rated_information)
-{
-    p18_parallel_rated_information_msg_t *m = (p18_parallel_rated_information_msg_t *)message_ptr;
-    switch (index) {
-        case 0: /* A */
-            P18_EXPECT_LISTITEM_LENGTH(1);
-            m->parallel_id_connection_status = atoi(value);
-            break;
-        case 1: /* BB */
-            P18_EXPECT_LISTITEM_LENGTH(2);
-            m->serial_number_valid_length = atoi(value);
-            break;
-        case 2: /* CCCCCCCCCCCCCCCCCCCC */
-            P18_EXPECT_LISTITEM_LENGTH(20);
-            substr_copy(m->serial_number, value, MIN(m->serial_number_valid_length, (int)ARRAY_SIZE(m->serial_number)-1));
-            break;
-        case 3: /* D */
-            P18_EXPECT_LISTITEM_LENGTH(1);
-            m->charger_source_priority = atoi(value);
-            break;
-        case 4: /* EEE */
-            P18_EXPECT_LISTITEM_LENGTH(3);
-            m->max_charging_current = atoi(value);
-            break;
-        case 5: /* FF */
-            P18_EXPECT_LISTITEM_LENGTH(2);
-            m->max_ac_charging_current = atoi(value);
-            break;
-        case 6: /* G */
-            P18_EXPECT_LISTITEM_LENGTH(1);
-            m->output_model_setting = atoi(value);
+            /* the last field's end is the expected length of the item */
+            if (field != NULL && field->width && item_len != (size_t)(field->pos + field->width))
+                LOG("%s: length of item %d is %zu != %d\n",
+                    __func__, index, item_len, field->pos + field->width);
+        }
+
+        if (*end == '\0')
             break;
+        item = end + 1;
     }
 }
-P18_UNPACK_FN(parallel_rated_information)
-{
-    P18_PARSE_LIST_AND_RETURN(parallel_rated_information, 7)
-}
 
-P18_PARSE_CB_FN(parallel_general_status)
+/* For lists of unknown length. */
+static void p18_decode_list(const char *data, int *values, size_t capacity, size_t *len)
 {
-    p18_parallel_general_status_msg_t *m = (p18_parallel_general_status_msg_t *)message_ptr;
-    int num = atoi(value);
-    switch (index) {
-        case 0: /* A */
-            P18_EXPECT_LISTITEM_LENGTH(1);
-            m->parallel_id_connection_status = num;
-            break;
-        case 1: /* B */
-            P18_EXPECT_LISTITEM_LENGTH(1);
-            m->work_mode = num;
-            break;
-        case 2: /* CC */
-            P18_EXPECT_LISTITEM_LENGTH(2);
-            m->fault_code = num;
-            break;
-        case 3: /* DDDD */
-            P18_EXPECT_LISTITEM_LENGTH(4);
-            m->grid_voltage = num;
-            break;
-        case 4: /* EEE */
-            P18_EXPECT_LISTITEM_LENGTH(3);
-            m->grid_freq = num;
-            break;
-        case 5: /* FFFF */
-            P18_EXPECT_LISTITEM_LENGTH(4);
-            m->ac_output_voltage = num;
-            break;
-        case 6: /* GGG */
-            P18_EXPECT_LISTITEM_LENGTH(3);
-            m->ac_output_freq = num;
-            break;
-        case 7: /* HHHH */
-            P18_EXPECT_LISTITEM_LENGTH(4);
-            m->ac_output_apparent_power = num;
-            break;
-        case 8: /* IIII */
-            P18_EXPECT_LISTITEM_LENGTH(4);
-            m->ac_output_active_power = num;
-            break;
-        case 9: /* JJJJJ */
-            P18_EXPECT_LISTITEM_LENGTH(5);
-            m->total_ac_output_apparent_power = num;
-            break;
-        case 10: /* KKKKK */
-            P18_EXPECT_LISTITEM_LENGTH(5);
-            m->total_ac_output_active_power = num;
-            break;
-        case 11: /* LLL */
-            P18_EXPECT_LISTITEM_LENGTH(3);
-            m->output_load_percent = num;
-            break;
-        case 12: /* MMM */
-            P18_EXPECT_LISTITEM_LENGTH(3);
-            m->total_output_load_percent = num;
-            break;
-        case 13: /* NNN */
-            P18_EXPECT_LISTITEM_LENGTH(3);
-            m->battery_voltage = num;
-            break;
-        case 14: /* OOO */
-            P18_EXPECT_LISTITEM_LENGTH(3);
-            m->battery_discharge_current = num;
-            break;
-        case 15: /* PPP */
-            P18_EXPECT_LISTITEM_LENGTH(3);
-            m->battery_charging_current = num;
-            break;
-        case 16: /* QQQ */
-            P18_EXPECT_LISTITEM_LENGTH(3);
-            m->total_battery_charging_current = num;
-            break;
-        case 17: /* MMM. It's not my mistake, it's as per the doc. */
-            P18_EXPECT_LISTITEM_LENGTH(3);
-            m->battery_capacity = num;
-            break;
-        case 18: /* RRRR */
-            P18_EXPECT_LISTITEM_LENGTH(4);
-            m->pv1_input_power = num;
-            break;
-        case 19: /* SSSS */
-            P18_EXPECT_LISTITEM_LENGTH(4);
-            m->pv2_input_power = num;
-            break;
-        case 20: /* TTTT */
-            P18_EXPECT_LISTITEM_LENGTH(4);
-            m->pv1_input_voltage = num == 1;
-            break;
-        case 21: /* UUUU */
-            P18_EXPECT_LISTITEM_LENGTH(4);
-            m->pv2_input_voltage = num;
-            break;
-        case 22: /* V */
-            P18_EXPECT_LISTITEM_LENGTH(1);
-            m->mppt1_charger_status = num;
-            break;
-        case 23: /* W */
-            P18_EXPECT_LISTITEM_LENGTH(1);
-            m->mppt2_charger_status = num;
-            break;
-        case 24: /* X */
-            P18_EXPECT_LISTITEM_LENGTH(1);
-            m->load_connected = num == 1;
-            break;
-        case 25: /* Y */
-            P18_EXPECT_LISTITEM_LENGTH(1);
-            m->battery_power_direction = num;
-            break;
-        case 26: /* Z */
-            P18_EXPECT_LISTITEM_LENGTH(1);
-            m->dc_ac_power_direction = num;
-            break;
-        case 27: /* a */
-            P18_EXPECT_LISTITEM_LENGTH(1);
-            m->line_power_direction = num;
-            break;
-        case 28: /* bbb. It's marked in red in the doc, idk what it means. */
-                 /* My guess is that this elem is not always present. */
-            P18_EXPECT_LISTITEM_LENGTH(3);
-            m->max_temp = num;
+    const char *item = data;
+
+    for (int index = 0; *item != '\0'; index++) {
+        const char *end = item;
+        while (*end != ',' && *end != '\0')
+            end++;
+
+        if (*len >= capacity)
+            ERROR("warning: %dth item, ignoring as we accepting up to %zu values\n",
+                  index, capacity);
+        else
+            values[(*len)++] = (int)p18_parse_number(item, end - item);
+
+        if (*end == '\0')
             break;
+        item = end + 1;
     }
 }
-P18_UNPACK_FN(parallel_general_status)
-{
-    P18_PARSE_LIST_AND_RETURN(parallel_general_status, 29)
-}
 
-P18_PARSE_CB_FN(ac_charge_time_bucket)
-{
-    p18_ac_charge_time_bucket_msg_t *m = (p18_ac_charge_time_bucket_msg_t *)message_ptr;
-    char buf[4];
-    switch (index) {
-        case 0: /* AAAA */
-            P18_EXPECT_LISTITEM_LENGTH(4);
+/* ------------------------------------------ */
+/* Command-specific methods */
 
-            substr_copy(buf, value, 2);
-            m->start_h = atoi(buf);
+P18_FIELDS(protocol_id) = {
+    P18_NUMBER(protocol_id, id, 0, 2),
+};
+P18_UNPACK_FNS(protocol_id, 0)
+
+/* YYYYMMDDHHMMSS */
+P18_FIELDS(current_time) = {
+    P18_SUBNUMBER(current_time, year,   "year",   0, 0,  4),
+    P18_SUBNUMBER(current_time, month,  "month",  0, 4,  2),
+    P18_SUBNUMBER(current_time, day,    "day",    0, 6,  2),
+    P18_SUBNUMBER(current_time, hour,   "hour",   0, 8,  2),
+    P18_SUBNUMBER(current_time, minute, "minute", 0, 10, 2),
+    P18_SUBNUMBER(current_time, second, "second", 0, 12, 2),
+};
+P18_UNPACK_FNS(current_time, 0)
 
-            substr_copy(buf, value+2, 2);
-            m->start_m = atoi(buf);
+P18_FIELDS(total_generated) = {
+    P18_NUMBER(total_generated, kwh, 0, 8),
+};
+P18_UNPACK_FNS(total_generated, 0)
 
-            break;
+P18_FIELDS(year_generated) = {
+    P18_NUMBER(year_generated, kwh, 0, 8),
+};
+P18_UNPACK_FNS(year_generated, 0)
 
-        case 1: /* BBBB */
-            P18_EXPECT_LISTITEM_LENGTH(4);
+P18_FIELDS(month_generated) = {
+    P18_NUMBER(month_generated, kwh, 0, 8),
+};
+P18_UNPACK_FNS(month_generated, 0)
 
-            substr_copy(buf, value, 2);
-            m->end_h = atoi(buf);
+P18_FIELDS(day_generated) = {
+    P18_FIELD(day_generated, kwh, "wh", 0, 0, 8, P18_FIELD_NUMBER),
+};
+P18_UNPACK_FNS(day_generated, 0)
 
-            substr_copy(buf, value+2, 2);
-            m->end_m = atoi(buf);
+/* two digits of length followed by the id, padded to 20 characters */
+P18_FIELDS(series_number) = {
+    P18_SUBNUMBER(series_number, length, "sn", 0, 0, 2),
+    P18_FIELD(series_number, id, "sn", 0, 2, 0, P18_FIELD_STRING),
+};
+static P18_MSG_T(series_number) p18_unpack_series_number(const char *data, uint32_t mask)
+{
+    P18_MSG_T(series_number) m = {0};
+    P18_DECODE(series_number, m, 0, mask);
 
-            break;
-    }
+    if (m.length >= 0 && m.length < (short)sizeof(m.id))
+        m.id[m.length] = '\0';
+
+    return m;
 }
-P18_UNPACK_FN(ac_charge_time_bucket)
+P18_UNPACK_FN(series_number)
 {
-    P18_PARSE_LIST_AND_RETURN(ac_charge_time_bucket, 2)
+    return p18_unpack_series_number(data, P18_ALL_FIELDS);
 }
-
-P18_PARSE_CB_FN(ac_supply_load_time_bucket)
+P18_UNPACK_SELECTED_FN(series_number)
 {
-    p18_ac_supply_load_time_bucket_msg_t *m = (p18_ac_supply_load_time_bucket_msg_t *)message_ptr;
-    char buf[4];
-    switch (index) {
-        case 0: /* AAAA */
-            P18_EXPECT_LISTITEM_LENGTH(4);
+    return p18_unpack_series_number(data, P18_SELECTED(series_number, keys, count));
+}
 
-            substr_copy(buf, value, 2);
-            m->start_h = atoi(buf);
+P18_FIELDS(cpu_version) = {
+    P18_FIELD(cpu_version, main_cpu_version,   "main_v",   0, 0, 5, P18_FIELD_STRING),
+    P18_FIELD(cpu_version, slave1_cpu_version, "slave1_v", 1, 0, 5, P18_FIELD_STRING),
+    P18_FIELD(cpu_version, slave2_cpu_version, "slave2_v", 2, 0, 5, P18_FIELD_STRING),
+};
+P18_UNPACK_FNS(cpu_version, 3)
+
+P18_FIELDS(rated_information) = {
+    P18_NUMBER(rated_information, ac_input_rating_voltage,         0,  4), /* AAAA */
+    P18_NUMBER(rated_information, ac_input_rating_current,         1,  3), /* BBB */
+    P18_NUMBER(rated_information, ac_output_rating_voltage,        2,  4), /* CCCC */
+    P18_NUMBER(rated_information, ac_output_rating_freq,           3,  3), /* DDD */
+    P18_NUMBER(rated_information, ac_output_rating_current,        4,  3), /* EEE */
+    P18_NUMBER(rated_information, ac_output_rating_apparent_power, 5,  4), /* FFFF */
+    P18_NUMBER(rated_information, ac_output_rating_active_power,   6,  4), /* GGGG */
+    P18_NUMBER(rated_information, battery_rating_voltage,          7,  3), /* HHH */
+    P18_NUMBER(rated_information, battery_recharge_voltage,        8,  3), /* III */
+    P18_NUMBER(rated_information, battery_redischarge_voltage,     9,  3), /* JJJ */
+    P18_NUMBER(rated_information, battery_under_voltage,           10, 3), /* KKK */
+    P18_NUMBER(rated_information, battery_bulk_voltage,            11, 3), /* LLL */
+    P18_NUMBER(rated_information, battery_float_voltage,           12, 3), /* MMM */
+    P18_NUMBER(rated_information, battery_type,                    13, 1), /* N */
+    P18_NUMBER(rated_information, max_ac_charging_current,         14, 2), /* OO */
+    P18_NUMBER(rated_information, max_charging_current,            15, 3), /* PPP */
+    P18_NUMBER(rated_information, input_voltage_range,             16, 1), /* Q */
+    P18_NUMBER(rated_information, output_source_priority,          17, 1), /* R */
+    P18_NUMBER(rated_information, charger_source_priority,         18, 1), /* S */
+    P18_NUMBER(rated_information, parallel_max_num,                19, 1), /* T */
+    P18_NUMBER(rated_information, machine_type,                    20, 1), /* U */
+    P18_NUMBER(rated_information, topology,                        21, 1), /* V */
+    P18_NUMBER(rated_information, output_model_setting,            22, 1), /* W */
+    P18_NUMBER(rated_information, solar_power_priority,            23, 1), /* Z */
+    P18_STRING(rated_information, mppt,                            24, 1), /* a */
+};
+P18_UNPACK_FNS(rated_information, 25)
+
+P18_FIELDS(general_status) = {
+    P18_NUMBER(general_status, grid_voltage,              0,  4), /* AAAA */
+    P18_NUMBER(general_status, grid_freq,                 1,  3), /* BBB */
+    P18_NUMBER(general_status, ac_output_voltage,         2,  4), /* CCCC */
+    P18_NUMBER(general_status, ac_output_freq,            3,  3), /* DDD */
+    P18_NUMBER(general_status, ac_output_apparent_power,  4,  4), /* EEEE */
+    P18_NUMBER(general_status, ac_output_active_power,    5,  4), /* FFFF */
+    P18_NUMBER(general_status, output_load_percent,       6,  3), /* GGG */
+    P18_NUMBER(general_status, battery_voltage,           7,  3), /* HHH */
+    P18_NUMBER(general_status, battery_voltage_scc,       8,  3), /* III */
+    P18_NUMBER(general_status, battery_voltage_scc2,      9,  3), /* JJJ */
+    P18_NUMBER(general_status, battery_discharge_current, 10, 3), /* KKK */
+    P18_NUMBER(general_status, battery_charging_current,  11, 3), /* LLL */
+    P18_NUMBER(general_status, battery_capacity,          12, 3), /* MMM */
+    P18_NUMBER(general_status, inverter_heat_sink_temp,   13, 3), /* NNN */
+    P18_NUMBER(general_status, mppt1_charger_temp,        14, 3), /* OOO */
+    P18_NUMBER(general_status, mppt2_charger_temp,        15, 3), /* PPP */
+    P18_NUMBER(general_status, pv1_input_power,           16, 4), /* QQQQ */
+    P18_NUMBER(general_status, pv2_input_power,           17, 4), /* RRRR */
+    P18_NUMBER(general_status, pv1_input_voltage,         18, 4), /* SSSS */
+    P18_NUMBER(general_status, pv2_input_voltage,         19, 4), /* TTTT */
+    P18_BOOL  (general_status, settings_values_changed,   20, 1), /* U */
+    P18_NUMBER(general_status, mppt1_charger_status,      21, 1), /* V */
+    P18_NUMBER(general_status, mppt2_charger_status,      22, 1), /* W */
+    P18_BOOL  (general_status, load_connected,            23, 1), /* X */
+    P18_NUMBER(general_status, battery_power_direction,   24, 1), /* Y */
+    P18_NUMBER(general_status, dc_ac_power_direction,     25, 1), /* Z */
+    P18_NUMBER(general_status, line_power_direction,      26, 1), /* a */
+    P18_NUMBER(general_status, local_parallel_id,         27, 1), /* b */
+};
+P18_UNPACK_FNS(general_status, 28)
 
-            substr_copy(buf, value+2, 2);
-            m->start_m = atoi(buf);
+P18_FIELDS(working_mode) = {
+    P18_NUMBER(working_mode, mode, 0, 2),
+};
+P18_UNPACK_FNS(working_mode, 0)
+
+P18_FIELDS(faults_warnings) = {
+    P18_NUMBER(faults_warnings, fault_code,                         0,  2),
+    P18_FLAG  (faults_warnings, line_fail,                          1,  1),
+    P18_FLAG  (faults_warnings, output_circuit_short,               2,  1),
+    P18_FLAG  (faults_warnings, inverter_over_temperature,          3,  1),
+    P18_FLAG  (faults_warnings, fan_lock,                           4,  1),
+    P18_FLAG  (faults_warnings, battery_voltage_high,               5,  1),
+    P18_FLAG  (faults_warnings, battery_low,                        6,  1),
+    P18_FLAG  (faults_warnings, battery_under,                      7,  1),
+    P18_FLAG  (faults_warnings, over_load,                          8,  1),
+    P18_FLAG  (faults_warnings, eeprom_fail,                        9,  1),
+    P18_FLAG  (faults_warnings, power_limit,                        10, 1),
+    P18_FLAG  (faults_warnings, pv1_voltage_high,                   11, 1),
+    P18_FLAG  (faults_warnings, pv2_voltage_high,                   12, 1),
+    P18_FLAG  (faults_warnings, mppt1_overload_warning,             13, 1),
+    P18_FLAG  (faults_warnings, mppt2_overload_warning,             14, 1),
+    P18_FLAG  (faults_warnings, battery_too_low_to_charge_for_scc1, 15, 1),
+    P18_FLAG  (faults_warnings, battery_too_low_to_charge_for_scc2, 16, 1),
+};
+P18_UNPACK_FNS(faults_warnings, 17)
+
+/* the 9th item is reserved */
+P18_FIELDS(flags_statuses) = {
+    P18_FLAG(flags_statuses, buzzer,                                        0, 1),
+    P18_FLAG(flags_statuses, overload_bypass,                               1, 1),
+    P18_FLAG(flags_statuses, lcd_escape_to_default_page_after_1min_timeout, 2, 1),
+    P18_FLAG(flags_statuses, overload_restart,                              3, 1),
+    P18_FLAG(flags_statuses, over_temp_restart,                             4, 1),
+    P18_FLAG(flags_statuses, backlight_on,                                  5, 1),
+    P18_FLAG(flags_statuses, alarm_on_primary_source_interrupt,             6, 1),
+    P18_FLAG(flags_statuses, fault_code_record,                             7, 1),
+};
+P18_UNPACK_FNS(flags_statuses, 9)
+
+P18_FIELDS(defaults) = {
+    P18_NUMBER(defaults, ac_output_voltage,                                  0,  4), /* AAAA */
+    P18_NUMBER(defaults, ac_output_freq,                                     1,  3), /* BBB */
+    P18_NUMBER(defaults, ac_input_voltage_range,                             2,  1), /* C */
+    P18_NUMBER(defaults, battery_under_voltage,                              3,  3), /* DDD */
+    P18_FIELD (defaults, charging_float_voltage, "battery_float_voltage",       4,  0, 3, P18_FIELD_NUMBER), /* EEE */
+    P18_FIELD (defaults, charging_bulk_voltage,  "battery_bulk_voltage",        5,  0, 3, P18_FIELD_NUMBER), /* FFF */
+    P18_NUMBER(defaults, battery_recharge_voltage,                           6,  3), /* GGG */
+    P18_NUMBER(defaults, battery_redischarge_voltage,                        7,  3), /* HHH */
+    P18_NUMBER(defaults, max_charging_current,                               8,  3), /* III */
+    P18_NUMBER(defaults, max_ac_charging_current,                            9,  2), /* JJ */
+    P18_NUMBER(defaults, battery_type,                                       10, 1), /* K */
+    P18_NUMBER(defaults, output_source_priority,                             11, 1), /* L */
+    P18_NUMBER(defaults, charger_source_priority,                            12, 1), /* M */
+    P18_NUMBER(defaults, solar_power_priority,                               13, 1), /* N */
+    P18_NUMBER(defaults, machine_type,                                       14, 1), /* O */
+    P18_NUMBER(defaults, output_model_setting,                               15, 1), /* P */
+    P18_FIELD (defaults, flag_buzzer,                                        "buzzer_flag",                                        16, 0, 1, P18_FIELD_FLAG), /* S */
+    P18_FIELD (defaults, flag_overload_restart,                              "overload_restart_flag",                              17, 0, 1, P18_FIELD_FLAG), /* T */
+    P18_FIELD (defaults, flag_over_temp_restart,                             "over_temp_restart_flag",                             18, 0, 1, P18_FIELD_FLAG), /* U */
+    P18_FIELD (defaults, flag_backlight_on,                                  "backlight_on_flag",                                  19, 0, 1, P18_FIELD_FLAG), /* V */
+    P18_FIELD (defaults, flag_alarm_on_primary_source_interrupt,             "alarm_on_primary_source_interrupt_flag",             20, 0, 1, P18_FIELD_FLAG), /* W */
+    P18_FIELD (defaults, flag_fault_code_record,                             "fault_code_record_flag",                             21, 0, 1, P18_FIELD_FLAG), /* X */
+    P18_FIELD (defaults, flag_overload_bypass,                               "overload_bypass_flag",                               22, 0, 1, P18_FIELD_FLAG), /* Y */
+    P18_FIELD (defaults, flag_lcd_escape_to_default_page_after_1min_timeout, "lcd_escape_to_default_page_after_1min_timeout_flag", 23, 0, 1, P18_FIELD_FLAG), /* Z */
+};
+P18_UNPACK_FNS(defaults, 24)
 
-            break;
+P18_UNPACK_FN(max_charging_current_selectable_values)
+{
+    P18_MSG_T(max_charging_current_selectable_values) m = {0};
+    p18_decode_list(data, m.amps, ARRAY_SIZE(m.amps), &m.len);
+    return m;
+}
+P18_UNPACK_SELECTED_FN(max_charging_current_selectable_values)
+{
+    UNUSED(keys);
+    UNUSED(count);
+    return P18_UNPACK_FN_NAME(max_charging_current_selectable_values)(data);
+}
 
-        case 1: /* BBBB */
-            P18_EXPECT_LISTITEM_LENGTH(4);
+P18_UNPACK_FN(max_ac_charging_current_selectable_values)
+{
+    P18_MSG_T(max_ac_charging_current_selectable_values) m = {0};
+    p18_decode_list(data, m.amps, ARRAY_SIZE(m.amps), &m.len);
+    return m;
+}
+P18_UNPACK_SELECTED_FN(max_ac_charging_current_selectable_values)
+{
+    UNUSED(keys);
+    UNUSED(count);
+    return P18_UNPACK_FN_NAME(max_ac_charging_current_selectable_values)(data);
+}
 
-            substr_copy(buf, value, 2);
-            m->end_h = atoi(buf);
+P18_FIELDS(parallel_rated_information) = {
+    P18_NUMBER(parallel_rated_information, parallel_id_connection_status, 0, 1),  /* A */
+    P18_FIELD (parallel_rated_information, serial_number_valid_length, "serial_number", 1, 0, 2, P18_FIELD_NUMBER), /* BB */
+    P18_STRING(parallel_rated_information, serial_number,                 2, 20), /* CCCCCCCCCCCCCCCCCCCC */
+    P18_NUMBER(parallel_rated_information, charger_source_priority,       3, 1),  /* D */
+    P18_NUMBER(parallel_rated_information, max_charging_current,          4, 3),  /* EEE */
+    P18_NUMBER(parallel_rated_information, max_ac_charging_current,       5, 2),  /* FF */
+    P18_NUMBER(parallel_rated_information, output_model_setting,          6, 1),  /* G */
+};
+static P18_MSG_T(parallel_rated_information) p18_unpack_parallel_rated_information(const char *data, uint32_t mask)
+{
+    P18_MSG_T(parallel_rated_information) m = {0};
+    P18_DECODE(parallel_rated_information, m, 7, mask);
 
-            substr_copy(buf, value+2, 2);
-            m->end_m = atoi(buf);
+    /* the serial number is padded to 20 characters */
+    if (m.serial_number_valid_length >= 0
+        && m.serial_number_valid_length < (int)sizeof(m.serial_number))
+        m.serial_number[m.serial_number_valid_length] = '\0';
 
-            break;
-    }
+    return m;
+}
+P18_UNPACK_FN(parallel_rated_information)
+{
+    return p18_unpack_parallel_rated_information(data, P18_ALL_FIELDS);
 }
-P18_UNPACK_FN(ac_supply_load_time_bucket)
+P18_UNPACK_SELECTED_FN(parallel_rated_information)
 {
-    P18_PARSE_LIST_AND_RETURN(ac_supply_load_time_bucket, 2)
+    return p18_unpack_parallel_rated_information(data, P18_SELECTED(parallel_rated_information, keys, count));
 }
 
+P18_FIELDS(parallel_general_status) = {
+    P18_NUMBER(parallel_general_status, parallel_id_connection_status,  0,  1), /* A */
+    P18_FIELD (parallel_general_status, work_mode, "mode",              1,  0, 1, P18_FIELD_NUMBER), /* B */
+    P18_NUMBER(parallel_general_status, fault_code,                     2,  2), /* CC */
+    P18_NUMBER(parallel_general_status, grid_voltage,                   3,  4), /* DDDD */
+    P18_NUMBER(parallel_general_status, grid_freq,                      4,  3), /* EEE */
+    P18_NUMBER(parallel_general_status, ac_output_voltage,              5,  4), /* FFFF */
+    P18_NUMBER(parallel_general_status, ac_output_freq,                 6,  3), /* GGG */
+    P18_NUMBER(parallel_general_status, ac_output_apparent_power,       7,  4), /* HHHH */
+    P18_NUMBER(parallel_general_status, ac_output_active_power,         8,  4), /* IIII */
+    P18_NUMBER(parallel_general_status, total_ac_output_apparent_power, 9,  5), /* JJJJJ */
+    P18_NUMBER(parallel_general_status, total_ac_output_active_power,   10, 5), /* KKKKK */
+    P18_NUMBER(parallel_general_status, output_load_percent,            11, 3), /* LLL */
+    P18_NUMBER(parallel_general_status, total_output_load_percent,      12, 3), /* MMM */
+    P18_NUMBER(parallel_general_status, battery_voltage,                13, 3), /* NNN */
+    P18_NUMBER(parallel_general_status, battery_discharge_current,      14, 3), /* OOO */
+    P18_NUMBER(parallel_general_status, battery_charging_current,       15, 3), /* PPP */
+    P18_NUMBER(parallel_general_status, total_battery_charging_current, 16, 3), /* QQQ */
+    P18_NUMBER(parallel_general_status, battery_capacity,               17, 3), /* MMM. It's not my mistake, it's as per the doc. */
+    P18_NUMBER(parallel_general_status, pv1_input_power,                18, 4), /* RRRR */
+    P18_NUMBER(parallel_general_status, pv2_input_power,                19, 4), /* SSSS */
+    P18_NUMBER(parallel_general_status, pv1_input_voltage,              20, 4), /* TTTT */
+    P18_NUMBER(parallel_general_status, pv2_input_voltage,              21, 4), /* UUUU */
+    P18_NUMBER(parallel_general_status, mppt1_charger_status,           22, 1), /* V */
+    P18_NUMBER(parallel_general_status, mppt2_charger_status,           23, 1), /* W */
+    P18_BOOL  (parallel_general_status, load_connected,                 24, 1), /* X */
+    P18_NUMBER(parallel_general_status, battery_power_direction,        25, 1), /* Y */
+    P18_NUMBER(parallel_general_status, dc_ac_power_direction,          26, 1), /* Z */
+    P18_NUMBER(parallel_general_status, line_power_direction,           27, 1), /* a */
+    /* bbb. It's marked in red in the doc, idk what it means.
+       My guess is that this elem is not always present. */
+    P18_NUMBER(parallel_general_status, max_temp,                       28, 3),
+};
+P18_UNPACK_FNS(parallel_general_status, 29)
+
+/* HHMM,HHMM */
+P18_FIELDS(ac_charge_time_bucket) = {
+    P18_SUBNUMBER(ac_charge_time_bucket, start_h, "start_time", 0, 0, 2),
+    P18_SUBNUMBER(ac_charge_time_bucket, start_m, "start_time", 0, 2, 2),
+    P18_SUBNUMBER(ac_charge_time_bucket, end_h,   "end_time",   1, 0, 2),
+    P18_SUBNUMBER(ac_charge_time_bucket, end_m,   "end_time",   1, 2, 2),
+};
+P18_UNPACK_FNS(ac_charge_time_bucket, 2)
+
+/* HHMM,HHMM */
+P18_FIELDS(ac_supply_load_time_bucket) = {
+    P18_SUBNUMBER(ac_supply_load_time_bucket, start_h, "start_time", 0, 0, 2),
+    P18_SUBNUMBER(ac_supply_load_time_bucket, start_m, "start_time", 0, 2, 2),
+    P18_SUBNUMBER(ac_supply_load_time_bucket, end_h,   "end_time",   1, 0, 2),
+    P18_SUBNUMBER(ac_supply_load_time_bucket, end_m,   "end_time",   1, 2, 2),
+};
+P18_UNPACK_FNS(ac_supply_load_time_bucket, 2)
+
 /* ------------------------------------------ */
 /* Label getters */
 
@@ -27,31 +27,20 @@
 #define P18_SET_CMDS_ENUM_OFFSET   1100
 
 #define MK_P18_UNPACK_FN_NAME(msg_type)    p18_unpack_ ## msg_type ## _msg
-#define MK_P18_PARSE_CB_FN_NAME(msg_type)  p18_parse_cb_ ## msg_type ## _msg
+#define MK_P18_UNPACK_SELECTED_FN_NAME(msg_type) p18_unpack_ ## msg_type ## _msg_selected
 #define MK_P18_MSG_T(msg_type)             p18_ ## msg_type ## _msg_t
 
 #define P18_MSG_T(msg_type)             MK_P18_MSG_T(msg_type)
 #define P18_UNPACK_FN_NAME(msg_type)    MK_P18_UNPACK_FN_NAME(msg_type)
-#define P18_PARSE_CB_FN_NAME(msg_type)  MK_P18_PARSE_CB_FN_NAME(msg_type)
+#define P18_UNPACK_SELECTED_FN_NAME(msg_type) MK_P18_UNPACK_SELECTED_FN_NAME(msg_type)
 
 #define P18_UNPACK_FN(msg_type) \
      P18_MSG_T(msg_type) P18_UNPACK_FN_NAME(msg_type)(const char *data)
 
-#define P18_PARSE_CB_FN(msg_type) \
-     static void P18_PARSE_CB_FN_NAME(msg_type)(const char *value, \
-                                                size_t value_len, \
-                                                unsigned int index, \
-                                                void *message_ptr)
-
-#define P18_PARSE_LIST_AND_RETURN(msg_type, exp_items_count) \
-    P18_MSG_T(msg_type) m = {0}; \
-    p18_parse_list(data, &m, (exp_items_count), P18_PARSE_CB_FN_NAME(msg_type)); \
-    return m;
-
-#define P18_EXPECT_LISTITEM_LENGTH(len)     \
-    p18_expect_listitem_length((const char *)__func__, index, (len), value_len)
-
-typedef void (*p18_parse_cb_t)(const char *, size_t, unsigned int, void *);
+/* same, but decodes only fields printed under the given keys and leaves the
+   rest zeroed; messages that have none of them are decoded fully */
+#define P18_UNPACK_SELECTED_FN(msg_type) \
+     P18_MSG_T(msg_type) P18_UNPACK_SELECTED_FN_NAME(msg_type)(const char *data, const char *const *keys, size_t count)
 
 /* ------------------------------------------ */
 /* Commands list */
@@ -454,8 +443,19 @@ extern const char *p18_battery_util_redischarging_voltages_48v_unit[12];
 /* ------------------------------------------ */
 /* Common methods */
 
+#define P18_MAX_COMMAND_LENGTH 128
+
+/* A command as it's written to the device: followed by the CRC and '\r'. */
+typedef struct {
+    char data[P18_MAX_COMMAND_LENGTH + 3];
+    size_t size;          /* of the whole frame */
+    size_t command_size;  /* without the CRC and '\r' */
+} p18_frame_t;
+
 bool p18_build_command(int command, const char **args, size_t args_size, char *buf);
+const p18_frame_t *p18_build_frame(int command, const char **args, size_t args_size, p18_frame_t *buf);
 bool p18_validate_query_response(const char *buf, size_t size, size_t *data_size);
+bool p18_response_matches(int command, const char *buf, size_t size);
 bool p18_set_result(const char *buf, size_t size);
 
 /* ------------------------------------------ */
@@ -482,6 +482,27 @@ P18_UNPACK_FN(parallel_general_status);
 P18_UNPACK_FN(ac_charge_time_bucket);
 P18_UNPACK_FN(ac_supply_load_time_bucket);
 
+P18_UNPACK_SELECTED_FN(protocol_id);
+P18_UNPACK_SELECTED_FN(current_time);
+P18_UNPACK_SELECTED_FN(total_generated);
+P18_UNPACK_SELECTED_FN(year_generated);
+P18_UNPACK_SELECTED_FN(month_generated);
+P18_UNPACK_SELECTED_FN(day_generated);
+P18_UNPACK_SELECTED_FN(series_number);
+P18_UNPACK_SELECTED_FN(cpu_version);
+P18_UNPACK_SELECTED_FN(rated_information);
+P18_UNPACK_SELECTED_FN(general_status);
+P18_UNPACK_SELECTED_FN(working_mode);
+P18_UNPACK_SELECTED_FN(faults_warnings);
+P18_UNPACK_SELECTED_FN(flags_statuses);
+P18_UNPACK_SELECTED_FN(defaults);
+P18_UNPACK_SELECTED_FN(max_charging_current_selectable_values);
+P18_UNPACK_SELECTED_FN(max_ac_charging_current_selectable_values);
+P18_UNPACK_SELECTED_FN(parallel_rated_information);
+P18_UNPACK_SELECTED_FN(parallel_general_status);
+P18_UNPACK_SELECTED_FN(ac_charge_time_bucket);
+P18_UNPACK_SELECTED_FN(ac_supply_load_time_bucket);
+
 
 /* ------------------------------------------ */
 /* Label getters */
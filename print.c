@@ -16,15 +16,26 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <unistd.h>
 #include "print.h"
+#include "delta.h"
 #include "util.h"
 
-#define PRINT_AUTO(items) \
-    if (print_is_table_format(format)) \
-        print_table((items), ARRAY_SIZE(items), format == PRINT_FORMAT_PARSABLE_TABLE); \
-    else \
-        print_json((items), ARRAY_SIZE(items), format == PRINT_FORMAT_JSON_W_UNITS);
+#define PRINT_AUTO(fields, values) \
+    _Static_assert(ARRAY_SIZE(fields) == ARRAY_SIZE(values), "a value for each field"); \
+    _Static_assert(ARRAY_SIZE(fields) <= UCHAR_MAX + 1, "indexed by unsigned char"); \
+    print_items(p, (fields), (values), ARRAY_SIZE(fields), format);
+
+/* i-th item of a list of indices, or just i if there's no list */
+#define PRINT_INDEX(list, i) ((list) != NULL ? (size_t)(list)[i] : (i))
 
 const short default_precision = 2;
 const char *units[] = {
@@ -45,6 +56,207 @@ const char *false_s = "false";
 const char *enabled = "Enabled";
 const char *disabled = "Disabled";
 
+/* output of the default printer, written out with one write() per message
+   or document */
+static char default_buf[PRINT_BUF_LENGTH];
+
+static print_columns_t default_columns;
+
+/* used by the CLI and by PRINT_FN functions called with NULL */
+static print_t default_printer = {
+    .buf = default_buf,
+    .size = sizeof(default_buf),
+    .flush = true,
+    .delta = true,
+    .document = {.empty = true, .format = PRINT_FORMAT_TABLE},
+    .columns = &default_columns
+};
+
+static void print_flush_section(print_t *p);
+static bool print_is_table_format(print_format_t f);
+
+void print_init_buffer(print_t *p, char *buf, size_t size)
+{
+    memset(p, 0, sizeof(*p));
+    p->buf = buf;
+    p->size = size;
+    p->document.empty = true;
+    if (size)
+        buf[0] = '\0';
+}
+
+/* Writes to the printer's file with as few write() calls as it takes. */
+static void print_write_file(print_t *p, const char *data, size_t len)
+{
+    FILE *f = p->file != NULL ? p->file : stdout;
+    int fd = fileno(f);
+    if (fd < 0) {
+        /* not backed by a descriptor, like an open_memstream() */
+        fwrite(data, 1, len, f);
+        fflush(f);
+        return;
+    }
+
+    /* whatever was written to f by other means goes first */
+    fflush(f);
+    while (len > 0) {
+        ssize_t written = write(fd, data, len);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        data += written;
+        len -= (size_t)written;
+    }
+}
+
+static void print_flush(print_t *p)
+{
+    if (!p->flush || !p->len)
+        return;
+    print_write_file(p, p->buf, p->len);
+    p->len = 0;
+}
+
+/* Flushes the default printer after each message, unless it's a part of a
+   document, which is flushed by print_end(). */
+static void print_done(print_t *p)
+{
+    if (!p->document.active)
+        print_flush(p);
+}
+
+static void print_write(print_t *p, const char *s, size_t n)
+{
+    if (p->flush) {
+        if (p->len + n > p->size)
+            print_flush(p);
+        if (n > p->size) {
+            /* wouldn't fit anyway */
+            print_write_file(p, s, n);
+            return;
+        }
+        memcpy(p->buf + p->len, s, n);
+        p->len += n;
+        return;
+    }
+
+    /* a caller's buffer, keeps as much as fits and stays NUL-terminated */
+    if (p->len + 1 < p->size) {
+        size_t fits = MIN(n, p->size - p->len - 1);
+        memcpy(p->buf + p->len, s, fits);
+        p->buf[p->len + fits] = '\0';
+    }
+    p->len += n;
+}
+
+static inline void print_putc(print_t *p, char c)
+{
+    if (p->flush && p->len < p->size)
+        p->buf[p->len++] = c;
+    else
+        print_write(p, &c, 1);
+}
+
+static inline void print_str(print_t *p, const char *s)
+{
+    print_write(p, s, strlen(s));
+}
+
+static void print_spaces(print_t *p, size_t n)
+{
+    while (n--)
+        print_putc(p, ' ');
+}
+
+static void print_long(print_t *p, long n)
+{
+    char buf[24];
+    char *s = buf + sizeof(buf);
+    unsigned long u = n < 0 ? -(unsigned long)n : (unsigned long)n;
+    do {
+        *--s = (char)('0' + u % 10);
+        u /= 10;
+    } while (u);
+    if (n < 0)
+        *--s = '-';
+    print_write(p, s, (size_t)(buf + sizeof(buf) - s));
+}
+
+/* Same as printf("%.*f"). Values that are too large, or too close to halfway
+   between two results for the rounding to be sure, are left to snprintf(). */
+static void print_fixed(print_t *p, double d, short precision)
+{
+    static const long scales[] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+    double a = signbit(d) ? -d : d;
+
+    if (precision >= 0 && precision < (short)ARRAY_SIZE(scales) && a < 1e12) {
+        long scale = scales[precision];
+        double scaled = a * scale;
+        double whole = floor(scaled);
+        double frac = scaled - whole;
+        if (fabs(frac - 0.5) > 1e-6) {
+            long long n = (long long)whole + (frac > 0.5);
+            char buf[32];
+            char *s = buf + sizeof(buf);
+            for (short i = 0; i < precision; i++) {
+                *--s = (char)('0' + n % 10);
+                n /= 10;
+            }
+            if (precision)
+                *--s = '.';
+            do {
+                *--s = (char)('0' + n % 10);
+                n /= 10;
+            } while (n);
+            if (signbit(d))
+                *--s = '-';
+            print_write(p, s, (size_t)(buf + sizeof(buf) - s));
+            return;
+        }
+    }
+
+    char buf[352];
+    int len = snprintf(buf, sizeof(buf), "%.*f", precision, d);
+    if (len > 0)
+        print_write(p, buf, MIN((size_t)len, sizeof(buf)-1));
+}
+
+/* Prints mantissa / 10^scale with precision digits after the point, using
+   integer arithmetic only. Digits past the precision are rounded half away
+   from zero. */
+static void print_decimal(print_t *p, long mantissa, short scale, short precision)
+{
+    unsigned long u = mantissa < 0 ? -(unsigned long)mantissa : (unsigned long)mantissa;
+    char buf[64];
+    char *s = buf + sizeof(buf);
+
+    precision = MIN(precision, PRINT_MAX_PRECISION);
+    if (scale > precision) {
+        unsigned long divisor = (unsigned long)variant_fixed_divisor(scale - precision);
+        u = u / divisor + (u % divisor >= (divisor + 1) / 2);
+        scale = precision;
+    }
+
+    for (short i = scale; i < precision; i++)
+        *--s = '0';
+    for (short i = 0; i < scale; i++) {
+        *--s = (char)('0' + u % 10);
+        u /= 10;
+    }
+    if (precision)
+        *--s = '.';
+    do {
+        *--s = (char)('0' + u % 10);
+        u /= 10;
+    } while (u);
+    if (mantissa < 0)
+        *--s = '-';
+
+    print_write(p, s, (size_t)(buf + sizeof(buf) - s));
+}
+
 static const char* print_unit_label(print_unit_t unit)
 {
     switch (unit) {
@@ -63,99 +275,426 @@ static const char* print_unit_label(print_unit_t unit)
     }
 }
 
-static void print_table(print_item_t *items, size_t size, bool parsable)
+static void print_table(print_t *p,
+                        const print_field_t *fields,
+                        const variant_t *values,
+                        const unsigned char *list,
+                        size_t count,
+                        bool parsable)
 {
-    print_item_t item;
-    char fmt[32], doublefmt[16];
-    char k[64], v[64];
+    size_t max_title_len = 0;
+
+    print_flush_section(p);
 
     if (!parsable) {
-        size_t len, max_title_len = 0;
-        for (size_t i = 0; i < size; i++) {
-            item = items[i];
-            len = strlen(item.title) + 1 /* for colon */;
+        for (size_t i = 0; i < count; i++) {
+            size_t len = strlen(fields[PRINT_INDEX(list, i)].title) + 1 /* for colon */;
             if (len > max_title_len)
                 max_title_len = len;
         }
-        sprintf(fmt, "%%-%zus %%s", max_title_len);
-    } else {
-        sprintf(fmt, "%%s %%s");
     }
 
-    const char *unit;
-    for (size_t i = 0; i < size; i++) {
-        item = items[i];
-
-        strcpy(k, parsable ? item.key : item.title);
-        if (!parsable)
-            strcat(k, ":");
-
-        if (variant_is_double(item.value)) {
-            sprintf(doublefmt, "%%2.%dlf",
-                    item.precision ? item.precision : default_precision);
-            snprintf(v, 32, doublefmt, item.value.d);
-        } else if (variant_is_long(item.value))
-            snprintf(v, 32, "%ld", item.value.l);
-        else if (variant_is_string(item.value)) {
-            char *pos = strchr(item.value.s, ' ');
-            if (parsable && pos != NULL && pos != item.value.s)
-                snprintf(v, 32, "\"%s\"", item.value.s);
-            else
-                snprintf(v, 32, "%s", item.value.s);
-        } else if (variant_is_bool(item.value))
-            snprintf(v, 32, "%s", item.value.b ? yes : no);
-        else if (variant_is_flag(item.value))
-            snprintf(v, 32, "%s", item.value.b ? enabled : disabled);
-
-        printf(fmt, k, v);
-        if (item.unit) {
-            unit = print_unit_label(item.unit);
+    for (size_t i = 0; i < count; i++) {
+        const print_field_t *field = &fields[PRINT_INDEX(list, i)];
+        const variant_t *value = &values[PRINT_INDEX(list, i)];
+
+        if (parsable) {
+            print_str(p, field->key);
+        } else {
+            size_t len = strlen(field->title);
+            print_write(p, field->title, len);
+            print_putc(p, ':');
+            print_spaces(p, max_title_len - len - 1);
+        }
+        print_putc(p, ' ');
+
+        if (variant_is_fixed(*value))
+            print_decimal(p, value->l, value->scale,
+                          field->precision ? field->precision : default_precision);
+        else if (variant_is_double(*value))
+            print_fixed(p, value->d,
+                        field->precision ? field->precision : default_precision);
+        else if (variant_is_long(*value))
+            print_long(p, value->l);
+        else if (variant_is_string(*value)) {
+            char *pos = strchr(value->s, ' ');
+            bool quote = parsable && pos != NULL && pos != value->s;
+            if (quote)
+                print_putc(p, '"');
+            print_str(p, value->s);
+            if (quote)
+                print_putc(p, '"');
+        } else if (variant_is_bool(*value))
+            print_str(p, value->b ? yes : no);
+        else if (variant_is_flag(*value))
+            print_str(p, value->b ? enabled : disabled);
+
+        if (field->unit) {
+            const char *unit = print_unit_label(field->unit);
             if (parsable && *unit != ' ')
-                putchar(' ');
-            printf("%s", print_unit_label(item.unit));
+                print_putc(p, ' ');
+            print_str(p, unit);
         }
 
-        putchar('\n');
+        print_putc(p, '\n');
     }
+
+    print_done(p);
 }
 
-void print_json(print_item_t *items, size_t size, bool with_units)
+static void print_json_object(print_t *p,
+                              const print_field_t *fields,
+                              const variant_t *values,
+                              const unsigned char *list,
+                              size_t count,
+                              bool with_units)
 {
-    print_item_t item;
-    putchar('{');
-    for (size_t i = 0; i < size; i++) {
-        item = items[i];
-        printf("\"%s\":", item.key);
-
-        if (item.unit && with_units)
-            putchar('[');
-
-        if (variant_is_string(item.value))
-            printf("\"%s\"", item.value.s);
-        else if (variant_is_double(item.value))
-            printf("%2.2lf", item.value.d);
-        else if (variant_is_long(item.value))
-            printf("%ld", item.value.l);
-        else if (variant_is_bool(item.value) || variant_is_flag(item.value))
-            printf("%s", item.value.b ? true_s : false_s);
-
-        if (item.unit && with_units) {
-            const char *unit_label = print_unit_label(item.unit);
+    print_flush_section(p);
+    print_putc(p, '{');
+    for (size_t i = 0; i < count; i++) {
+        const print_field_t *field = &fields[PRINT_INDEX(list, i)];
+        const variant_t *value = &values[PRINT_INDEX(list, i)];
+        print_putc(p, '"');
+        print_str(p, field->key);
+        print_putc(p, '"');
+        print_putc(p, ':');
+
+        if (field->unit && with_units)
+            print_putc(p, '[');
+
+        if (variant_is_string(*value)) {
+            print_putc(p, '"');
+            print_str(p, value->s);
+            print_putc(p, '"');
+        } else if (variant_is_fixed(*value))
+            print_decimal(p, value->l, value->scale, 2);
+        else if (variant_is_double(*value))
+            print_fixed(p, value->d, 2);
+        else if (variant_is_long(*value))
+            print_long(p, value->l);
+        else if (variant_is_bool(*value) || variant_is_flag(*value))
+            print_str(p, value->b ? true_s : false_s);
+
+        if (field->unit && with_units) {
+            const char *unit_label = print_unit_label(field->unit);
             if (unit_label[0] == ' ')
                 unit_label++;
-            printf(",\"%s\"]", unit_label);
+            print_str(p, ",\"");
+            print_str(p, unit_label);
+            print_str(p, "\"]");
         }
 
-        if (i < size-1)
-            putchar(',');
+        if (i < count-1)
+            print_putc(p, ',');
+    }
+    print_putc(p, '}');
+    if (!p->document.active)
+        print_putc(p, '\n');
+
+    print_done(p);
+}
+
+/* FNV-1a, to tell whether a csv header differs from the one printed */
+#define PRINT_HASH_INIT 2166136261UL
+
+static unsigned long print_hash(unsigned long h, const char *s, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+        h = ((h ^ (unsigned char)s[i]) * 16777619UL) & 0xffffffffUL;
+    return h;
+}
+
+/* A csv field is quoted if it has to be, as in RFC 4180. Tsv can't quote,
+   so tabs and line breaks are replaced with spaces. */
+static void print_delimited_str(print_t *p, const char *s, char sep)
+{
+    if (sep == '\t') {
+        for (; *s; s++)
+            print_putc(p, (*s == '\t' || *s == '\n' || *s == '\r') ? ' ' : *s);
+        return;
+    }
+
+    if (strpbrk(s, ",\"\r\n") == NULL) {
+        print_str(p, s);
+        return;
+    }
+
+    print_putc(p, '"');
+    for (; *s; s++) {
+        if (*s == '"')
+            print_putc(p, '"');
+        print_putc(p, *s);
+    }
+    print_putc(p, '"');
+}
+
+/* Decimal values are printed exactly, with as many digits as they have. */
+static void print_delimited_value(print_t *p, const variant_t *value, char sep)
+{
+    if (variant_is_string(*value))
+        print_delimited_str(p, value->s, sep);
+    else if (variant_is_fixed(*value))
+        print_decimal(p, value->l, value->scale, value->scale);
+    else if (variant_is_double(*value))
+        print_fixed(p, value->d, default_precision);
+    else if (variant_is_long(*value))
+        print_long(p, value->l);
+    else if (variant_is_bool(*value) || variant_is_flag(*value))
+        print_str(p, value->b ? true_s : false_s);
+}
+
+/* A stream gets one header, before its first row. A row with other columns
+   would make it unreadable as a table, so it's skipped. Returns false then,
+   and sets *header if the header is yet to be printed. */
+static bool print_delimited_row(print_t *p, unsigned long hash, bool *header)
+{
+    *header = p->header_hash == 0;
+    if (*header)
+        p->header_hash = hash;
+    else if (hash != p->header_hash) {
+        ERROR("csv and tsv can't mix samples of different kinds, row skipped\n");
+        return false;
+    }
+    return true;
+}
+
+/* Outside of a document, a row is printed with each message. In a document,
+   columns are collected until print_end(). */
+static void print_delimited(print_t *p,
+                            const print_field_t *fields,
+                            const variant_t *values,
+                            const unsigned char *list,
+                            size_t count,
+                            char sep)
+{
+    print_flush_section(p);
+
+    if (p->document.active && p->columns != NULL) {
+        print_t *header = &p->columns->header;
+        print_t *row = &p->columns->row;
+        const char *section = p->document.section;
+        for (size_t i = 0; i < count; i++) {
+            if (row->len) {
+                print_putc(header, sep);
+                print_putc(row, sep);
+            }
+            if (section != NULL) {
+                char column[256];
+                snprintf(column, sizeof(column), "%s.%s", section, fields[PRINT_INDEX(list, i)].key);
+                print_delimited_str(header, column, sep);
+            } else {
+                print_str(header, fields[PRINT_INDEX(list, i)].key);
+            }
+            print_delimited_value(row, &values[PRINT_INDEX(list, i)], sep);
+        }
+        return;
+    }
+
+    unsigned long hash = PRINT_HASH_INIT;
+    for (size_t i = 0; i < count; i++) {
+        const char *key = fields[PRINT_INDEX(list, i)].key;
+        if (i)
+            hash = print_hash(hash, &sep, 1);
+        hash = print_hash(hash, key, strlen(key));
+    }
+    bool header;
+    if (!print_delimited_row(p, hash, &header))
+        return;
+    if (header) {
+        for (size_t i = 0; i < count; i++) {
+            if (i)
+                print_putc(p, sep);
+            print_str(p, fields[PRINT_INDEX(list, i)].key);
+        }
+        print_putc(p, '\n');
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (i)
+            print_putc(p, sep);
+        print_delimited_value(p, &values[PRINT_INDEX(list, i)], sep);
     }
-    putchar('}');
-    putchar('\n');
+    print_putc(p, '\n');
+
+    print_done(p);
+}
+
+/* measurement names, tag keys and values, and field keys */
+static void print_influx_name(print_t *p, const char *s, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        if (s[i] == ',' || s[i] == '=' || s[i] == ' ')
+            print_putc(p, '\\');
+        print_putc(p, s[i]);
+    }
+}
+
+/* A point of InfluxDB line protocol. The measurement is the section name,
+   and its DEVICE. prefix, if there is one, goes to the device tag instead
+   of the printer's device. */
+static void print_influx(print_t *p,
+                         const print_field_t *fields,
+                         const variant_t *values,
+                         const unsigned char *list,
+                         size_t count)
+{
+    print_flush_section(p);
+
+    const char *measurement = p->document.active && p->document.section != NULL
+        ? p->document.section
+        : "isv";
+    const char *dot = strrchr(measurement, '.');
+    if (dot != NULL) {
+        print_influx_name(p, dot+1, strlen(dot+1));
+        print_str(p, ",device=");
+        print_influx_name(p, measurement, (size_t)(dot - measurement));
+    } else {
+        print_influx_name(p, measurement, strlen(measurement));
+        if (p->device != NULL) {
+            print_str(p, ",device=");
+            print_influx_name(p, p->device, strlen(p->device));
+        }
+    }
+    if (p->document.active && p->document.id >= 0) {
+        print_str(p, ",id=");
+        print_long(p, p->document.id);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        const char *key = fields[PRINT_INDEX(list, i)].key;
+        const variant_t *value = &values[PRINT_INDEX(list, i)];
+
+        print_putc(p, i ? ',' : ' ');
+        print_influx_name(p, key, strlen(key));
+        print_putc(p, '=');
+
+        if (variant_is_string(*value)) {
+            print_putc(p, '"');
+            for (const char *c = value->s; *c; c++) {
+                if (*c == '"' || *c == '\\')
+                    print_putc(p, '\\');
+                print_putc(p, *c);
+            }
+            print_putc(p, '"');
+        } else if (variant_is_long(*value)) {
+            print_long(p, value->l);
+            print_putc(p, 'i');
+        } else {
+            print_delimited_value(p, value, ',');
+        }
+    }
+
+    if (p->document.active && p->document.has_time) {
+        /* milliseconds to nanoseconds, without overflowing */
+        char ns[32];
+        snprintf(ns, sizeof(ns), " %llu%03u000000",
+                 p->document.time / 1000, (unsigned int)(p->document.time % 1000));
+        print_str(p, ns);
+    }
+    print_putc(p, '\n');
+
+    print_done(p);
+}
+
+/* Prints the listed items of a message as they are, in any format. */
+static void print_object(print_t *p,
+                         const print_field_t *fields,
+                         const variant_t *values,
+                         const unsigned char *list,
+                         size_t count,
+                         print_format_t format)
+{
+    if (print_is_table_format(format))
+        print_table(p, fields, values, list, count, format == PRINT_FORMAT_PARSABLE_TABLE);
+    else if (print_is_delimited_format(format))
+        print_delimited(p, fields, values, list, count, format == PRINT_FORMAT_TSV ? '\t' : ',');
+    else if (format == PRINT_FORMAT_INFLUX)
+        print_influx(p, fields, values, list, count);
+    else
+        print_json_object(p, fields, values, list, count, format == PRINT_FORMAT_JSON_W_UNITS);
+}
+
+void print_json(const print_field_t *fields, const variant_t *values, size_t size, bool with_units)
+{
+    print_json_object(&default_printer, fields, values, NULL, size, with_units);
+}
+
+void print_select_fields(const char *const *keys, size_t count)
+{
+    default_printer.selection.keys = keys;
+    default_printer.selection.count = count;
+}
+
+void print_set_device(const char *name)
+{
+    default_printer.device = name;
+}
+
+static bool print_is_selected(const print_t *p, const char *key)
+{
+    for (size_t i = 0; i < p->selection.count; i++) {
+        if (!strcmp(p->selection.keys[i], key))
+            return true;
+    }
+    return false;
+}
+
+/* Prints items of a message, or in delta mode only those that changed.
+   If some fields are selected, only those are printed, unless the message
+   has none of them. Nothing is copied: the items to print are listed by
+   their indices. */
+static void print_items(print_t *p,
+                        const print_field_t *fields,
+                        const variant_t *values,
+                        size_t size,
+                        print_format_t format)
+{
+    if (p == NULL)
+        p = &default_printer;
+
+    /* PRINT_AUTO() makes sure that indices fit */
+    unsigned char list[UCHAR_MAX + 1];
+    const unsigned char *printed = NULL;
+    size_t count = size;
+
+    if (p->selection.count) {
+        size_t selected = 0;
+        for (size_t i = 0; i < size; i++) {
+            if (print_is_selected(p, fields[i].key))
+                list[selected++] = (unsigned char)i;
+        }
+        if (selected) {
+            printed = list;
+            count = selected;
+        }
+    }
+
+    if (p->delta && delta_enabled()) {
+        if (printed == NULL) {
+            for (size_t i = 0; i < size; i++)
+                list[i] = (unsigned char)i;
+            printed = list;
+        }
+        count = delta_filter(p->document.active ? p->document.section : NULL,
+                             fields, values, list, count);
+        if (!count)
+            return;
+    }
+
+    print_object(p, fields, values, printed, count, format);
+}
+
+void print_set_output(FILE *f)
+{
+    print_flush(&default_printer);
+    default_printer.file = f;
 }
 
 bool print_is_json_format(print_format_t f)
 {
-    return f == PRINT_FORMAT_JSON_W_UNITS || f == PRINT_FORMAT_JSON;
+    return f == PRINT_FORMAT_JSON_W_UNITS
+        || f == PRINT_FORMAT_JSON
+        || f == PRINT_FORMAT_NDJSON;
 }
 
 static bool print_is_table_format(print_format_t f)
@@ -163,927 +702,1241 @@ static bool print_is_table_format(print_format_t f)
     return f == PRINT_FORMAT_TABLE || f == PRINT_FORMAT_PARSABLE_TABLE;
 }
 
-void print_set_result(bool success, print_format_t format) {
-    if (print_is_table_format(format))
-        printf("%s\n", success ? "OK" : "Failure");
-    else {
-        print_item_t items[] = {
-            {
-                .key = (success ? "ok" : "error"),
-                .value = (success ? variant_long(1) : variant_string("failure"))
+bool print_is_delimited_format(print_format_t f)
+{
+    return f == PRINT_FORMAT_CSV || f == PRINT_FORMAT_TSV;
+}
+
+bool print_stamps_samples(print_format_t f)
+{
+    return f == PRINT_FORMAT_NDJSON || f == PRINT_FORMAT_INFLUX || print_is_delimited_format(f);
+}
+
+/* In delta mode, the document and its sections are opened lazily, when
+   something is printed into them, so that sections without changes and
+   documents without sections are omitted entirely. */
+static void print_open_document(print_t *p)
+{
+    if (p->document.opened)
+        return;
+    p->document.opened = true;
+    if (print_is_json_format(p->document.format))
+        print_putc(p, '{');
+}
+
+static void print_flush_section(print_t *p)
+{
+    if (!p->document.active || !p->document.section_pending)
+        return;
+
+    print_open_document(p);
+    if (print_is_json_format(p->document.format)) {
+        if (!p->document.empty)
+            print_putc(p, ',');
+        print_putc(p, '"');
+        print_str(p, p->document.section);
+        print_str(p, "\":");
+    } else if (print_is_table_format(p->document.format)) {
+        if (!p->document.empty)
+            print_putc(p, '\n');
+        print_putc(p, '[');
+        print_str(p, p->document.section);
+        print_str(p, "]\n");
+    }
+    p->document.empty = false;
+    p->document.section_pending = false;
+}
+
+void print_begin(print_format_t format)
+{
+    print_t *p = &default_printer;
+    p->document.active = true;
+    p->document.opened = false;
+    p->document.empty = true;
+    p->document.section_pending = false;
+    p->document.section = NULL;
+    p->document.format = format;
+    p->document.has_time = false;
+    p->document.id = -1;
+    if (print_is_delimited_format(format) && p->columns != NULL) {
+        print_columns_t *c = p->columns;
+        print_init_buffer(&c->header, c->header_buf, sizeof(c->header_buf));
+        print_init_buffer(&c->row, c->row_buf, sizeof(c->row_buf));
+    }
+    if (!delta_enabled())
+        print_open_document(p);
+}
+
+void print_section(const char *name, print_format_t format)
+{
+    print_t *p = &default_printer;
+    UNUSED(format);
+    if (!p->document.active)
+        return;
+
+    p->document.section = name;
+    p->document.section_pending = true;
+    if (!delta_enabled())
+        print_flush_section(p);
+}
+
+void print_end(print_format_t format)
+{
+    print_t *p = &default_printer;
+    if (!p->document.active)
+        return;
+
+    p->document.active = false;
+    if (!p->document.opened)
+        return;
+
+    if (print_is_json_format(format)) {
+        print_putc(p, '}');
+        print_putc(p, '\n');
+    } else if (print_is_delimited_format(format)) {
+        const print_t *row = p->columns != NULL ? &p->columns->row : NULL;
+        if (row != NULL && row->len) {
+            /* buffers of their own are truncated, not flushed */
+            const print_t *header = &p->columns->header;
+            size_t header_len = MIN(header->len, header->size - 1);
+            unsigned long hash = print_hash(PRINT_HASH_INIT, header->buf, header_len);
+            bool print_header;
+            if (print_delimited_row(p, hash, &print_header)) {
+                if (print_header) {
+                    print_write(p, header->buf, header_len);
+                    print_putc(p, '\n');
+                }
+                print_write(p, row->buf, MIN(row->len, row->size - 1));
+                print_putc(p, '\n');
             }
+        }
+    } else if (print_is_table_format(format) && !p->document.empty) {
+        print_putc(p, '\n');
+    }
+    print_flush(p);
+}
+
+void print_error(print_format_t format, const char *fmt, ...)
+{
+    enum { buf_size = 256 };
+    char buf[buf_size];
+    va_list args;
+    va_start(args, fmt);
+    size_t len = vsnprintf(buf, buf_size, fmt, args);
+    va_end(args);
+    buf[MIN(len, buf_size-1)] = '\0';
+    ERROR("error: %s\n", buf);
+    if (print_is_json_format(format)) {
+        static const print_field_t fields[] = {
+            {.key= "error"}
+        };
+        const variant_t values[] = {
+            variant_string(buf),
+        };
+        print_json(fields, values, ARRAY_SIZE(fields), false);
+    }
+}
+
+void print_set_result(bool success, print_format_t format) {
+    print_t *p = &default_printer;
+    print_flush_section(p);
+    if (print_is_table_format(format)) {
+        print_str(p, success ? "OK\n" : "Failure\n");
+        print_done(p);
+    } else {
+        static const print_field_t ok_fields[] = {
+            {.key= "ok"}
+        };
+        static const print_field_t error_fields[] = {
+            {.key= "error"}
+        };
+        const variant_t values[] = {
+            success ? variant_long(1) : variant_string("failure"),
         };
-        print_json(items, ARRAY_SIZE(items), false);
+        print_object(p, success ? ok_fields : error_fields, values, NULL, ARRAY_SIZE(values), format);
     }
 }
 
-static void print_table_list(const int *items, size_t size)
+/* In influx, time and id of a sample are not a point of their own, but the
+   timestamp and a tag of the points that follow in the document. */
+static bool print_sample_tag(unsigned long long time, int id)
 {
-    for (size_t i = 0; i < size; i++)
-        printf("%d\n", items[i]);
+    print_t *p = &default_printer;
+    if (!p->document.active)
+        return false;
+    p->document.has_time = true;
+    p->document.time = time;
+    p->document.id = id;
+    p->document.section_pending = false;
+    return true;
 }
 
-static void print_json_list(const int *items, size_t size)
+void print_sample(unsigned long long time, int id, print_format_t format)
 {
-    putchar('[');
+    static const print_field_t fields[] = {
+        {.key= "time", .title= "Time"},
+        {.key= "id",   .title= "ID"},
+    };
+    const variant_t values[] = {
+        variant_long((long)time),
+        variant_long(id),
+    };
+    size_t size = id >= 0 ? 2 : 1;
+
+    if (format == PRINT_FORMAT_INFLUX && print_sample_tag(time, id))
+        return;
+    print_object(&default_printer, fields, values, NULL, size, format);
+}
+
+void print_sample_clock(unsigned long long time, unsigned long long monotonic, print_format_t format)
+{
+    static const print_field_t fields[] = {
+        {.key= "time",      .title= "Time"},
+        {.key= "monotonic", .title= "Monotonic time"},
+    };
+    const variant_t values[] = {
+        variant_long((long)time),
+        variant_long((long)monotonic),
+    };
+
+    if (format == PRINT_FORMAT_INFLUX && print_sample_tag(time, -1))
+        return;
+    print_object(&default_printer, fields, values, NULL, ARRAY_SIZE(fields), format);
+}
+
+void print_device(const char *path,
+                  const char *serial,
+                  const char *manufacturer,
+                  const char *product,
+                  const char *sn,
+                  print_format_t format)
+{
+    static const print_field_t fields[] = {
+        {.key= "path",         .title= "Path"},
+        {.key= "serial",       .title= "Serial number"},
+        {.key= "manufacturer", .title= "Manufacturer"},
+        {.key= "product",      .title= "Product"},
+        {.key= "sn",           .title= "Series number"},
+    };
+    const variant_t values[] = {
+        variant_string(path),
+        variant_string(serial),
+        variant_string(manufacturer),
+        variant_string(product),
+        variant_string(sn),
+    };
+    size_t size = sn != NULL ? 5 : 4;
+
+    print_object(&default_printer, fields, values, NULL, size, format);
+}
+
+static void print_table_list(print_t *p, const int *items, size_t size)
+{
+    if (p == NULL)
+        p = &default_printer;
+    print_flush_section(p);
+    for (size_t i = 0; i < size; i++) {
+        print_long(p, items[i]);
+        print_putc(p, '\n');
+    }
+    print_done(p);
+}
+
+static void print_json_list(print_t *p, const int *items, size_t size)
+{
+    if (p == NULL)
+        p = &default_printer;
+    print_flush_section(p);
+    print_putc(p, '[');
     for (size_t i = 0; i < size; i++) {
-        printf("%d", items[i]);
+        print_long(p, items[i]);
         if (i < size-1)
-            putchar(',');
+            print_putc(p, ',');
     }
-    putchar(']');
-    putchar('\n');
+    print_putc(p, ']');
+    if (!p->document.active)
+        print_putc(p, '\n');
+    print_done(p);
 }
 
+/* in other formats, a list is a single space-separated string */
+static void print_joined_list(print_t *p, const int *items, size_t size, print_format_t format)
+{
+    static const print_field_t fields[] = {
+        {.key= "amps", .title= "Amps"}
+    };
+    char buf[256];
+    size_t len = 0;
+    buf[0] = '\0';
+    for (size_t i = 0; i < size && len < sizeof(buf); i++)
+        len += (size_t)snprintf(buf + len, sizeof(buf) - len, i ? " %d" : "%d", items[i]);
+    const variant_t values[] = {
+        variant_string(buf),
+    };
+    print_object(p != NULL ? p : &default_printer, fields, values, NULL, ARRAY_SIZE(fields), format);
+}
 
 /* ------------------------------------------ */
 
 PRINT_FN(protocol_id)
 {
-    print_item_t items[] = {
-        {.key= "id", .title= "Protocol ID", .value= variant_long(m->id)}
+    static const print_field_t fields[] = {
+        {.key= "id", .title= "Protocol ID"}
     };
-    PRINT_AUTO(items)
+    const variant_t values[] = {
+        variant_long(m->id),
+    };
+    PRINT_AUTO(fields, values)
 }
 
 PRINT_FN(current_time)
 {
-    print_item_t items[] = {
-        {.key= "year",   .title= "Year",   .value= variant_long(m->year)  },
-        {.key= "month",  .title= "Month",  .value= variant_long(m->month) },
-        {.key= "day",    .title= "Day",    .value= variant_long(m->day)   },
-        {.key= "hour",   .title= "Hour",   .value= variant_long(m->hour)  },
-        {.key= "minute", .title= "Minute", .value= variant_long(m->minute)},
-        {.key= "second", .title= "Second", .value= variant_long(m->second)},
+    static const print_field_t fields[] = {
+        {.key= "year",   .title= "Year"},
+        {.key= "month",  .title= "Month"},
+        {.key= "day",    .title= "Day"},
+        {.key= "hour",   .title= "Hour"},
+        {.key= "minute", .title= "Minute"},
+        {.key= "second", .title= "Second"},
+    };
+    const variant_t values[] = {
+        variant_long(m->year),
+        variant_long(m->month),
+        variant_long(m->day),
+        variant_long(m->hour),
+        variant_long(m->minute),
+        variant_long(m->second),
     };
-    PRINT_AUTO(items)
+    PRINT_AUTO(fields, values)
 }
 
 PRINT_FN(total_generated)
 {
-    print_item_t items[] = {
+    static const print_field_t fields[] = {
         {
             .key = "kwh",
             .title = "kWh",
-            .value = variant_long((long)m->kwh)
         },
     };
-    PRINT_AUTO(items)
+    const variant_t values[] = {
+        variant_long((long)m->kwh),
+    };
+    PRINT_AUTO(fields, values)
 }
 
 PRINT_FN(year_generated)
 {
-    print_item_t items[] = {
+    static const print_field_t fields[] = {
         {
             .key = "kwh",
             .title = "kWh",
-            .value = variant_long((long)m->kwh)
         },
     };
-    PRINT_AUTO(items)
+    const variant_t values[] = {
+        variant_long((long)m->kwh),
+    };
+    PRINT_AUTO(fields, values)
 }
 
 PRINT_FN(month_generated)
 {
-    print_item_t items[] = {
+    static const print_field_t fields[] = {
         {
             .key = "kwh",
             .title = "kWh",
-            .value = variant_long((long)m->kwh)
         },
     };
-    PRINT_AUTO(items)
+    const variant_t values[] = {
+        variant_long((long)m->kwh),
+    };
+    PRINT_AUTO(fields, values)
 }
 
 PRINT_FN(day_generated)
 {
-    print_item_t items[] = {
+    static const print_field_t fields[] = {
         {
             .key = "wh",
             .title = "Wh",
-            .value = variant_long((long)m->kwh)
         },
     };
-    PRINT_AUTO(items)
+    const variant_t values[] = {
+        variant_long((long)m->kwh),
+    };
+    PRINT_AUTO(fields, values)
 }
 
 PRINT_FN(series_number)
 {
-    print_item_t items[] = {
-        {.key= "sn", .title= "Series number", .value= variant_string(m->id)}
+    static const print_field_t fields[] = {
+        {.key= "sn", .title= "Series number"}
+    };
+    const variant_t values[] = {
+        variant_string(m->id),
     };
-    PRINT_AUTO(items)
+    PRINT_AUTO(fields, values)
 }
 
 PRINT_FN(cpu_version)
 {
-    print_item_t items[] = {
-        {.key= "main_v",   .title= "Main CPU version",    .value= variant_string((m->main_cpu_version))},
-        {.key= "slave1_v", .title= "Slave 1 CPU version", .value= variant_string(m->slave1_cpu_version)},
-        {.key= "slave2_v", .title= "Slave 2 CPU version", .value= variant_string(m->slave2_cpu_version)},
+    static const print_field_t fields[] = {
+        {.key= "main_v",   .title= "Main CPU version"},
+        {.key= "slave1_v", .title= "Slave 1 CPU version"},
+        {.key= "slave2_v", .title= "Slave 2 CPU version"},
     };
-    PRINT_AUTO(items)
+    const variant_t values[] = {
+        variant_string((m->main_cpu_version)),
+        variant_string(m->slave1_cpu_version),
+        variant_string(m->slave2_cpu_version),
+    };
+    PRINT_AUTO(fields, values)
 }
 
 PRINT_FN(rated_information)
 {
-    print_item_t items[] = {
+    static const print_field_t fields[] = {
         {
             .key = "ac_input_rating_voltage",
             .title = "AC input rating voltage",
-            .value = variant_double(m->ac_input_rating_voltage/10.0),
             .precision = 1,
             .unit = PRINT_UNIT_V,
         },
         {
             .key = "ac_input_rating_current",
             .title = "AC input rating current",
-            .value = variant_double(m->ac_input_rating_current/10.0),
             .precision = 1,
             .unit = PRINT_UNIT_A,
         },
         {
             .key = "ac_output_rating_voltage",
             .title = "AC output rating voltage",
-            .value = variant_double(m->ac_output_rating_voltage/10.0),
             .precision = 1,
             .unit = PRINT_UNIT_V,
         },
         {
             .key = "ac_output_rating_freq",
             .title = "AC output rating frequency",
-            .value = variant_double(m->ac_output_rating_freq/10.0),
             .precision = 1,
             .unit = PRINT_UNIT_HZ
         },
         {
             .key = "ac_output_rating_current",
             .title =  "AC output rating current",
-            .value = variant_double(m->ac_output_rating_current/10.0),
             .precision = 1,
             .unit = PRINT_UNIT_A,
         },
         {
             .key = "ac_output_rating_apparent_power",
             .title = "AC output rating apparent power",
-            .value = variant_long(m->ac_output_rating_apparent_power),
             .unit = PRINT_UNIT_VA,
         },
         {
             .key = "ac_output_rating_active_power",
             .title = "AC output rating active power",
-            .value = variant_long(m->ac_output_rating_active_power),
             .unit = PRINT_UNIT_WH,
         },
         {
             .key = "battery_rating_voltage",
             .title = "Battery rating voltage",
-            .value = variant_double(m->battery_rating_voltage/10.0),
             .precision = 1,
             .unit = PRINT_UNIT_V,
         },
         {
             .key = "battery_recharge_voltage",
             .title = "Battery re-charge voltage",
-            .value = variant_double(m->battery_recharge_voltage/10.0),
             .precision = 1,
             .unit = PRINT_UNIT_V,
         },
         {
             .key = "battery_redischarge_voltage",
             .title = "Battery re-discharge voltage",
-            .value = variant_double(m->battery_redischarge_voltage/10.0),
             .precision = 1,
             .unit = PRINT_UNIT_V,
         },
         {
             .key = "battery_under_voltage",
             .title = "Battery under voltage",
-            .value = variant_double(m->battery_under_voltage/10.0),
             .precision = 1,
             .unit = PRINT_UNIT_V,
         },
         {
             .key = "battery_bulk_voltage",
             .title = "Battery bulk voltage",
-            .value = variant_double(m->battery_bulk_voltage/10.0),
             .precision = 1,
             .unit = PRINT_UNIT_V,
         },
         {
             .key = "battery_float_voltage",
             .title =  "Battery float voltage",
-            .value = variant_double(m->battery_float_voltage/10.0),
             .precision = 1,
             .unit = PRINT_UNIT_V,
         },
         {
             .key = "battery_type",
             .title = "Battery type",
-            .value = variant_string(p18_battery_type_label(m->battery_type))
         },
         {
             .key = "max_charging_current",
             .title = "Max charging current",
-            .value = variant_long(m->max_charging_current),
             .unit = PRINT_UNIT_A
         },
         {
             .key = "max_ac_charging_current",
             .title = "Max AC charging current",
-            .value = variant_long(m->max_ac_charging_current),
             .unit = PRINT_UNIT_A
         },
         {
             .key = "input_voltage_range",
             .title = "Input voltage range",
-            .value = variant_string(p18_input_voltage_range_label(m->input_voltage_range))
         },
         {
             .key = "output_source_priority",
             .title = "Output source priority",
-            .value = variant_string(p18_output_source_priority_label(m->output_source_priority))
         },
         {
             .key = "charger_source_priority",
             .title = "Charger source priority",
-            .value = variant_string(p18_charge_source_priority_label(m->charger_source_priority))
         },
         {
             .key = "parallel_max_num",
             .title = "Parallel max num",
-            .value = variant_long(m->parallel_max_num)
         },
         {
             .key = "machine_type",
             .title = "Machine type",
-            .value = variant_string(p18_machine_type_label(m->machine_type))
         },
         {
             .key = "topology",
             .title = "Topology",
-            .value = variant_string(p18_topology_label(m->topology))
         },
         {
             .key = "output_model_setting",
             .title = "Output model setting",
-            .value = variant_string(p18_output_model_setting_label(m->output_model_setting))
         },
         {
             .key = "solar_power_priority",
             .title = "Solar power priority",
-            .value = variant_string(p18_solar_power_priority_label(m->solar_power_priority))
         },
         {
             .key = "mppt",
             .title = "MPPT string",
-            .value = variant_string(m->mppt)
         },
     };
-    PRINT_AUTO(items)
+    const variant_t values[] = {
+        variant_fixed(m->ac_input_rating_voltage, 1),
+        variant_fixed(m->ac_input_rating_current, 1),
+        variant_fixed(m->ac_output_rating_voltage, 1),
+        variant_fixed(m->ac_output_rating_freq, 1),
+        variant_fixed(m->ac_output_rating_current, 1),
+        variant_long(m->ac_output_rating_apparent_power),
+        variant_long(m->ac_output_rating_active_power),
+        variant_fixed(m->battery_rating_voltage, 1),
+        variant_fixed(m->battery_recharge_voltage, 1),
+        variant_fixed(m->battery_redischarge_voltage, 1),
+        variant_fixed(m->battery_under_voltage, 1),
+        variant_fixed(m->battery_bulk_voltage, 1),
+        variant_fixed(m->battery_float_voltage, 1),
+        variant_string(p18_battery_type_label(m->battery_type)),
+        variant_long(m->max_charging_current),
+        variant_long(m->max_ac_charging_current),
+        variant_string(p18_input_voltage_range_label(m->input_voltage_range)),
+        variant_string(p18_output_source_priority_label(m->output_source_priority)),
+        variant_string(p18_charge_source_priority_label(m->charger_source_priority)),
+        variant_long(m->parallel_max_num),
+        variant_string(p18_machine_type_label(m->machine_type)),
+        variant_string(p18_topology_label(m->topology)),
+        variant_string(p18_output_model_setting_label(m->output_model_setting)),
+        variant_string(p18_solar_power_priority_label(m->solar_power_priority)),
+        variant_string(m->mppt),
+    };
+    PRINT_AUTO(fields, values)
 }
 
 PRINT_FN(general_status)
 {
-    print_item_t items[] = {
+    static const print_field_t fields[] = {
         {
             .key = "grid_voltage",
             .title = "Grid voltage",
-            .value = variant_double(m->grid_voltage/10.0),
             .precision = 1,
             .unit = PRINT_UNIT_V,
         },
         {
             .key = "grid_freq",
             .title = "Grid frequency",
-            .value = variant_double(m->grid_freq/10.0),
             .precision = 1,
             .unit = PRINT_UNIT_HZ,
         },
         {
             .key = "ac_output_voltage",
             .title = "AC output voltage",
-            .value = variant_double(m->ac_output_voltage/10.0),
             .precision = 1,
             .unit = PRINT_UNIT_V,
         },
         {
             .key = "ac_output_freq",
             .title = "AC output frequency",
-            .value = variant_double(m->ac_output_freq/10.0),
             .precision = 1,
             .unit = PRINT_UNIT_HZ,
         },
         {
             .key = "ac_output_apparent_power",
             .title = "AC output apparent power",
-            .value = variant_long(m->ac_output_apparent_power),
             .unit = PRINT_UNIT_VA,
         },
         {
             .key = "ac_output_active_power",
             .title = "AC output active power",
-            .value = variant_long(m->ac_output_active_power),
             .unit = PRINT_UNIT_WH,
         },
         {
             .key = "output_load_percent",
             .title = "Output load percent",
-            .value = variant_long(m->output_load_percent),
             .unit = PRINT_UNIT_PERCENTAGE,
         },
         {
             .key = "battery_voltage",
             .title = "Battery voltage",
-            .value = variant_double(m->battery_voltage/10.0),
             .precision = 1,
             .unit = PRINT_UNIT_V,
         },
         {
             .key = "battery_voltage_scc",
             .title = "Battery voltage from SCC",
-            .value = variant_double(m->battery_voltage_scc/10.0),
             .precision = 1,
             .unit = PRINT_UNIT_V,
         },
         {
             .key = "battery_voltage_scc2",
             .title = "Battery voltage from SCC2",
-            .value = variant_double(m->battery_voltage_scc2/10.0),
             .precision = 1,
             .unit = PRINT_UNIT_V,
         },
         {
             .key = "battery_discharge_current",
             .title = "Battery discharge current",
-            .value = variant_long(m->battery_discharge_current),
             .unit = PRINT_UNIT_A,
         },
         {
             .key = "battery_charging_current",
             .title = "Battery charging current",
-            .value = variant_long(m->battery_charging_current),
             .unit = PRINT_UNIT_A,
         },
         {
             .key = "battery_capacity",
             .title = "Battery capacity",
-            .value = variant_long(m->battery_capacity),
             .unit = PRINT_UNIT_PERCENTAGE,
         },
         {
             .key = "inverter_heat_sink_temp",
             .title = "Inverter heat sink temperature",
-            .value = variant_long(m->inverter_heat_sink_temp),
             .unit = PRINT_UNIT_CELSIUS,
         },
         {
             .key = "mppt1_charger_temp",
             .title = "MPPT1 charger temperature",
-            .value = variant_long(m->mppt1_charger_temp),
             .unit = PRINT_UNIT_CELSIUS,
         },
         {
             .key = "mppt2_charger_temp",
             .title = "MPPT2 charger temperature",
-            .value = variant_long(m->mppt2_charger_temp),
             .unit = PRINT_UNIT_CELSIUS,
         },
         {
             .key = "pv1_input_power",
             .title = "PV1 Input power",
-            .value = variant_double(m->pv1_input_power),
             .unit = PRINT_UNIT_WH,
         },
         {
             .key = "pv2_input_power",
             .title = "PV2 Input power",
-            .value = variant_double(m->pv2_input_power),
             .unit = PRINT_UNIT_WH,
         },
         {
             .key = "pv1_input_voltage",
             .title = "PV1 Input voltage",
-            .value = variant_double(m->pv1_input_voltage/10.0),
             .precision = 1,
             .unit = PRINT_UNIT_V,
         },
         {
             .key = "pv2_input_voltage",
             .title = "PV2 Input voltage",
-            .value = variant_double(m->pv2_input_voltage/10.0),
                 .precision = 1,
             .unit = PRINT_UNIT_V,
         },
         {
             .key = "settings_values_changed",
             .title = "Setting value configuration state",
-            .value = variant_string(m->settings_values_changed ? "Nothing changed" : "Something changed"),
         },
         {
             .key = "mppt1_charger_status",
             .title = "MPPT1 charger status",
-            .value = variant_string(p18_mppt_charger_status_label(m->mppt1_charger_status)),
         },
         {
             .key = "mppt2_charger_status",
             .title = "MPPT2 charger status",
-            .value = variant_string(p18_mppt_charger_status_label(m->mppt2_charger_status)),
         },
         {
             .key = "load_connected",
             .title = "Load connection",
-            .value = variant_string(m->load_connected ? "Connected" : "Disconnected"),
         },
         {
             .key = "battery_power_direction",
             .title = "Battery power direction",
-            .value = variant_string(p18_battery_power_direction_label(m->battery_power_direction)),
         },
         {
             .key = "dc_ac_power_direction",
             .title = "DC/AC power direction",
-            .value = variant_string(p18_dc_ac_power_direction_label(m->dc_ac_power_direction)),
         },
         {
             .key = "line_power_direction",
             .title = "Line power direction",
-            .value = variant_string(p18_line_power_direction_label(m->line_power_direction)),
         },
         {
             .key = "local_parallel_id",
             .title = "Local parallel ID",
-            .value = variant_long(m->local_parallel_id),
         }
     };
-    PRINT_AUTO(items)
+    const variant_t values[] = {
+        variant_fixed(m->grid_voltage, 1),
+        variant_fixed(m->grid_freq, 1),
+        variant_fixed(m->ac_output_voltage, 1),
+        variant_fixed(m->ac_output_freq, 1),
+        variant_long(m->ac_output_apparent_power),
+        variant_long(m->ac_output_active_power),
+        variant_long(m->output_load_percent),
+        variant_fixed(m->battery_voltage, 1),
+        variant_fixed(m->battery_voltage_scc, 1),
+        variant_fixed(m->battery_voltage_scc2, 1),
+        variant_long(m->battery_discharge_current),
+        variant_long(m->battery_charging_current),
+        variant_long(m->battery_capacity),
+        variant_long(m->inverter_heat_sink_temp),
+        variant_long(m->mppt1_charger_temp),
+        variant_long(m->mppt2_charger_temp),
+        variant_fixed(m->pv1_input_power, 0),
+        variant_fixed(m->pv2_input_power, 0),
+        variant_fixed(m->pv1_input_voltage, 1),
+        variant_fixed(m->pv2_input_voltage, 1),
+        variant_string(m->settings_values_changed ? "Nothing changed" : "Something changed"),
+        variant_string(p18_mppt_charger_status_label(m->mppt1_charger_status)),
+        variant_string(p18_mppt_charger_status_label(m->mppt2_charger_status)),
+        variant_string(m->load_connected ? "Connected" : "Disconnected"),
+        variant_string(p18_battery_power_direction_label(m->battery_power_direction)),
+        variant_string(p18_dc_ac_power_direction_label(m->dc_ac_power_direction)),
+        variant_string(p18_line_power_direction_label(m->line_power_direction)),
+        variant_long(m->local_parallel_id),
+    };
+    PRINT_AUTO(fields, values)
 }
 
 PRINT_FN(working_mode)
 {
-    print_item_t items[] = {
-        {.key= "mode", .title= "Working mode", .value= variant_string(p18_working_mode_label(m->mode))}
+    static const print_field_t fields[] = {
+        {.key= "mode", .title= "Working mode"}
+    };
+    const variant_t values[] = {
+        variant_string(p18_working_mode_label(m->mode)),
     };
-    PRINT_AUTO(items)
+    PRINT_AUTO(fields, values)
 }
 
 PRINT_FN(faults_warnings)
 {
-    print_item_t items[] = {
-        {.key= "fault_code",                .title= "Fault code",               .value= variant_string(p18_fault_code_label(m->fault_code))},
-        {.key= "line_fail",                 .title= "Line fail",                .value= variant_bool(m->line_fail)},
-        {.key= "output_circuit_short",      .title= "Output circuit short",     .value= variant_bool(m->output_circuit_short)},
-        {.key= "inverter_over_temperature", .title= "Inverter over temperature",.value= variant_bool(m->inverter_over_temperature)},
-        {.key= "fan_lock",                  .title= "Fan lock",                 .value= variant_bool(m->fan_lock)},
-        {.key= "battery_voltage_high",      .title= "Battery voltage high",     .value= variant_bool(m->battery_voltage_high)},
-        {.key= "battery_low",               .title= "Battery low",              .value= variant_bool(m->battery_low)},
-        {.key= "battery_under",             .title= "Battery under",            .value= variant_bool(m->battery_under)},
-        {.key= "over_load",                 .title= "Over load",                .value= variant_bool(m->over_load)},
-        {.key= "eeprom_fail",               .title= "EEPROM fail",              .value= variant_bool(m->eeprom_fail)},
-        {.key= "power_limit",               .title= "Power limit",              .value= variant_bool(m->power_limit)},
-        {.key= "pv1_voltage_high",          .title= "PV1 voltage high",         .value= variant_bool(m->pv1_voltage_high)},
-        {.key= "pv2_voltage_high",          .title= "PV2 voltage high",         .value= variant_bool(m->pv2_voltage_high)},
-        {.key= "mppt1_overload_warning",    .title= "MPPT1 overload warning",   .value= variant_bool(m->mppt1_overload_warning)},
-        {.key= "mppt2_overload_warning",    .title= "MPPT2 overload warning",   .value= variant_bool(m->mppt2_overload_warning)},
-        {.key= "battery_too_low_to_charge_for_scc1", .title= "Battery too low to charge for SCC1", .value= variant_bool(m->battery_too_low_to_charge_for_scc1)},
-        {.key= "battery_too_low_to_charge_for_scc2", .title= "Battery too low to charge for SCC2", .value= variant_bool(m->battery_too_low_to_charge_for_scc2)},
+    static const print_field_t fields[] = {
+        {.key= "fault_code",                .title= "Fault code"},
+        {.key= "line_fail",                 .title= "Line fail"},
+        {.key= "output_circuit_short",      .title= "Output circuit short"},
+        {.key= "inverter_over_temperature", .title= "Inverter over temperature"},
+        {.key= "fan_lock",                  .title= "Fan lock"},
+        {.key= "battery_voltage_high",      .title= "Battery voltage high"},
+        {.key= "battery_low",               .title= "Battery low"},
+        {.key= "battery_under",             .title= "Battery under"},
+        {.key= "over_load",                 .title= "Over load"},
+        {.key= "eeprom_fail",               .title= "EEPROM fail"},
+        {.key= "power_limit",               .title= "Power limit"},
+        {.key= "pv1_voltage_high",          .title= "PV1 voltage high"},
+        {.key= "pv2_voltage_high",          .title= "PV2 voltage high"},
+        {.key= "mppt1_overload_warning",    .title= "MPPT1 overload warning"},
+        {.key= "mppt2_overload_warning",    .title= "MPPT2 overload warning"},
+        {.key= "battery_too_low_to_charge_for_scc1", .title= "Battery too low to charge for SCC1"},
+        {.key= "battery_too_low_to_charge_for_scc2", .title= "Battery too low to charge for SCC2"},
     };
-    PRINT_AUTO(items)
+    const variant_t values[] = {
+        variant_string(p18_fault_code_label(m->fault_code)),
+        variant_bool(m->line_fail),
+        variant_bool(m->output_circuit_short),
+        variant_bool(m->inverter_over_temperature),
+        variant_bool(m->fan_lock),
+        variant_bool(m->battery_voltage_high),
+        variant_bool(m->battery_low),
+        variant_bool(m->battery_under),
+        variant_bool(m->over_load),
+        variant_bool(m->eeprom_fail),
+        variant_bool(m->power_limit),
+        variant_bool(m->pv1_voltage_high),
+        variant_bool(m->pv2_voltage_high),
+        variant_bool(m->mppt1_overload_warning),
+        variant_bool(m->mppt2_overload_warning),
+        variant_bool(m->battery_too_low_to_charge_for_scc1),
+        variant_bool(m->battery_too_low_to_charge_for_scc2),
+    };
+    PRINT_AUTO(fields, values)
 }
 
 PRINT_FN(flags_statuses)
 {
-    print_item_t items[] = {
+    static const print_field_t fields[] = {
         {
             .key = "buzzer",
             .title = "Buzzer",
-            .value = variant_flag(m->buzzer)
         },
         {
             .key = "overload_bypass",
             .title = "Overload bypass function",
-            .value = variant_flag(m->overload_bypass)
         },
         {
             .key = "lcd_escape_to_default_page_after_1min_timeout",
             .title = "Escape to default page after 1min timeout",
-            .value = variant_flag(m->lcd_escape_to_default_page_after_1min_timeout)
         },
         {
             .key = "overload_restart",
             .title = "Overload restart",
-            .value = variant_flag(m->overload_restart)
         },
         {
             .key = "over_temp_restart",
             .title = "Over temperature restart",
-            .value = variant_flag(m->over_temp_restart)
         },
         {
             .key = "backlight_on",
             .title = "Backlight on",
-            .value = variant_flag(m->backlight_on)
         },
         {
             .key = "alarm_on_primary_source_interrupt",
             .title = "Alarm on when primary source interrupt",
-            .value = variant_flag(m->alarm_on_primary_source_interrupt)
         },
         {
             .key = "fault_code_record",
             .title = "Fault code record",
-            .value = variant_flag(m->fault_code_record)
         },
     };
-    PRINT_AUTO(items)
+    const variant_t values[] = {
+        variant_flag(m->buzzer),
+        variant_flag(m->overload_bypass),
+        variant_flag(m->lcd_escape_to_default_page_after_1min_timeout),
+        variant_flag(m->overload_restart),
+        variant_flag(m->over_temp_restart),
+        variant_flag(m->backlight_on),
+        variant_flag(m->alarm_on_primary_source_interrupt),
+        variant_flag(m->fault_code_record),
+    };
+    PRINT_AUTO(fields, values)
 }
 
 PRINT_FN(defaults)
 {
-    print_item_t items[] = {
+    static const print_field_t fields[] = {
         {
             .key = "ac_output_voltage",
             .title = "AC output voltage",
-            .value = variant_double(m->ac_output_voltage/10.0),
             .precision = 1,
             .unit = PRINT_UNIT_V,
         },
         {
             .key = "ac_output_freq",
             .title = "AC output frequency",
-            .value = variant_double(m->ac_output_freq/10.0),
             .precision = 1,
             .unit = PRINT_UNIT_HZ,
         },
         {
             .key = "ac_input_voltage_range",
             .title = "AC input voltage range",
-            .value = variant_string(p18_input_voltage_range_label(m->ac_input_voltage_range)),
         },
         {
             .key = "battery_under_voltage",
             .title = "Battery under voltage",
-            .value = variant_double(m->battery_under_voltage/10.0),
             .precision = 1,
             .unit = PRINT_UNIT_V,
         },
         {
             .key = "battery_bulk_voltage",
             .title = "Charging bulk voltage",
-            .value = variant_double(m->charging_bulk_voltage/10.0),
             .precision = 1,
             .unit = PRINT_UNIT_V,
         },
         {
             .key = "battery_float_voltage",
             .title =  "Charging float voltage",
-            .value = variant_double(m->charging_float_voltage/10.0),
             .precision = 1,
             .unit = PRINT_UNIT_V,
         },
         {
             .key = "battery_recharge_voltage",
             .title = "Battery re-charge voltage",
-            .value = variant_double(m->battery_recharge_voltage/10.0),
             .precision = 1,
             .unit = PRINT_UNIT_V,
         },
         {
             .key = "battery_redischarge_voltage",
             .title = "Battery re-discharge voltage",
-            .value = variant_double(m->battery_redischarge_voltage/10.0),
             .precision = 1,
             .unit = PRINT_UNIT_V,
         },
         {
             .key = "max_ac_charging_current",
             .title = "Max AC charging current",
-            .value = variant_long(m->max_ac_charging_current),
             .unit = PRINT_UNIT_A
         },
         {
             .key = "max_charging_current",
             .title = "Max charging current",
-            .value = variant_long(m->max_charging_current),
             .unit = PRINT_UNIT_A
         },
         {
             .key = "battery_type",
             .title = "Battery type",
-            .value = variant_string(p18_battery_type_label(m->battery_type))
         },
         {
             .key = "output_source_priority",
             .title = "Output source priority",
-            .value = variant_string(p18_output_source_priority_label(m->output_source_priority))
         },
         {
             .key = "charger_source_priority",
             .title = "Charger source priority",
-            .value = variant_string(p18_charge_source_priority_label(m->charger_source_priority))
         },
         {
             .key = "solar_power_priority",
             .title = "Solar power priority",
-            .value = variant_string(p18_solar_power_priority_label(m->solar_power_priority))
         },
         {
             .key = "machine_type",
             .title = "Machine type",
-            .value = variant_string(p18_machine_type_label(m->machine_type))
         },
         {
             .key = "output_model_setting",
             .title = "Output model setting",
-            .value = variant_string(p18_output_model_setting_label(m->output_model_setting))
         },
         {
             .key = "buzzer_flag",
             .title = "Buzzer flag",
-            .value = variant_flag(m->flag_buzzer)
         },
         {
             .key = "overload_bypass_flag",
             .title = "Overload bypass function flag",
-            .value = variant_flag(m->flag_overload_bypass)
         },
         {
             .key = "lcd_escape_to_default_page_after_1min_timeout_flag",
             .title = "Escape to default page after 1min timeout flag",
-            .value = variant_flag(m->flag_lcd_escape_to_default_page_after_1min_timeout)
         },
         {
             .key = "overload_restart_flag",
             .title = "Overload restart flag",
-            .value = variant_flag(m->flag_overload_restart)
         },
         {
             .key = "over_temp_restart_flag",
             .title = "Over temperature restart flag",
-            .value = variant_flag(m->flag_over_temp_restart)
         },
         {
             .key = "backlight_on_flag",
             .title = "Backlight on flag",
-            .value = variant_flag(m->flag_backlight_on)
         },
         {
             .key = "alarm_on_primary_source_interrupt_flag",
             .title = "Alarm on when primary source interrupt flag",
-            .value = variant_flag(m->flag_alarm_on_primary_source_interrupt)
         },
         {
             .key = "fault_code_record_flag",
             .title = "Fault code record flag",
-            .value = variant_flag(m->flag_fault_code_record)
         }
     };
-    PRINT_AUTO(items)
+    const variant_t values[] = {
+        variant_fixed(m->ac_output_voltage, 1),
+        variant_fixed(m->ac_output_freq, 1),
+        variant_string(p18_input_voltage_range_label(m->ac_input_voltage_range)),
+        variant_fixed(m->battery_under_voltage, 1),
+        variant_fixed(m->charging_bulk_voltage, 1),
+        variant_fixed(m->charging_float_voltage, 1),
+        variant_fixed(m->battery_recharge_voltage, 1),
+        variant_fixed(m->battery_redischarge_voltage, 1),
+        variant_long(m->max_ac_charging_current),
+        variant_long(m->max_charging_current),
+        variant_string(p18_battery_type_label(m->battery_type)),
+        variant_string(p18_output_source_priority_label(m->output_source_priority)),
+        variant_string(p18_charge_source_priority_label(m->charger_source_priority)),
+        variant_string(p18_solar_power_priority_label(m->solar_power_priority)),
+        variant_string(p18_machine_type_label(m->machine_type)),
+        variant_string(p18_output_model_setting_label(m->output_model_setting)),
+        variant_flag(m->flag_buzzer),
+        variant_flag(m->flag_overload_bypass),
+        variant_flag(m->flag_lcd_escape_to_default_page_after_1min_timeout),
+        variant_flag(m->flag_overload_restart),
+        variant_flag(m->flag_over_temp_restart),
+        variant_flag(m->flag_backlight_on),
+        variant_flag(m->flag_alarm_on_primary_source_interrupt),
+        variant_flag(m->flag_fault_code_record),
+    };
+    PRINT_AUTO(fields, values)
 }
 
 PRINT_FN(max_charging_current_selectable_values)
 {
     if (print_is_json_format(format))
-        print_json_list(m->amps, m->len);
+        print_json_list(p, m->amps, m->len);
     else if (print_is_table_format(format))
-        print_table_list(m->amps, m->len);
+        print_table_list(p, m->amps, m->len);
+    else
+        print_joined_list(p, m->amps, m->len, format);
 }
 
 PRINT_FN(max_ac_charging_current_selectable_values)
 {
     if (print_is_json_format(format))
-        print_json_list(m->amps, m->len);
+        print_json_list(p, m->amps, m->len);
     else if (print_is_table_format(format))
-        print_table_list(m->amps, m->len);
+        print_table_list(p, m->amps, m->len);
+    else
+        print_joined_list(p, m->amps, m->len, format);
 }
 
 PRINT_FN(parallel_rated_information)
 {
-    print_item_t items[] = {
+    static const print_field_t fields[] = {
         {
             .key = "parallel_id_connection_status",
             .title = "Parallel ID connection status",
-            .value = variant_string(p18_parallel_connection_status_label(m->parallel_id_connection_status)),
         },
         {
             .key = "serial_number",
             .title = "Serial number",
-            .value = variant_string(m->serial_number),
         },
         {
             .key = "charger_source_priority",
             .title = "Charger source priority",
-            .value = variant_string(p18_charge_source_priority_label(m->charger_source_priority))
         },
         {
             .key = "max_charging_current",
             .title = "Max charging current",
-            .value = variant_long(m->max_charging_current),
             .unit = PRINT_UNIT_A
         },
         {
             .key = "max_ac_charging_current",
             .title = "Max AC charging current",
-            .value = variant_long(m->max_ac_charging_current),
             .unit = PRINT_UNIT_A
         },
         {
             .key = "output_model_setting",
             .title = "Output model setting",
-            .value = variant_string(p18_output_model_setting_label(m->output_model_setting))
         },
     };
-    PRINT_AUTO(items)
+    const variant_t values[] = {
+        variant_string(p18_parallel_connection_status_label(m->parallel_id_connection_status)),
+        variant_string(m->serial_number),
+        variant_string(p18_charge_source_priority_label(m->charger_source_priority)),
+        variant_long(m->max_charging_current),
+        variant_long(m->max_ac_charging_current),
+        variant_string(p18_output_model_setting_label(m->output_model_setting)),
+    };
+    PRINT_AUTO(fields, values)
 }
 
 PRINT_FN(parallel_general_status)
 {
-    print_item_t items[] = {
+    static const print_field_t fields[] = {
         {
             .key = "parallel_id_connection_status",
             .title = "Parallel ID connection status",
-            .value = variant_string(p18_parallel_connection_status_label(m->parallel_id_connection_status)),
         },
         {
             .key = "mode",
             .title = "Working mode",
-            .value = variant_string(p18_working_mode_label(m->work_mode))
         },
         {
             .key = "fault_code",
             .title = "Fault code",
-            .value = variant_string(p18_fault_code_label(m->fault_code))
         },
         {
             .key = "grid_voltage",
             .title = "Grid voltage",
-            .value = variant_double(m->grid_voltage/10.0),
             .precision = 1,
             .unit = PRINT_UNIT_V,
         },
         {
             .key = "grid_freq",
             .title = "Grid frequency",
-            .value = variant_double(m->grid_freq/10.0),
             .precision = 1,
             .unit = PRINT_UNIT_HZ,
         },
         {
             .key = "ac_output_voltage",
             .title = "AC output voltage",
-            .value = variant_double(m->ac_output_voltage/10.0),
             .precision = 1,
             .unit = PRINT_UNIT_V,
         },
         {
             .key = "ac_output_freq",
             .title = "AC output frequency",
-            .value = variant_double(m->ac_output_freq/10.0),
             .precision = 1,
             .unit = PRINT_UNIT_HZ,
         },
         {
             .key = "ac_output_apparent_power",
             .title = "AC output apparent power",
-            .value = variant_long(m->ac_output_apparent_power),
             .unit = PRINT_UNIT_VA,
         },
         {
             .key = "ac_output_active_power",
             .title = "AC output active power",
-            .value = variant_long(m->ac_output_active_power),
             .unit = PRINT_UNIT_WH,
         },
         {
             .key = "total_ac_output_apparent_power",
             .title = "Total AC output apparent power",
-            .value = variant_long(m->total_ac_output_apparent_power),
             .unit = PRINT_UNIT_VA,
         },
         {
             .key = "total_ac_output_active_power",
             .title = "Total AC output active power",
-            .value = variant_long(m->total_ac_output_active_power),
             .unit = PRINT_UNIT_WH,
         },
         {
             .key = "output_load_percent",
             .title = "Output load percent",
-            .value = variant_long(m->output_load_percent),
             .unit = PRINT_UNIT_PERCENTAGE,
         },
         {
             .key = "total_output_load_percent",
             .title = "Total output load percent",
-            .value = variant_long(m->total_output_load_percent),
             .unit = PRINT_UNIT_PERCENTAGE,
         },
         {
             .key = "battery_voltage",
             .title = "Battery voltage",
-            .value = variant_double(m->battery_voltage/10.0),
             .precision = 1,
             .unit = PRINT_UNIT_V,
         },
         {
             .key = "battery_discharge_current",
             .title = "Battery discharge current",
-            .value = variant_long(m->battery_discharge_current),
             .unit = PRINT_UNIT_A,
         },
         {
             .key = "battery_charging_current",
             .title = "Battery charging current",
-            .value = variant_long(m->battery_charging_current),
             .unit = PRINT_UNIT_A,
         },
         {
             .key = "pv1_input_power",
             .title = "PV1 Input power",
-            .value = variant_double(m->pv1_input_power),
             .unit = PRINT_UNIT_WH,
         },
         {
             .key = "pv2_input_power",
             .title = "PV2 Input power",
-            .value = variant_double(m->pv2_input_power),
             .unit = PRINT_UNIT_WH,
         },
         {
             .key = "pv1_input_voltage",
             .title = "PV1 Input voltage",
-            .value = variant_double(m->pv1_input_voltage/10.0),
             .precision = 1,
             .unit = PRINT_UNIT_V,
         },
         {
             .key = "pv2_input_voltage",
             .title = "PV2 Input voltage",
-            .value = variant_double(m->pv2_input_voltage/10.0),
             .precision = 1,
             .unit = PRINT_UNIT_V,
         },
         {
             .key = "mppt1_charger_status",
             .title = "MPPT1 charger status",
-            .value = variant_string(p18_mppt_charger_status_label(m->mppt1_charger_status)),
         },
         {
             .key = "mppt2_charger_status",
             .title = "MPPT2 charger status",
-            .value = variant_string(p18_mppt_charger_status_label(m->mppt2_charger_status)),
         },
         {
             .key = "load_connected",
             .title = "Load connection",
-            .value = variant_string(m->load_connected ? "Connected" : "Disconnected"),
         },
         {
             .key = "battery_power_direction",
             .title = "Battery power direction",
-            .value = variant_string(p18_battery_power_direction_label(m->battery_power_direction)),
         },
         {
             .key = "dc_ac_power_direction",
             .title = "DC/AC power direction",
-            .value = variant_string(p18_dc_ac_power_direction_label(m->dc_ac_power_direction)),
         },
         {
             .key = "line_power_direction",
             .title = "Line power direction",
-            .value = variant_string(p18_line_power_direction_label(m->line_power_direction)),
         },
         {
             .key = "max_temp",
             .title = "Max. temperature",
-            .value = variant_long(m->max_temp),
         }
     };
-    PRINT_AUTO(items)
+    const variant_t values[] = {
+        variant_string(p18_parallel_connection_status_label(m->parallel_id_connection_status)),
+        variant_string(p18_working_mode_label(m->work_mode)),
+        variant_string(p18_fault_code_label(m->fault_code)),
+        variant_fixed(m->grid_voltage, 1),
+        variant_fixed(m->grid_freq, 1),
+        variant_fixed(m->ac_output_voltage, 1),
+        variant_fixed(m->ac_output_freq, 1),
+        variant_long(m->ac_output_apparent_power),
+        variant_long(m->ac_output_active_power),
+        variant_long(m->total_ac_output_apparent_power),
+        variant_long(m->total_ac_output_active_power),
+        variant_long(m->output_load_percent),
+        variant_long(m->total_output_load_percent),
+        variant_fixed(m->battery_voltage, 1),
+        variant_long(m->battery_discharge_current),
+        variant_long(m->battery_charging_current),
+        variant_fixed(m->pv1_input_power, 0),
+        variant_fixed(m->pv2_input_power, 0),
+        variant_fixed(m->pv1_input_voltage, 1),
+        variant_fixed(m->pv2_input_voltage, 1),
+        variant_string(p18_mppt_charger_status_label(m->mppt1_charger_status)),
+        variant_string(p18_mppt_charger_status_label(m->mppt2_charger_status)),
+        variant_string(m->load_connected ? "Connected" : "Disconnected"),
+        variant_string(p18_battery_power_direction_label(m->battery_power_direction)),
+        variant_string(p18_dc_ac_power_direction_label(m->dc_ac_power_direction)),
+        variant_string(p18_line_power_direction_label(m->line_power_direction)),
+        variant_long(m->max_temp),
+    };
+    PRINT_AUTO(fields, values)
 }
 
 PRINT_FN(ac_charge_time_bucket)
 {
-    static const int buf_size = 16;
+    enum { buf_size = 16 };
     char start_time[buf_size], end_time[buf_size];
     snprintf(start_time, buf_size, "%02d:%02d", m->start_h, m->start_m);
     snprintf(end_time, buf_size, "%02d:%02d", m->end_h, m->end_m);
-    print_item_t items[] = {
-            {.key= "start_time", .title= "Start time", .value= variant_string(start_time)},
-            {.key= "end_time",   .title= "End time",   .value= variant_string(end_time)},
+    static const print_field_t fields[] = {
+            {.key= "start_time", .title= "Start time"},
+            {.key= "end_time",   .title= "End time"},
+    };
+    const variant_t values[] = {
+        variant_string(start_time),
+        variant_string(end_time),
     };
-    PRINT_AUTO(items)
+    PRINT_AUTO(fields, values)
 }
 
 PRINT_FN(ac_supply_load_time_bucket)
 {
-    static const int buf_size = 16;
+    enum { buf_size = 16 };
     char start_time[buf_size], end_time[buf_size];
     snprintf(start_time, buf_size, "%02d:%02d", m->start_h, m->start_m);
     snprintf(end_time, buf_size, "%02d:%02d", m->end_h, m->end_m);
-    print_item_t items[] = {
-            {.key= "start_time", .title= "Start time", .value= variant_string(start_time)},
-            {.key= "end_time",   .title= "End time",   .value= variant_string(end_time)},
+    static const print_field_t fields[] = {
+            {.key= "start_time", .title= "Start time"},
+            {.key= "end_time",   .title= "End time"},
+    };
+    const variant_t values[] = {
+        variant_string(start_time),
+        variant_string(end_time),
     };
-    PRINT_AUTO(items)
+    PRINT_AUTO(fields, values)
 }
\ No newline at end of file
@@ -19,14 +19,20 @@
 #ifndef ISV_PRINT_H
 #define ISV_PRINT_H
 
+#include <stdio.h>
+
 #include "p18.h"
 #include "variant.h"
 
+#define PRINT_BUF_LENGTH    8192
+#define PRINT_MAX_PRECISION 18
+
 #define MAKE_PRINT_FN_NAME(msg_type)  print_ ## msg_type ## _msg
 #define PRINT_FN_NAME(msg_type)       MAKE_PRINT_FN_NAME(msg_type)
 
+/* p is where to print, NULL means the default printer, see print_t */
 #define PRINT_FN(msg_type) \
-     void PRINT_FN_NAME(msg_type)(const P18_MSG_T(msg_type) *m, print_format_t format)
+     void PRINT_FN_NAME(msg_type)(print_t *p, const P18_MSG_T(msg_type) *m, print_format_t format)
 
 typedef enum {
     PRINT_UNIT_V = 1,
@@ -44,19 +50,112 @@ typedef enum {
     PRINT_FORMAT_PARSABLE_TABLE,
     PRINT_FORMAT_JSON,
     PRINT_FORMAT_JSON_W_UNITS,
+    PRINT_FORMAT_NDJSON, /* JSON, with each daemon sample stamped by print_sample_clock() */
+    PRINT_FORMAT_CSV,
+    PRINT_FORMAT_TSV,
+    PRINT_FORMAT_INFLUX, /* InfluxDB line protocol */
 } print_format_t;
 
+/* Describes an item of a message. These are the same for every response,
+   so they live in static tables, and only values are filled per message. */
 typedef struct {
-    char *key;
-    char *title;
-    variant_t value;
+    const char *key;
+    const char *title;
     short precision;
     print_unit_t unit;
-} print_item_t;
+} print_field_t;
+
+/* state of a multi-section document, see print_begin() */
+typedef struct {
+    bool active;
+    bool opened;          /* the opening brace has been printed */
+    bool empty;
+    bool section_pending; /* section header is yet to be printed */
+    const char *section;
+    print_format_t format;
+    bool has_time;        /* time and id of the sample, for influx */
+    unsigned long long time;
+    int id;
+} print_document_t;
+
+/* Where messages are printed to. The CLI uses the default printer, which
+   renders each message, or each document, into its buffer and writes it to
+   stdout, or to a file set by print_set_output(), at once. One set up by
+   print_init_buffer() writes to a caller's buffer and shares nothing with
+   the rest of the process. */
+typedef struct print_columns print_columns_t;
+
+typedef struct {
+    FILE *file;   /* where the buffer is flushed to, NULL means stdout */
+    char *buf;
+    size_t size;
+    size_t len;   /* length of the output, even if it didn't fit */
+    bool flush;   /* flush buf when it's full instead of truncating */
+    bool delta;   /* print only what changed, see delta.h */
+    unsigned long header_hash; /* of the csv or tsv header, 0 until printed */
+    const char *device; /* tags influx points, see print_set_device() */
+    struct {
+        const char *const *keys;
+        size_t count;
+    } selection;
+    print_document_t document;
+    print_columns_t *columns; /* of a csv or tsv document, if it can have one */
+} print_t;
+
+/* csv and tsv documents are collected here, and written out by print_end() */
+struct print_columns {
+    print_t header;
+    print_t row;
+    char header_buf[PRINT_BUF_LENGTH];
+    char row_buf[PRINT_BUF_LENGTH];
+};
+
+/* The output is always NUL-terminated, if size is not 0. */
+void print_init_buffer(print_t *p, char *buf, size_t size);
 
-void print_json(print_item_t *items, size_t size, bool with_units);
+void print_set_output(FILE *f);
+void print_json(const print_field_t *fields, const variant_t *values, size_t size, bool with_units);
 void print_set_result(bool success, print_format_t format);
 bool print_is_json_format(print_format_t f);
+bool print_is_delimited_format(print_format_t f);
+
+/* whether polled samples are stamped with print_sample_clock() */
+bool print_stamps_samples(print_format_t f);
+
+/* Prints only items with these keys, if a message has any of them. The array
+   must stay valid until the next call; count 0 selects everything. */
+void print_select_fields(const char *const *keys, size_t count);
+
+/* Names the device that influx points are tagged with, unless a section
+   name gives another one. The string must stay valid while printing. */
+void print_set_device(const char *name);
+
+/* A document groups outputs of several queries: in JSON formats it's a single
+   object with one key per section, in table formats sections are separated
+   by [name] headers. In csv and tsv it's a single row with SECTION.KEY
+   columns, in influx a point per section, SECTION being the measurement. */
+void print_begin(print_format_t format);
+void print_section(const char *name, print_format_t format);
+void print_end(print_format_t format);
+
+void print_error(print_format_t format, const char *fmt, ...);
+
+/* Time of a recorded sample, in milliseconds, and its parallel id (if not
+   negative), see record.h. */
+void print_sample(unsigned long long time, int id, print_format_t format);
+
+/* Wall-clock and monotonic time a polled sample was taken at, in
+   milliseconds. Only the former can be compared across hosts, only the
+   latter can be subtracted reliably. */
+void print_sample_clock(unsigned long long time, unsigned long long monotonic, print_format_t format);
+
+/* A device found by --list-devices; sn is NULL if it didn't answer. */
+void print_device(const char *path,
+                  const char *serial,
+                  const char *manufacturer,
+                  const char *product,
+                  const char *sn,
+                  print_format_t format);
 
 PRINT_FN(protocol_id);
 PRINT_FN(current_time);
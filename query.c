@@ -0,0 +1,533 @@
+/**
+ * Copyright (C) 2020  Evgeny Zinoviev
+ * This file is part of isv <https://github.com/gch1p/isv>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "query.h"
+#include "cache.h"
+#include "engine.h"
+#include "p18.h"
+#include "util.h"
+
+#define MK_QUERY_PRINT_FN_NAME(msg_type)  query_print_ ## msg_type
+#define QUERY_PRINT_FN_NAME(msg_type)     MK_QUERY_PRINT_FN_NAME(msg_type)
+
+#define QUERY_PRINT_FN(msg_type) \
+    static void QUERY_PRINT_FN_NAME(msg_type)(const char *data, const char *const *keys, size_t count, \
+                                              print_format_t format) \
+    { \
+        P18_MSG_T(msg_type) m = P18_UNPACK_SELECTED_FN_NAME(msg_type)(data, keys, count); \
+        PRINT_FN_NAME(msg_type)(NULL, &m, format); \
+    }
+
+#define QUERY_HANDLER(command_key, msg_type, option_name, args) \
+    [(command_key) - P18_QUERY_CMDS_ENUM_OFFSET] = { \
+        #msg_type, (option_name), (args), QUERY_PRINT_FN_NAME(msg_type) \
+    }
+
+typedef void (*query_print_fn_t)(const char *, const char *const *, size_t, print_format_t);
+
+typedef struct {
+    const char *name;        /* message type, used as a section name */
+    const char *option_name; /* as in --get-... command line option */
+    size_t args_count;
+    query_print_fn_t print;
+} query_handler_t;
+
+QUERY_PRINT_FN(protocol_id)
+QUERY_PRINT_FN(current_time)
+QUERY_PRINT_FN(total_generated)
+QUERY_PRINT_FN(year_generated)
+QUERY_PRINT_FN(month_generated)
+QUERY_PRINT_FN(day_generated)
+QUERY_PRINT_FN(series_number)
+QUERY_PRINT_FN(cpu_version)
+QUERY_PRINT_FN(rated_information)
+QUERY_PRINT_FN(general_status)
+QUERY_PRINT_FN(working_mode)
+QUERY_PRINT_FN(faults_warnings)
+QUERY_PRINT_FN(flags_statuses)
+QUERY_PRINT_FN(defaults)
+QUERY_PRINT_FN(max_charging_current_selectable_values)
+QUERY_PRINT_FN(max_ac_charging_current_selectable_values)
+QUERY_PRINT_FN(parallel_rated_information)
+QUERY_PRINT_FN(parallel_general_status)
+QUERY_PRINT_FN(ac_charge_time_bucket)
+QUERY_PRINT_FN(ac_supply_load_time_bucket)
+
+static const query_handler_t query_handlers[] = {
+    QUERY_HANDLER(P18_QUERY_PROTOCOL_ID,                               protocol_id,                               "protocol-id",                               0),
+    QUERY_HANDLER(P18_QUERY_CURRENT_TIME,                              current_time,                              "date-time",                                 0),
+    QUERY_HANDLER(P18_QUERY_TOTAL_GENERATED,                           total_generated,                           "total-generated",                           0),
+    QUERY_HANDLER(P18_QUERY_YEAR_GENERATED,                            year_generated,                            "year-generated",                            1),
+    QUERY_HANDLER(P18_QUERY_MONTH_GENERATED,                           month_generated,                           "month-generated",                           2),
+    QUERY_HANDLER(P18_QUERY_DAY_GENERATED,                             day_generated,                             "day-generated",                             3),
+    QUERY_HANDLER(P18_QUERY_SERIES_NUMBER,                             series_number,                             "series-number",                             0),
+    QUERY_HANDLER(P18_QUERY_CPU_VERSION,                               cpu_version,                               "cpu-version",                               0),
+    QUERY_HANDLER(P18_QUERY_RATED_INFORMATION,                         rated_information,                         "rated-information",                         0),
+    QUERY_HANDLER(P18_QUERY_GENERAL_STATUS,                            general_status,                            "general-status",                            0),
+    QUERY_HANDLER(P18_QUERY_WORKING_MODE,                              working_mode,                              "working-mode",                              0),
+    QUERY_HANDLER(P18_QUERY_FAULTS_WARNINGS,                           faults_warnings,                           "faults-warnings",                           0),
+    QUERY_HANDLER(P18_QUERY_FLAGS_STATUSES,                            flags_statuses,                            "flags",                                     0),
+    QUERY_HANDLER(P18_QUERY_DEFAULTS,                                  defaults,                                  "defaults",                                  0),
+    QUERY_HANDLER(P18_QUERY_MAX_CHARGING_CURRENT_SELECTABLE_VALUES,    max_charging_current_selectable_values,    "max-charging-current-selectable-values",    0),
+    QUERY_HANDLER(P18_QUERY_MAX_AC_CHARGING_CURRENT_SELECTABLE_VALUES, max_ac_charging_current_selectable_values, "max-ac-charging-current-selectable-values", 0),
+    QUERY_HANDLER(P18_QUERY_PARALLEL_RATED_INFORMATION,                parallel_rated_information,                "parallel-rated-information",                1),
+    QUERY_HANDLER(P18_QUERY_PARALLEL_GENERAL_STATUS,                   parallel_general_status,                   "parallel-general-status",                   1),
+    QUERY_HANDLER(P18_QUERY_AC_CHARGE_TIME_BUCKET,                     ac_charge_time_bucket,                     "ac-charge-time-bucket",                     0),
+    QUERY_HANDLER(P18_QUERY_AC_SUPPLY_LOAD_TIME_BUCKET,                ac_supply_load_time_bucket,                "ac-supply-load-time-bucket",                0),
+};
+
+static const query_handler_t *query_handler(int command_key)
+{
+    int index = command_key - P18_QUERY_CMDS_ENUM_OFFSET;
+    if (index < 0 || index >= (int)ARRAY_SIZE(query_handlers))
+        return NULL;
+    return &query_handlers[index];
+}
+
+const char *query_name(int command_key)
+{
+    const query_handler_t *handler = query_handler(command_key);
+    return handler != NULL ? handler->name : NULL;
+}
+
+/* Formats a section name for the request: the message type followed by
+   the arguments, e.g. "parallel_general_status_1". */
+void query_section_name(const query_request_t *request, char *buf, size_t bufsize)
+{
+    const char *name = query_name(request->command_key);
+    size_t len = (size_t)snprintf(buf, bufsize, "%s", name != NULL ? name : "unknown");
+    for (size_t i = 0; i < QUERY_MAX_ARGS && request->args[i] != NULL && len < bufsize; i++)
+        len += (size_t)snprintf(buf + len, bufsize - len, "_%s", request->args[i]);
+}
+
+/* Finds a get query by its command line option name without the "get-"
+   prefix, e.g. "general-status". Returns 0 if there's no such query. */
+int query_find(const char *option_name, size_t *args_count)
+{
+    for (size_t i = 0; i < ARRAY_SIZE(query_handlers); i++) {
+        if (!strcmp(query_handlers[i].option_name, option_name)) {
+            if (args_count != NULL)
+                *args_count = query_handlers[i].args_count;
+            return (int)i + P18_QUERY_CMDS_ENUM_OFFSET;
+        }
+    }
+    return 0;
+}
+
+/* Parses a query line like "parallel-general-status 1", in the same form as
+   --get-* options without the "get-" prefix. The arguments are stored in buf,
+   which must be at least QUERY_LINE_LENGTH bytes long. Returns an error
+   message, or NULL on success. */
+const char *query_parse(const char *line, query_request_t *request, char *buf)
+{
+    char *saveptr = NULL;
+    size_t args_count, i = 0;
+
+    if (strlen(line) >= QUERY_LINE_LENGTH)
+        return "query is too long";
+
+    strcpy(buf, line);
+    memset(request, 0, sizeof(*request));
+
+    const char *name = strtok_r(buf, " \t", &saveptr);
+    if (name == NULL)
+        return "empty query";
+
+    request->command_key = query_find(name, &args_count);
+    if (!request->command_key)
+        return "unknown query";
+
+    const char *arg;
+    while ((arg = strtok_r(NULL, " \t", &saveptr)) != NULL) {
+        if (i >= args_count)
+            return "too many arguments";
+        if (!isnumeric(arg) || strlen(arg) > 4)
+            return "invalid argument";
+        request->args[i++] = arg;
+    }
+    if (i < args_count)
+        return "not enough arguments";
+
+    return NULL;
+}
+
+/*
+ * Parses a comma-separated list of keys to decode and print, as they appear
+ * in the output, e.g. "battery_voltage,pv1_input_power". NULL or an empty
+ * list selects everything. Returns QUERY_ERR_INPUT if the list is too long
+ * or has no keys.
+ */
+int query_parse_fields(const char *list, query_fields_t *fields)
+{
+    fields->count = 0;
+    if (list == NULL || *list == '\0')
+        return QUERY_OK;
+
+    if (strlen(list) >= sizeof(fields->buf))
+        return QUERY_ERR_INPUT;
+    strcpy(fields->buf, list);
+
+    char *saveptr = NULL;
+    for (char *key = strtok_r(fields->buf, ",", &saveptr); key != NULL; key = strtok_r(NULL, ",", &saveptr)) {
+        if (fields->count == ARRAY_SIZE(fields->keys)) {
+            fields->count = 0;
+            return QUERY_ERR_INPUT;
+        }
+        fields->keys[fields->count++] = key;
+    }
+
+    return fields->count ? QUERY_OK : QUERY_ERR_INPUT;
+}
+
+/* Timeouts and garbled responses happen on a healthy link now and then,
+   anything else most likely means the device is gone. */
+bool query_is_device_error(int err)
+{
+    return err != ETIMEDOUT && err != EBADMSG && err != ENOBUFS;
+}
+
+/* Builds the frame for the command and copies the command itself to command,
+   a COMMAND_BUF_LENGTH bytes long buffer. Returns NULL if the command or the
+   arguments are invalid. The first step of query_exchange(). */
+const p18_frame_t *query_prepare(int command_key,
+                                 const char **args,
+                                 size_t args_size,
+                                 p18_frame_t *frame_buf,
+                                 char *command,
+                                 char *error,
+                                 size_t error_size)
+{
+    const p18_frame_t *frame = p18_build_frame(command_key, args, args_size, frame_buf);
+    if (frame == NULL) {
+        snprintf(error, error_size, "invalid query command %d", command_key);
+        return NULL;
+    }
+
+    /* the command itself is used as a cache key and in error messages */
+    size_t command_len = MIN(frame->command_size, COMMAND_BUF_LENGTH - 1);
+    memcpy(command, frame->data, command_len);
+    command[command_len] = '\0';
+
+    return frame;
+}
+
+/* Validates the response to a get query and caches it, or drops the cached
+   responses a set command affects. The last step of query_exchange(). */
+int query_complete(voltronic_dev_t dev,
+                   int command_key,
+                   const char *command,
+                   const char *buf,
+                   size_t received,
+                   bool cached,
+                   char *error,
+                   size_t error_size)
+{
+    if (command_key < P18_SET_CMDS_ENUM_OFFSET) {
+        size_t data_size;
+        if (!p18_validate_query_response(buf, received, &data_size)) {
+            snprintf(error, error_size, "invalid response");
+            errno = EBADMSG;
+            return QUERY_ERR_COMM;
+        }
+
+        if (!cached)
+            cache_put(dev, command_key, command, buf, received);
+    } else {
+        /* even a failed set might have changed something */
+        cache_invalidate(dev, command_key);
+    }
+
+    return QUERY_OK;
+}
+
+/* Sends the frame built by query_prepare() and waits for the response to it,
+   which is neither validated nor cached. Returns QUERY_OK, or QUERY_ERR_COMM
+   with the error message in error and errno set. */
+int query_transfer(voltronic_dev_t dev,
+                   int command_key,
+                   const p18_frame_t *frame,
+                   const char *command,
+                   int timeout,
+                   char *buf,
+                   size_t bufsize,
+                   size_t *received,
+                   char *error,
+                   size_t error_size)
+{
+    unsigned long long deadline = monotonic_ms() + timeout;
+    int result = voltronic_dev_execute(dev, WRITE_FRAMED_VOLTRONIC_INPUT,
+                                       frame->data, frame->size,
+                                       buf, bufsize, received,
+                                       timeout);
+
+    /* skip whatever doesn't look like a response to this command, like
+       a late response to an earlier one or a part of it */
+    while (result > 0
+           ? !p18_response_matches(command_key, buf, *received)
+           : errno == EBADMSG) {
+        unsigned long long now = monotonic_ms();
+        if (now >= deadline)
+            break;
+        LOG("%s: skipping a frame that isn't a response to %s\n", __func__, command);
+        result = voltronic_dev_receive(dev, 0, buf, bufsize, received,
+                                       (unsigned int)(deadline - now));
+    }
+
+    /* the deadline passed with only a response to something else */
+    if (result > 0 && !p18_response_matches(command_key, buf, *received)) {
+        result = -1;
+        errno = ETIMEDOUT;
+    }
+
+    if (result <= 0) {
+        int saved_errno = errno;
+        snprintf(error, error_size, "failed to execute %s: %s", command, strerror(errno));
+        errno = saved_errno;
+        return QUERY_ERR_COMM;
+    }
+
+    return QUERY_OK;
+}
+
+/* Builds the command and executes it; responses to get queries are taken from
+   the cache while they're fresh, and validated. On success, the response is
+   in buf and its size is in *received (0 in pretend mode). On failure, writes
+   the error message to error and returns QUERY_ERR_* code; errno is preserved
+   for the caller to tell timeouts from device errors. Doesn't print anything,
+   so can be called from several threads for different devices. */
+int query_exchange(voltronic_dev_t dev,
+                   int command_key,
+                   int timeout,
+                   const char **args,
+                   size_t args_size,
+                   bool pretend,
+                   char *buf,
+                   size_t bufsize,
+                   size_t *received,
+                   char *error,
+                   size_t error_size)
+{
+    p18_frame_t frame_buf;
+    char command[COMMAND_BUF_LENGTH];
+    const p18_frame_t *frame = query_prepare(command_key, args, args_size, &frame_buf,
+                                             command, error, error_size);
+    if (frame == NULL)
+        return QUERY_ERR_INPUT;
+
+    if (pretend) {
+        LOG("would write %zu %s:\n",
+            frame->size, (frame->size > 1 ? "bytes" : "byte"));
+        HEXDUMP(frame->data, frame->size);
+        *received = 0;
+        return QUERY_OK;
+    }
+
+    bool cached = command_key < P18_SET_CMDS_ENUM_OFFSET
+        && cache_get(dev, command_key, command, buf, bufsize, received);
+
+    if (!cached) {
+        int result = query_transfer(dev, command_key, frame, command, timeout,
+                                    buf, bufsize, received, error, error_size);
+        if (result != QUERY_OK)
+            return result;
+    }
+
+    return query_complete(dev, command_key, command, buf, *received, cached,
+                          error, error_size);
+}
+
+/* Same as query_exchange(), but prints the error. */
+int query_fetch(voltronic_dev_t dev,
+                int command_key,
+                int timeout,
+                const char **args,
+                size_t args_size,
+                bool pretend,
+                print_format_t format,
+                char *buf,
+                size_t bufsize,
+                size_t *received)
+{
+    char error[QUERY_ERROR_LENGTH];
+    int result = query_exchange(dev, command_key, timeout, args, args_size, pretend,
+                                buf, bufsize, received, error, sizeof(error));
+    if (result != QUERY_OK) {
+        int saved_errno = errno;
+        print_error(format, "%s", error);
+        errno = saved_errno;
+    }
+    return result;
+}
+
+/* Prints a successful response. Returns QUERY_ERR_COMM if it's a set
+   command that the inverter refused. */
+int query_print(int command_key,
+                const char *buf,
+                size_t received,
+                const query_fields_t *fields,
+                print_format_t format)
+{
+    if (command_key < P18_SET_CMDS_ENUM_OFFSET) {
+        const query_handler_t *handler = query_handler(command_key);
+        if (handler != NULL) {
+            const char *const *keys = fields != NULL ? fields->keys : NULL;
+            size_t count = fields != NULL ? fields->count : 0;
+            print_select_fields(keys, count);
+            handler->print(buf+5, keys, count, format);
+            print_select_fields(NULL, 0);
+        }
+    } else {
+        bool success = p18_set_result(buf, received);
+        print_set_result(success, format);
+        if (!success)
+            return QUERY_ERR_COMM;
+    }
+
+    return QUERY_OK;
+}
+
+/* Executes the command and prints the result. Returns QUERY_* code, see
+   query_fetch(). */
+int query(voltronic_dev_t dev,
+          int command_key,
+          int timeout,
+          const char **args,
+          size_t args_size,
+          bool pretend,
+          const query_fields_t *fields,
+          print_format_t format)
+{
+    char buffer[RESPONSE_BUF_LENGTH];
+    size_t received;
+
+    int result = query_fetch(dev, command_key, timeout, args, args_size,
+                             pretend, format, buffer, sizeof(buffer), &received);
+    if (result != QUERY_OK || pretend)
+        return result;
+
+    return query_print(command_key, buffer, received, fields, format);
+}
+
+static void query_batch_section(const device_t *devices,
+                                size_t devices_count,
+                                size_t d,
+                                const query_request_t *request,
+                                char *buf,
+                                size_t bufsize)
+{
+    if (devices_count > 1)
+        snprintf(buf, bufsize, "%s.%s", devices[d].name, query_name(request->command_key));
+    else
+        snprintf(buf, bufsize, "%s", query_name(request->command_key));
+}
+
+/* Runs the requests on all devices at once with the engine, then prints
+   the results in the same order as query_batch() would. */
+static int query_batch_engine(const device_t *devices,
+                              size_t devices_count,
+                              const query_request_t *requests,
+                              size_t count,
+                              int timeout,
+                              print_format_t format)
+{
+    char section[QUERY_LINE_LENGTH];
+    size_t jobs_count = devices_count * count;
+    engine_job_t *jobs = calloc(jobs_count, sizeof(engine_job_t));
+    if (jobs == NULL) {
+        ERROR("%s: out of memory\n", __func__);
+        return QUERY_ERR_COMM;
+    }
+
+    for (size_t d = 0; d < devices_count; d++) {
+        for (size_t i = 0; i < count; i++) {
+            engine_job_t *job = &jobs[d * count + i];
+            job->dev = devices[d].dev;
+            job->command_key = requests[i].command_key;
+            job->args = (const char **)requests[i].args;
+            job->args_size = QUERY_MAX_ARGS;
+        }
+    }
+
+    int worst = engine_run(jobs, jobs_count, timeout);
+
+    print_begin(format);
+    for (size_t d = 0; d < devices_count; d++) {
+        for (size_t i = 0; i < count; i++) {
+            engine_job_t *job = &jobs[d * count + i];
+            query_batch_section(devices, devices_count, d, &requests[i], section, sizeof(section));
+            print_section(section, format);
+            if (job->result != QUERY_OK)
+                print_error(format, "%s", job->error);
+            else if (query_print(job->command_key, job->buf, job->received, requests[i].fields, format) != QUERY_OK)
+                worst = MAX(worst, QUERY_ERR_COMM);
+        }
+    }
+    print_end(format);
+
+    free(jobs);
+    return worst;
+}
+
+/* Runs every request on every device. A single request is printed as is,
+   several are grouped in one document, and with several devices sections
+   are prefixed with device names. Several devices are queried at the same
+   time, one after another otherwise. Returns the worst of the results. */
+int query_batch(const device_t *devices,
+                size_t devices_count,
+                const query_request_t *requests,
+                size_t count,
+                int timeout,
+                bool pretend,
+                print_format_t format)
+{
+    char section[QUERY_LINE_LENGTH];
+
+    /* influx takes the measurement name from the section, if there's one */
+    if (devices_count == 1 && count == 1
+        && (format != PRINT_FORMAT_INFLUX || query_name(requests[0].command_key) == NULL))
+        return query(devices[0].dev, requests[0].command_key, timeout,
+                     (const char **)requests[0].args, QUERY_MAX_ARGS,
+                     pretend, requests[0].fields, format);
+
+    if (devices_count > 1 && !pretend)
+        return query_batch_engine(devices, devices_count, requests, count, timeout, format);
+
+    int worst = QUERY_OK;
+    print_begin(format);
+    for (size_t d = 0; d < devices_count; d++) {
+        for (size_t i = 0; i < count; i++) {
+            query_batch_section(devices, devices_count, d, &requests[i], section, sizeof(section));
+            print_section(section, format);
+            int result = query(devices[d].dev, requests[i].command_key, timeout,
+                               (const char **)requests[i].args, QUERY_MAX_ARGS,
+                               pretend, requests[i].fields, format);
+            if (result > worst)
+                worst = result;
+        }
+    }
+    print_end(format);
+
+    return worst;
+}
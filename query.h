@@ -0,0 +1,130 @@
+/**
+ * Copyright (C) 2020  Evgeny Zinoviev
+ * This file is part of isv <https://github.com/gch1p/isv>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ISV_QUERY_H
+#define ISV_QUERY_H
+
+#include <stdbool.h>
+
+#include "print.h"
+#include "device.h"
+#include "p18.h"
+#include "libvoltronic/voltronic_dev.h"
+
+#define COMMAND_BUF_LENGTH  128
+#define RESPONSE_BUF_LENGTH 128
+
+#define QUERY_MAX_ARGS      6
+#define QUERY_MAX_BATCH     32
+#define QUERY_LINE_LENGTH   128
+#define QUERY_ERROR_LENGTH  256
+#define QUERY_MAX_FIELDS    32
+#define QUERY_FIELDS_LENGTH 1024
+
+/* return codes, same as the isv exit codes */
+#define QUERY_OK          0
+#define QUERY_ERR_INPUT   1
+#define QUERY_ERR_COMM    2
+
+/* keys of the fields to decode and print, see query_parse_fields() */
+typedef struct {
+    char buf[QUERY_FIELDS_LENGTH]; /* keys point here */
+    const char *keys[QUERY_MAX_FIELDS];
+    size_t count;
+} query_fields_t;
+
+typedef struct {
+    int command_key;
+    const char *args[QUERY_MAX_ARGS];
+    const query_fields_t *fields; /* NULL selects everything */
+} query_request_t;
+
+const char *query_name(int command_key);
+void query_section_name(const query_request_t *request, char *buf, size_t bufsize);
+int query_find(const char *option_name, size_t *args_count);
+const char *query_parse(const char *line, query_request_t *request, char *buf);
+bool query_is_device_error(int err);
+int query_parse_fields(const char *list, query_fields_t *fields);
+const p18_frame_t *query_prepare(int command_key,
+                                 const char **args,
+                                 size_t args_size,
+                                 p18_frame_t *frame_buf,
+                                 char *command,
+                                 char *error,
+                                 size_t error_size);
+int query_complete(voltronic_dev_t dev,
+                   int command_key,
+                   const char *command,
+                   const char *buf,
+                   size_t received,
+                   bool cached,
+                   char *error,
+                   size_t error_size);
+int query_transfer(voltronic_dev_t dev,
+                   int command_key,
+                   const p18_frame_t *frame,
+                   const char *command,
+                   int timeout,
+                   char *buf,
+                   size_t bufsize,
+                   size_t *received,
+                   char *error,
+                   size_t error_size);
+int query_exchange(voltronic_dev_t dev,
+                   int command_key,
+                   int timeout,
+                   const char **args,
+                   size_t args_size,
+                   bool pretend,
+                   char *buf,
+                   size_t bufsize,
+                   size_t *received,
+                   char *error,
+                   size_t error_size);
+int query_fetch(voltronic_dev_t dev,
+                int command_key,
+                int timeout,
+                const char **args,
+                size_t args_size,
+                bool pretend,
+                print_format_t format,
+                char *buf,
+                size_t bufsize,
+                size_t *received);
+int query_print(int command_key,
+                const char *buf,
+                size_t received,
+                const query_fields_t *fields,
+                print_format_t format);
+int query(voltronic_dev_t dev,
+          int command_key,
+          int timeout,
+          const char **args,
+          size_t args_size,
+          bool pretend,
+          const query_fields_t *fields,
+          print_format_t format);
+int query_batch(const device_t *devices,
+                size_t devices_count,
+                const query_request_t *requests,
+                size_t count,
+                int timeout,
+                bool pretend,
+                print_format_t format);
+
+#endif //ISV_QUERY_H
@@ -0,0 +1,562 @@
+/**
+ * Copyright (C) 2020  Evgeny Zinoviev
+ * This file is part of isv <https://github.com/gch1p/isv>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "record.h"
+#include "p18.h"
+#include "util.h"
+
+#define RECORD_MAGIC             "ISVREC\0\0"
+#define RECORD_MAGIC_SIZE        8
+#define RECORD_FILE_HEADER_SIZE  24
+#define RECORD_TYPE_NAME_SIZE    32
+#define RECORD_TYPE_HEADER_SIZE  (RECORD_TYPE_NAME_SIZE + 4)
+#define RECORD_FIELD_NAME_SIZE   40
+#define RECORD_FIELD_HEADER_SIZE (RECORD_FIELD_NAME_SIZE + 8)
+#define RECORD_HEADER_SIZE       16 /* of each record */
+#define RECORD_VALUE_SIZE        4
+#define RECORD_MAX_HEADER        4096
+#define RECORD_MAX_TYPES         8
+#define RECORD_MAX_FIELDS        64
+
+#define RECORD_FIELD(msg_type, field) \
+    {#field, offsetof(P18_MSG_T(msg_type), field), sizeof(((P18_MSG_T(msg_type) *)0)->field)}
+
+#define RECORD_TYPE(command_key, msg_type, fields) \
+    { \
+        #msg_type, (command_key), (fields), ARRAY_SIZE(fields), \
+        record_unpack_ ## msg_type, record_print_ ## msg_type \
+    }
+
+#define RECORD_FNS(msg_type) \
+    static void record_unpack_ ## msg_type(const char *data, void *m) \
+    { \
+        *(P18_MSG_T(msg_type) *)m = P18_UNPACK_FN_NAME(msg_type)(data); \
+    } \
+    static void record_print_ ## msg_type(const void *m, print_format_t format) \
+    { \
+        PRINT_FN_NAME(msg_type)(NULL, m, format); \
+    }
+
+typedef struct {
+    const char *name;
+    size_t offset; /* in the message struct */
+    size_t size;
+} record_field_t;
+
+typedef struct {
+    const char *name;
+    int command_key;
+    const record_field_t *fields;
+    size_t fields_count;
+    void (*unpack)(const char *data, void *m);
+    void (*print)(const void *m, print_format_t format);
+} record_type_t;
+
+struct record {
+    int fd;
+    size_t record_size;
+};
+
+/* enough for any of the recorded messages */
+typedef union {
+    p18_general_status_msg_t general_status;
+    p18_parallel_general_status_msg_t parallel_general_status;
+} record_msg_t;
+
+static const record_field_t general_status_fields[] = {
+    RECORD_FIELD(general_status, grid_voltage),
+    RECORD_FIELD(general_status, grid_freq),
+    RECORD_FIELD(general_status, ac_output_voltage),
+    RECORD_FIELD(general_status, ac_output_freq),
+    RECORD_FIELD(general_status, ac_output_apparent_power),
+    RECORD_FIELD(general_status, ac_output_active_power),
+    RECORD_FIELD(general_status, output_load_percent),
+    RECORD_FIELD(general_status, battery_voltage),
+    RECORD_FIELD(general_status, battery_voltage_scc),
+    RECORD_FIELD(general_status, battery_voltage_scc2),
+    RECORD_FIELD(general_status, battery_discharge_current),
+    RECORD_FIELD(general_status, battery_charging_current),
+    RECORD_FIELD(general_status, battery_capacity),
+    RECORD_FIELD(general_status, inverter_heat_sink_temp),
+    RECORD_FIELD(general_status, mppt1_charger_temp),
+    RECORD_FIELD(general_status, mppt2_charger_temp),
+    RECORD_FIELD(general_status, pv1_input_power),
+    RECORD_FIELD(general_status, pv2_input_power),
+    RECORD_FIELD(general_status, pv1_input_voltage),
+    RECORD_FIELD(general_status, pv2_input_voltage),
+    RECORD_FIELD(general_status, settings_values_changed),
+    RECORD_FIELD(general_status, mppt1_charger_status),
+    RECORD_FIELD(general_status, mppt2_charger_status),
+    RECORD_FIELD(general_status, load_connected),
+    RECORD_FIELD(general_status, battery_power_direction),
+    RECORD_FIELD(general_status, dc_ac_power_direction),
+    RECORD_FIELD(general_status, line_power_direction),
+    RECORD_FIELD(general_status, local_parallel_id),
+};
+
+static const record_field_t parallel_general_status_fields[] = {
+    RECORD_FIELD(parallel_general_status, parallel_id_connection_status),
+    RECORD_FIELD(parallel_general_status, work_mode),
+    RECORD_FIELD(parallel_general_status, fault_code),
+    RECORD_FIELD(parallel_general_status, grid_voltage),
+    RECORD_FIELD(parallel_general_status, grid_freq),
+    RECORD_FIELD(parallel_general_status, ac_output_voltage),
+    RECORD_FIELD(parallel_general_status, ac_output_freq),
+    RECORD_FIELD(parallel_general_status, ac_output_apparent_power),
+    RECORD_FIELD(parallel_general_status, ac_output_active_power),
+    RECORD_FIELD(parallel_general_status, total_ac_output_apparent_power),
+    RECORD_FIELD(parallel_general_status, total_ac_output_active_power),
+    RECORD_FIELD(parallel_general_status, output_load_percent),
+    RECORD_FIELD(parallel_general_status, total_output_load_percent),
+    RECORD_FIELD(parallel_general_status, battery_voltage),
+    RECORD_FIELD(parallel_general_status, battery_discharge_current),
+    RECORD_FIELD(parallel_general_status, battery_charging_current),
+    RECORD_FIELD(parallel_general_status, total_battery_charging_current),
+    RECORD_FIELD(parallel_general_status, battery_capacity),
+    RECORD_FIELD(parallel_general_status, pv1_input_power),
+    RECORD_FIELD(parallel_general_status, pv2_input_power),
+    RECORD_FIELD(parallel_general_status, pv1_input_voltage),
+    RECORD_FIELD(parallel_general_status, pv2_input_voltage),
+    RECORD_FIELD(parallel_general_status, mppt1_charger_status),
+    RECORD_FIELD(parallel_general_status, mppt2_charger_status),
+    RECORD_FIELD(parallel_general_status, load_connected),
+    RECORD_FIELD(parallel_general_status, battery_power_direction),
+    RECORD_FIELD(parallel_general_status, dc_ac_power_direction),
+    RECORD_FIELD(parallel_general_status, line_power_direction),
+    RECORD_FIELD(parallel_general_status, max_temp),
+};
+
+RECORD_FNS(general_status)
+RECORD_FNS(parallel_general_status)
+
+static const record_type_t record_types[] = {
+    RECORD_TYPE(P18_QUERY_GENERAL_STATUS,          general_status,          general_status_fields),
+    RECORD_TYPE(P18_QUERY_PARALLEL_GENERAL_STATUS, parallel_general_status, parallel_general_status_fields),
+};
+
+
+/* ------------------------------------------ */
+/* Little-endian helpers */
+
+static void put_u16(unsigned char *p, uint16_t v)
+{
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+}
+
+static void put_u32(unsigned char *p, uint32_t v)
+{
+    for (int i = 0; i < 4; i++)
+        p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static void put_u64(unsigned char *p, uint64_t v)
+{
+    for (int i = 0; i < 8; i++)
+        p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static uint16_t get_u16(const unsigned char *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get_u32(const unsigned char *p)
+{
+    uint32_t v = 0;
+    for (int i = 3; i >= 0; i--)
+        v = (v << 8) | p[i];
+    return v;
+}
+
+static uint64_t get_u64(const unsigned char *p)
+{
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--)
+        v = (v << 8) | p[i];
+    return v;
+}
+
+
+/* ------------------------------------------ */
+/* Fields */
+
+static uint32_t record_field_get(const void *m, const record_field_t *field)
+{
+    const char *p = (const char *)m + field->offset;
+    switch (field->size) {
+        case 1: { uint8_t v;  memcpy(&v, p, 1); return v; }
+        case 2: { uint16_t v; memcpy(&v, p, 2); return v; }
+        case 4: { uint32_t v; memcpy(&v, p, 4); return v; }
+        default: return 0;
+    }
+}
+
+static void record_field_set(void *m, const record_field_t *field, uint32_t value)
+{
+    char *p = (char *)m + field->offset;
+    switch (field->size) {
+        case 1: { uint8_t v = (uint8_t)value;   memcpy(p, &v, 1); break; }
+        case 2: { uint16_t v = (uint16_t)value; memcpy(p, &v, 2); break; }
+        case 4: { uint32_t v = value;           memcpy(p, &v, 4); break; }
+        default: break;
+    }
+}
+
+static size_t record_size(void)
+{
+    size_t max_fields = 0;
+    for (size_t i = 0; i < ARRAY_SIZE(record_types); i++)
+        max_fields = MAX(max_fields, record_types[i].fields_count);
+
+    size_t size = RECORD_HEADER_SIZE + max_fields * RECORD_VALUE_SIZE;
+    return (size + 7) & ~(size_t)7;
+}
+
+/* Builds the file header describing the current layout. Returns its size. */
+static size_t record_build_header(unsigned char *buf)
+{
+    size_t len = RECORD_FILE_HEADER_SIZE;
+    memset(buf, 0, RECORD_MAX_HEADER);
+
+    for (size_t i = 0; i < ARRAY_SIZE(record_types); i++) {
+        const record_type_t *type = &record_types[i];
+        strncpy((char *)buf + len, type->name, RECORD_TYPE_NAME_SIZE - 1);
+        put_u32(buf + len + RECORD_TYPE_NAME_SIZE, (uint32_t)type->fields_count);
+        len += RECORD_TYPE_HEADER_SIZE;
+
+        for (size_t j = 0; j < type->fields_count; j++) {
+            strncpy((char *)buf + len, type->fields[j].name, RECORD_FIELD_NAME_SIZE - 1);
+            put_u32(buf + len + RECORD_FIELD_NAME_SIZE,
+                    (uint32_t)(RECORD_HEADER_SIZE + j * RECORD_VALUE_SIZE));
+            put_u32(buf + len + RECORD_FIELD_NAME_SIZE + 4, RECORD_VALUE_SIZE);
+            len += RECORD_FIELD_HEADER_SIZE;
+        }
+    }
+
+    memcpy(buf, RECORD_MAGIC, RECORD_MAGIC_SIZE);
+    put_u32(buf + 8, RECORD_VERSION);
+    put_u32(buf + 12, (uint32_t)len);
+    put_u32(buf + 16, (uint32_t)record_size());
+    put_u32(buf + 20, (uint32_t)ARRAY_SIZE(record_types));
+
+    return len;
+}
+
+static const record_type_t *record_type(int command_key, size_t *index)
+{
+    for (size_t i = 0; i < ARRAY_SIZE(record_types); i++) {
+        if (record_types[i].command_key == command_key) {
+            if (index != NULL)
+                *index = i;
+            return &record_types[i];
+        }
+    }
+    return NULL;
+}
+
+bool record_supports(int command_key)
+{
+    return record_type(command_key, NULL) != NULL;
+}
+
+
+/* ------------------------------------------ */
+/* Writing */
+
+/* Opens the log for appending, creating it if needed. An existing log must
+   have been written with the same layout. */
+record_t *record_open(const char *path)
+{
+    unsigned char header[RECORD_MAX_HEADER];
+    unsigned char existing[RECORD_MAX_HEADER];
+    size_t header_size = record_build_header(header);
+    struct stat st;
+
+    int fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (fd == -1) {
+        ERROR("%s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+
+    if (fstat(fd, &st) == -1) {
+        ERROR("%s: %s\n", path, strerror(errno));
+        goto fail;
+    }
+
+    if (st.st_size == 0) {
+        if (write(fd, header, header_size) != (ssize_t)header_size) {
+            ERROR("%s: failed to write header: %s\n", path, strerror(errno));
+            goto fail;
+        }
+    } else {
+        if ((size_t)st.st_size < header_size
+            || pread(fd, existing, header_size, 0) != (ssize_t)header_size
+            || memcmp(existing, header, header_size) != 0) {
+            ERROR("%s: not a log or written by a different version of isv\n", path);
+            goto fail;
+        }
+
+        /* drop a partially written record, if any */
+        size_t tail = ((size_t)st.st_size - header_size) % record_size();
+        if (tail) {
+            LOG("%s: truncating %zu bytes of an incomplete record\n", __func__, tail);
+            if (ftruncate(fd, st.st_size - (off_t)tail) == -1) {
+                ERROR("%s: %s\n", path, strerror(errno));
+                goto fail;
+            }
+        }
+    }
+
+    record_t *r = malloc(sizeof(record_t));
+    if (r == NULL) {
+        ERROR("%s: out of memory\n", __func__);
+        goto fail;
+    }
+    r->fd = fd;
+    r->record_size = record_size();
+    return r;
+
+fail:
+    close(fd);
+    return NULL;
+}
+
+/* Appends a sample. data is the validated response payload. */
+int record_write(record_t *r, int command_key, const char **args, const char *data)
+{
+    unsigned char buf[RECORD_HEADER_SIZE + RECORD_MAX_FIELDS * RECORD_VALUE_SIZE];
+    struct timespec ts;
+    record_msg_t m;
+    size_t index;
+
+    const record_type_t *type = record_type(command_key, &index);
+    if (type == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    type->unpack(data, &m);
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    memset(buf, 0, r->record_size);
+    put_u64(buf, (uint64_t)ts.tv_sec * 1000 + (uint64_t)(ts.tv_nsec / 1000000));
+    put_u16(buf + 8, (uint16_t)index);
+    put_u16(buf + 10, (args != NULL && args[0] != NULL)
+                      ? (uint16_t)atoi(args[0])
+                      : RECORD_NO_ID);
+
+    for (size_t i = 0; i < type->fields_count; i++)
+        put_u32(buf + RECORD_HEADER_SIZE + i * RECORD_VALUE_SIZE,
+                record_field_get(&m, &type->fields[i]));
+
+    /* O_APPEND and a single write keep records whole */
+    if (write(r->fd, buf, r->record_size) != (ssize_t)r->record_size) {
+        ERROR("%s: %s\n", __func__, strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+void record_close(record_t *r)
+{
+    close(r->fd);
+    free(r);
+}
+
+
+/* ------------------------------------------ */
+/* Replaying */
+
+typedef struct {
+    const record_type_t *type; /* NULL if unknown to this version */
+    long offsets[RECORD_MAX_FIELDS]; /* per type->fields, -1 if missing */
+} record_file_type_t;
+
+/* Matches types and fields described in the file header against ours. */
+static bool record_parse_header(const unsigned char *p,
+                                size_t file_size,
+                                size_t *header_size,
+                                size_t *rec_size,
+                                record_file_type_t *types,
+                                size_t *types_count)
+{
+    if (file_size < RECORD_FILE_HEADER_SIZE || memcmp(p, RECORD_MAGIC, RECORD_MAGIC_SIZE) != 0)
+        return false;
+
+    if (get_u32(p + 8) != RECORD_VERSION)
+        return false;
+
+    *header_size = get_u32(p + 12);
+    *rec_size = get_u32(p + 16);
+    *types_count = get_u32(p + 20);
+    if (*header_size > file_size
+        || *rec_size < RECORD_HEADER_SIZE
+        || *types_count > RECORD_MAX_TYPES)
+        return false;
+
+    size_t pos = RECORD_FILE_HEADER_SIZE;
+    for (size_t i = 0; i < *types_count; i++) {
+        char name[RECORD_FIELD_NAME_SIZE + 1] = {0};
+
+        if (pos + RECORD_TYPE_HEADER_SIZE > *header_size)
+            return false;
+        memcpy(name, p + pos, RECORD_TYPE_NAME_SIZE);
+        size_t fields_count = get_u32(p + pos + RECORD_TYPE_NAME_SIZE);
+        pos += RECORD_TYPE_HEADER_SIZE;
+
+        types[i].type = NULL;
+        for (size_t k = 0; k < ARRAY_SIZE(record_types); k++) {
+            if (!strcmp(record_types[k].name, name))
+                types[i].type = &record_types[k];
+        }
+        for (size_t k = 0; k < RECORD_MAX_FIELDS; k++)
+            types[i].offsets[k] = -1;
+
+        for (size_t j = 0; j < fields_count; j++) {
+            if (pos + RECORD_FIELD_HEADER_SIZE > *header_size)
+                return false;
+            memset(name, 0, sizeof(name));
+            memcpy(name, p + pos, RECORD_FIELD_NAME_SIZE);
+            uint32_t offset = get_u32(p + pos + RECORD_FIELD_NAME_SIZE);
+            uint32_t size = get_u32(p + pos + RECORD_FIELD_NAME_SIZE + 4);
+            pos += RECORD_FIELD_HEADER_SIZE;
+
+            /* offset + size could wrap around */
+            if (size != RECORD_VALUE_SIZE || size > *rec_size || offset > *rec_size - size)
+                return false;
+
+            const record_type_t *type = types[i].type;
+            for (size_t k = 0; type != NULL && k < type->fields_count; k++) {
+                if (!strcmp(type->fields[k].name, name))
+                    types[i].offsets[k] = offset;
+            }
+        }
+    }
+
+    return true;
+}
+
+int record_replay(const char *path, print_format_t format)
+{
+    record_file_type_t types[RECORD_MAX_TYPES];
+    size_t header_size, rec_size, types_count;
+    struct stat st;
+    int ret = 0;
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        ERROR("%s: %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    if (fstat(fd, &st) == -1) {
+        ERROR("%s: %s\n", path, strerror(errno));
+        close(fd);
+        return 1;
+    }
+
+    if (st.st_size == 0) {
+        ERROR("%s: not a log\n", path);
+        close(fd);
+        return 1;
+    }
+
+    size_t file_size = (size_t)st.st_size;
+    const unsigned char *p = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        ERROR("%s: mmap: %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    if (!record_parse_header(p, file_size, &header_size, &rec_size, types, &types_count)) {
+        ERROR("%s: not a log or written by an incompatible version of isv\n", path);
+        ret = 1;
+        goto end;
+    }
+
+    /* a csv or tsv stream has one set of columns, so it gets only samples
+       of the same kind as the first one */
+    bool one_kind = print_is_delimited_format(format);
+    size_t kind_type = SIZE_MAX;
+    uint16_t kind_id = RECORD_NO_ID;
+    size_t skipped = 0;
+
+    for (size_t pos = header_size; pos + rec_size <= file_size; pos += rec_size) {
+        const unsigned char *rec = p + pos;
+        size_t type_index = get_u16(rec + 8);
+        if (type_index >= types_count || types[type_index].type == NULL)
+            continue;
+
+        if (one_kind) {
+            if (kind_type == SIZE_MAX) {
+                kind_type = type_index;
+                kind_id = get_u16(rec + 10);
+            } else if (type_index != kind_type || get_u16(rec + 10) != kind_id) {
+                skipped++;
+                continue;
+            }
+        }
+
+        const record_file_type_t *ft = &types[type_index];
+        record_msg_t m;
+        memset(&m, 0, sizeof(m));
+        for (size_t i = 0; i < ft->type->fields_count; i++) {
+            if (ft->offsets[i] != -1)
+                record_field_set(&m, &ft->type->fields[i], get_u32(rec + ft->offsets[i]));
+        }
+
+        /* named the same way as in daemon mode */
+        char section[64];
+        uint16_t id = get_u16(rec + 10);
+        if (id != RECORD_NO_ID)
+            snprintf(section, sizeof(section), "%s_%u", ft->type->name, id);
+        else
+            snprintf(section, sizeof(section), "%s", ft->type->name);
+
+        print_begin(format);
+        print_section("sample", format);
+        print_sample(get_u64(rec), id != RECORD_NO_ID ? id : -1, format);
+        print_section(section, format);
+        ft->type->print(&m, format);
+        print_end(format);
+    }
+
+    if (skipped)
+        ERROR("%s: csv and tsv can't mix samples of different kinds, %zu skipped\n", path, skipped);
+
+end:
+    munmap((void *)p, file_size);
+    return ret;
+}
@@ -0,0 +1,71 @@
+/**
+ * Copyright (C) 2020  Evgeny Zinoviev
+ * This file is part of isv <https://github.com/gch1p/isv>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ISV_RECORD_H
+#define ISV_RECORD_H
+
+#include <stdbool.h>
+
+#include "print.h"
+
+/*
+ * Binary log of general status samples. All numbers are little-endian.
+ *
+ * The file starts with a header:
+ *
+ *     char     magic[8];        "ISVREC\0\0"
+ *     uint32_t version;         RECORD_VERSION
+ *     uint32_t header_size;     records start at this offset
+ *     uint32_t record_size;     all records have the same size
+ *     uint32_t types_count;
+ *
+ * followed by types_count type descriptors:
+ *
+ *     char     name[32];        e.g. "general_status"
+ *     uint32_t fields_count;
+ *
+ * each followed by fields_count field descriptors:
+ *
+ *     char     name[40];        e.g. "battery_voltage"
+ *     uint32_t offset;          from the start of the record
+ *     uint32_t size;            always 4 for now
+ *
+ * Records are:
+ *
+ *     uint64_t time;            unix time, in milliseconds
+ *     uint16_t type;            index of the type descriptor
+ *     uint16_t id;              parallel id, or 0xffff
+ *     uint32_t reserved;
+ *     uint32_t values[];        as described by the header
+ *
+ * Readers look fields up by name, so fields can be added, removed or
+ * reordered without breaking old files.
+ */
+
+#define RECORD_VERSION       1
+#define RECORD_NO_ID         0xffff
+
+typedef struct record record_t;
+
+bool record_supports(int command_key);
+record_t *record_open(const char *path);
+int record_write(record_t *r, int command_key, const char **args, const char *data);
+void record_close(record_t *r);
+int record_replay(const char *path, print_format_t format);
+
+#endif //ISV_RECORD_H
@@ -0,0 +1,176 @@
+/**
+ * Copyright (C) 2020  Evgeny Zinoviev
+ * This file is part of isv <https://github.com/gch1p/isv>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "scan.h"
+#include "engine.h"
+#include "query.h"
+#include "p18.h"
+#include "util.h"
+
+/*
+ * Every device is asked for the number of parallel machines (PIRI) and then
+ * for PGS of each of them. All devices are queried at the same time by the
+ * engine, in two rounds. Nothing is printed until both rounds are done, then
+ * the results are printed as one document, so the whole scan takes as long
+ * as the slowest device.
+ */
+
+typedef struct {
+    int result;
+    char error[QUERY_ERROR_LENGTH];
+    p18_parallel_general_status_msg_t msg;
+} scan_result_t;
+
+typedef struct {
+    const device_t *device;
+
+    int result;
+    char error[QUERY_ERROR_LENGTH];
+    size_t parallel_count;
+    scan_result_t results[SCAN_MAX_PARALLEL];
+} scan_device_t;
+
+static const char *scan_ids[SCAN_MAX_PARALLEL] = {"0", "1", "2", "3", "4", "5", "6", "7", "8"};
+
+/* Fills scans with the results of both rounds. */
+static void scan_run(scan_device_t *scans, size_t devices_count, int timeout, engine_job_t *jobs)
+{
+    for (size_t i = 0; i < devices_count; i++) {
+        engine_job_t *job = &jobs[i];
+        job->dev = scans[i].device->dev;
+        job->command_key = P18_QUERY_RATED_INFORMATION;
+        job->args = NULL;
+        job->args_size = 0;
+    }
+    engine_run(jobs, devices_count, timeout);
+
+    size_t jobs_count = 0;
+    for (size_t i = 0; i < devices_count; i++) {
+        scan_device_t *w = &scans[i];
+        w->result = jobs[i].result;
+        if (w->result != QUERY_OK) {
+            strcpy(w->error, jobs[i].error);
+            continue;
+        }
+
+        p18_rated_information_msg_t rated = p18_unpack_rated_information_msg(jobs[i].buf+5);
+        w->parallel_count = MIN(MAX(rated.parallel_max_num, 1), SCAN_MAX_PARALLEL);
+    }
+
+    for (size_t i = 0; i < devices_count; i++) {
+        scan_device_t *w = &scans[i];
+        if (w->result != QUERY_OK)
+            continue;
+
+        for (size_t id = 0; id < w->parallel_count; id++) {
+            engine_job_t *job = &jobs[jobs_count++];
+            job->dev = w->device->dev;
+            job->command_key = P18_QUERY_PARALLEL_GENERAL_STATUS;
+            job->args = &scan_ids[id];
+            job->args_size = 1;
+        }
+    }
+    engine_run(jobs, jobs_count, timeout);
+
+    jobs_count = 0;
+    for (size_t i = 0; i < devices_count; i++) {
+        scan_device_t *w = &scans[i];
+        if (w->result != QUERY_OK)
+            continue;
+
+        for (size_t id = 0; id < w->parallel_count; id++) {
+            scan_result_t *r = &w->results[id];
+            engine_job_t *job = &jobs[jobs_count++];
+            r->result = job->result;
+            if (r->result == QUERY_OK)
+                r->msg = p18_unpack_parallel_general_status_msg(job->buf+5);
+            else
+                strcpy(r->error, job->error);
+        }
+    }
+}
+
+static void scan_section_name(const scan_device_t *w, size_t id, char *buf, size_t bufsize)
+{
+    if (w->device->name != NULL)
+        snprintf(buf, bufsize, "%s.parallel_general_status_%zu", w->device->name, id);
+    else
+        snprintf(buf, bufsize, "parallel_general_status_%zu", id);
+}
+
+/* Returns the worst of the QUERY_* results. */
+int scan_parallel(const device_t *devices,
+                  size_t devices_count,
+                  int timeout,
+                  print_format_t format)
+{
+    char section[128];
+    int worst = QUERY_OK;
+
+    devices_count = MIN(devices_count, SCAN_MAX_DEVICES);
+    scan_device_t *scans = calloc(devices_count, sizeof(scan_device_t));
+    engine_job_t *jobs = calloc(devices_count * SCAN_MAX_PARALLEL, sizeof(engine_job_t));
+    if (scans == NULL || jobs == NULL) {
+        ERROR("%s: out of memory\n", __func__);
+        free(scans);
+        free(jobs);
+        return QUERY_ERR_COMM;
+    }
+
+    for (size_t i = 0; i < devices_count; i++)
+        scans[i].device = &devices[i];
+
+    scan_run(scans, devices_count, timeout, jobs);
+    free(jobs);
+
+    print_begin(format);
+    for (size_t i = 0; i < devices_count; i++) {
+        scan_device_t *w = &scans[i];
+
+        if (w->result != QUERY_OK) {
+            if (w->device->name != NULL)
+                snprintf(section, sizeof(section), "%s.rated_information", w->device->name);
+            else
+                snprintf(section, sizeof(section), "rated_information");
+            print_section(section, format);
+            print_error(format, "%s", w->error);
+            worst = MAX(worst, w->result);
+            continue;
+        }
+
+        for (size_t id = 0; id < w->parallel_count; id++) {
+            scan_result_t *r = &w->results[id];
+            scan_section_name(w, id, section, sizeof(section));
+            print_section(section, format);
+            if (r->result == QUERY_OK) {
+                print_parallel_general_status_msg(NULL, &r->msg, format);
+            } else {
+                print_error(format, "%s", r->error);
+                worst = MAX(worst, r->result);
+            }
+        }
+    }
+    print_end(format);
+
+    free(scans);
+    return worst;
+}
@@ -0,0 +1,35 @@
+/**
+ * Copyright (C) 2020  Evgeny Zinoviev
+ * This file is part of isv <https://github.com/gch1p/isv>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ISV_SCAN_H
+#define ISV_SCAN_H
+
+#include <stddef.h>
+
+#include "print.h"
+#include "device.h"
+
+#define SCAN_MAX_DEVICES   DEVICE_MAX
+#define SCAN_MAX_PARALLEL  9 /* parallel ids are single digits */
+
+int scan_parallel(const device_t *devices,
+                  size_t devices_count,
+                  int timeout,
+                  print_format_t format);
+
+#endif //ISV_SCAN_H
@@ -0,0 +1,407 @@
+/**
+ * Copyright (C) 2020  Evgeny Zinoviev
+ * This file is part of isv <https://github.com/gch1p/isv>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "server.h"
+#include "query.h"
+#include "device.h"
+#include "util.h"
+
+/*
+ * Protocol: a client sends one query per line, which is a --get-* option name
+ * without the "get-" prefix, followed by its arguments separated by spaces:
+ *
+ *     general-status
+ *     parallel-general-status 1
+ *
+ * and receives one line of JSON per query. Requests from all clients go
+ * through one FIFO queue and are executed one at a time; each client can have
+ * one request in the queue, so a request never waits for more than
+ * SERVER_MAX_CLIENTS-1 others. Identical requests waiting in the queue are
+ * answered with a single device round trip.
+ */
+
+typedef struct {
+    int fd;                /* -1 if the slot is free */
+    char in[SERVER_LINE_LENGTH];
+    size_t in_len;
+    bool discarding;       /* current line is too long, skipping it */
+    bool queued;
+    query_request_t request;
+    char request_buf[QUERY_LINE_LENGTH]; /* request.args point here */
+    char *out;
+    size_t out_len;
+    size_t out_pos;
+} server_client_t;
+
+static server_client_t clients[SERVER_MAX_CLIENTS];
+static int queue[SERVER_MAX_CLIENTS];
+static size_t queue_len = 0;
+
+static voltronic_dev_t dev = NULL;
+static unsigned int failures = 0;
+
+static int server_listen(const char *path)
+{
+    struct sockaddr_un addr;
+    struct stat st;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        ERROR("%s: socket path is too long\n", __func__);
+        return -1;
+    }
+
+    /* remove a stale socket left by a previous instance */
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) {
+        ERROR("%s: socket: %s\n", __func__, strerror(errno));
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1
+        || listen(fd, SERVER_MAX_CLIENTS) == -1) {
+        ERROR("%s: %s: %s\n", __func__, path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static void server_client_close(server_client_t *c)
+{
+    LOG("%s: client %d disconnected\n", __func__, c->fd);
+    close(c->fd);
+    free(c->out);
+
+    if (c->queued) {
+        int index = (int)(c - clients);
+        for (size_t i = 0; i < queue_len; i++) {
+            if (queue[i] == index) {
+                memmove(&queue[i], &queue[i+1], (queue_len-i-1) * sizeof(queue[0]));
+                queue_len--;
+                break;
+            }
+        }
+    }
+
+    memset(c, 0, sizeof(*c));
+    c->fd = -1;
+}
+
+static void server_accept(int listen_fd)
+{
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd == -1)
+        return;
+
+    for (size_t i = 0; i < ARRAY_SIZE(clients); i++) {
+        server_client_t *c = &clients[i];
+        if (c->fd != -1)
+            continue;
+
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        c->fd = fd;
+        LOG("%s: client %d connected\n", __func__, fd);
+        return;
+    }
+
+    ERROR("%s: too many clients\n", __func__);
+    close(fd);
+}
+
+static void server_append_output(server_client_t *c, const char *data, size_t len)
+{
+    char *out = realloc(c->out, c->out_len + len);
+    if (out == NULL) {
+        ERROR("%s: out of memory\n", __func__);
+        return;
+    }
+    memcpy(out + c->out_len, data, len);
+    c->out = out;
+    c->out_len += len;
+}
+
+static void server_respond_error(server_client_t *c, const char *message)
+{
+    char *buf = NULL;
+    size_t size = 0;
+    FILE *f = open_memstream(&buf, &size);
+    if (f == NULL)
+        return;
+
+    static const print_field_t fields[] = {
+        {.key= "error"}
+    };
+    const variant_t values[] = {
+        variant_string(message),
+    };
+    print_set_output(f);
+    print_json(fields, values, ARRAY_SIZE(fields), false);
+    print_set_output(NULL);
+    fclose(f);
+
+    server_append_output(c, buf, size);
+    free(buf);
+}
+
+static void server_process_input(server_client_t *c)
+{
+    while (!c->queued && c->out_len == 0) {
+        char *nl = memchr(c->in, '\n', c->in_len);
+        if (nl == NULL) {
+            if (c->in_len == sizeof(c->in)) {
+                c->discarding = true;
+                c->in_len = 0;
+            }
+            return;
+        }
+
+        *nl = '\0';
+        if (nl > c->in && *(nl-1) == '\r')
+            *(nl-1) = '\0';
+
+        char line[SERVER_LINE_LENGTH];
+        strcpy(line, c->in);
+        c->in_len -= (size_t)(nl - c->in) + 1;
+        memmove(c->in, nl + 1, c->in_len);
+
+        if (c->discarding) {
+            c->discarding = false;
+            server_respond_error(c, "line is too long");
+            continue;
+        }
+
+        if (*line == '\0')
+            continue;
+
+        const char *error = query_parse(line, &c->request, c->request_buf);
+        if (error != NULL) {
+            server_respond_error(c, error);
+            continue;
+        }
+
+        c->queued = true;
+        queue[queue_len++] = (int)(c - clients);
+    }
+}
+
+static void server_read(server_client_t *c)
+{
+    ssize_t n = read(c->fd, c->in + c->in_len, sizeof(c->in) - c->in_len);
+    if (n == 0 || (n == -1 && errno != EAGAIN && errno != EINTR)) {
+        server_client_close(c);
+        return;
+    }
+    if (n > 0) {
+        c->in_len += (size_t)n;
+        server_process_input(c);
+    }
+}
+
+static void server_write(server_client_t *c)
+{
+    ssize_t n = write(c->fd, c->out + c->out_pos, c->out_len - c->out_pos);
+    if (n == -1) {
+        if (errno != EAGAIN && errno != EINTR)
+            server_client_close(c);
+        return;
+    }
+
+    c->out_pos += (size_t)n;
+    if (c->out_pos == c->out_len) {
+        free(c->out);
+        c->out = NULL;
+        c->out_len = 0;
+        c->out_pos = 0;
+        server_process_input(c);
+    }
+}
+
+static bool server_same_request(const query_request_t *a, const query_request_t *b)
+{
+    if (a->command_key != b->command_key)
+        return false;
+    for (size_t i = 0; i < QUERY_MAX_ARGS; i++) {
+        if ((a->args[i] == NULL) != (b->args[i] == NULL))
+            return false;
+        if (a->args[i] != NULL && strcmp(a->args[i], b->args[i]) != 0)
+            return false;
+    }
+    return true;
+}
+
+static void server_execute_next(daemon_open_fn_t open_device,
+                                int timeout,
+                                print_format_t format)
+{
+    server_client_t *head = &clients[queue[0]];
+    char *buf = NULL;
+    size_t size = 0;
+    int result = QUERY_OK;
+
+    if (dev == NULL) {
+        dev = open_device();
+        failures = 0;
+    }
+
+    FILE *f = open_memstream(&buf, &size);
+    if (f == NULL) {
+        ERROR("%s: open_memstream: %s\n", __func__, strerror(errno));
+        return;
+    }
+
+    print_set_output(f);
+    if (dev == NULL) {
+        print_error(format, "could not open device: %s", strerror(errno));
+    } else {
+        result = query(dev, head->request.command_key, timeout,
+                       (const char **)head->request.args, QUERY_MAX_ARGS,
+                       false, head->request.fields, format);
+    }
+    print_set_output(NULL);
+    fclose(f);
+
+    /* answer the head of the queue and everyone waiting for the same thing */
+    for (size_t i = 0; i < queue_len;) {
+        server_client_t *c = &clients[queue[i]];
+        if (c != head && !server_same_request(&c->request, &head->request)) {
+            i++;
+            continue;
+        }
+        server_append_output(c, buf, size);
+        c->queued = false;
+        memmove(&queue[i], &queue[i+1], (queue_len-i-1) * sizeof(queue[0]));
+        queue_len--;
+    }
+    free(buf);
+
+    if (result == QUERY_OK) {
+        failures = 0;
+    } else if (result == QUERY_ERR_COMM) {
+        if (query_is_device_error(errno) || ++failures >= DAEMON_MAX_FAILURES) {
+            ERROR("reopening device\n");
+            /* it may come back as a different device */
+            device_close(dev);
+            dev = NULL;
+        }
+    }
+}
+
+int server_run(const char *socket_path,
+               daemon_open_fn_t open_device,
+               int timeout,
+               print_format_t format)
+{
+    struct pollfd pfds[SERVER_MAX_CLIENTS + 1];
+    int pfd_clients[SERVER_MAX_CLIENTS + 1];
+
+    /* responses are framed by newlines, so tables won't do */
+    if (!print_is_json_format(format))
+        format = PRINT_FORMAT_JSON;
+
+    for (size_t i = 0; i < ARRAY_SIZE(clients); i++)
+        clients[i].fd = -1;
+
+    int listen_fd = server_listen(socket_path);
+    if (listen_fd == -1)
+        return 1;
+
+    signal(SIGPIPE, SIG_IGN);
+    daemon_install_signal_handlers();
+
+    dev = open_device();
+    if (dev == NULL)
+        ERROR("could not open device: %s, will retry on request\n", strerror(errno));
+
+    while (!daemon_stopping()) {
+        nfds_t nfds = 0;
+
+        pfds[nfds].fd = listen_fd;
+        pfds[nfds].events = POLLIN;
+        pfd_clients[nfds++] = -1;
+
+        for (size_t i = 0; i < ARRAY_SIZE(clients); i++) {
+            server_client_t *c = &clients[i];
+            if (c->fd == -1)
+                continue;
+            pfds[nfds].fd = c->fd;
+            pfds[nfds].events = c->out_len != 0 ? POLLOUT : (c->queued ? 0 : POLLIN);
+            pfd_clients[nfds++] = (int)i;
+        }
+
+        /* don't block while there's work for the device */
+        if (poll(pfds, nfds, queue_len ? 0 : -1) == -1) {
+            if (errno == EINTR)
+                continue;
+            ERROR("%s: poll: %s\n", __func__, strerror(errno));
+            break;
+        }
+
+        for (nfds_t i = 0; i < nfds; i++) {
+            if (!pfds[i].revents)
+                continue;
+
+            if (pfd_clients[i] == -1) {
+                server_accept(listen_fd);
+                continue;
+            }
+
+            server_client_t *c = &clients[pfd_clients[i]];
+            if (pfds[i].revents & POLLOUT)
+                server_write(c);
+            else if (pfds[i].revents & (POLLIN | POLLHUP | POLLERR))
+                server_read(c);
+        }
+
+        if (queue_len)
+            server_execute_next(open_device, timeout, format);
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(clients); i++) {
+        if (clients[i].fd != -1)
+            server_client_close(&clients[i]);
+    }
+    close(listen_fd);
+    unlink(socket_path);
+
+    if (dev != NULL)
+        device_close(dev);
+
+    return 0;
+}
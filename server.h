@@ -0,0 +1,33 @@
+/**
+ * Copyright (C) 2020  Evgeny Zinoviev
+ * This file is part of isv <https://github.com/gch1p/isv>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ISV_SERVER_H
+#define ISV_SERVER_H
+
+#include "print.h"
+#include "daemon.h"
+
+#define SERVER_MAX_CLIENTS   64
+#define SERVER_LINE_LENGTH   128
+
+int server_run(const char *socket_path,
+               daemon_open_fn_t open_device,
+               int timeout,
+               print_format_t format);
+
+#endif //ISV_SERVER_H
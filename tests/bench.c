@@ -0,0 +1,106 @@
+/**
+ * Copyright (C) 2020  Evgeny Zinoviev
+ * This file is part of isv <https://github.com/gch1p/isv>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Benchmarks run by `make bench`. Each one prints the average time per
+ * operation; the numbers are only comparable on the same machine.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "p18.h"
+#include "print.h"
+#include "libvoltronic/voltronic_crc.h"
+
+/* data of a general status response, as the decoder gets it */
+static const char general_status_data[] =
+    "0000,000,2301,500,0114,0069,002,496,000,000,001,000,073,032,000,000,"
+    "0000,0000,0000,0000,1,0,0,1,2,2,0,0";
+
+/* keeps results from being optimized away */
+static volatile unsigned long bench_sink;
+
+static unsigned long long bench_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000 + (unsigned long long)ts.tv_nsec;
+}
+
+static void bench_report(const char *name, unsigned long long start, size_t iterations)
+{
+    double ns = (double)(bench_now_ns() - start) / (double)iterations;
+    printf("%-32s %10.1f ns/op\n", name, ns);
+}
+
+/* a general status response is about a hundred bytes long */
+static void bench_crc(void)
+{
+    static const size_t iterations = 2000000;
+    char frame[100];
+    for (size_t i = 0; i < sizeof(frame); i++)
+        frame[i] = (char)('0' + i % 10);
+
+    unsigned long long start = bench_now_ns();
+    for (size_t i = 0; i < iterations; i++) {
+        frame[0] = (char)i;
+        bench_sink += calculate_voltronic_crc(frame, sizeof(frame));
+    }
+    bench_report("crc, 100 bytes", start, iterations);
+}
+
+static void bench_decode(void)
+{
+    static const size_t iterations = 2000000;
+
+    unsigned long long start = bench_now_ns();
+    for (size_t i = 0; i < iterations; i++) {
+        p18_general_status_msg_t m = p18_unpack_general_status_msg(general_status_data);
+        bench_sink += (unsigned long)m.battery_voltage;
+    }
+    bench_report("decode, general status", start, iterations);
+}
+
+static void bench_format(print_format_t format, const char *name)
+{
+    static const size_t iterations = 200000;
+    char buf[PRINT_BUF_LENGTH];
+    print_t p;
+    p18_general_status_msg_t m = p18_unpack_general_status_msg(general_status_data);
+
+    unsigned long long start = bench_now_ns();
+    for (size_t i = 0; i < iterations; i++) {
+        print_init_buffer(&p, buf, sizeof(buf));
+        print_general_status_msg(&p, &m, format);
+        bench_sink += p.len;
+    }
+    bench_report(name, start, iterations);
+}
+
+int main(void)
+{
+    bench_crc();
+    bench_decode();
+    bench_format(PRINT_FORMAT_TABLE, "format, general status, table");
+    bench_format(PRINT_FORMAT_JSON, "format, general status, json");
+    return 0;
+}
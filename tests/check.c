@@ -0,0 +1,280 @@
+/**
+ * Copyright (C) 2020  Evgeny Zinoviev
+ * This file is part of isv <https://github.com/gch1p/isv>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Checks run by `make check`. Devices are faked with an implementation of
+ * voltronic_dev_impl_t that plays back canned input, so no inverter is needed.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "query.h"
+#include "p18.h"
+#include "libvoltronic/voltronic_crc.h"
+#include "libvoltronic/voltronic_dev_impl.h"
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+static int failures = 0;
+
+#if defined(CHECK_WRAP_MALLOC)
+/* linked with -Wl,--wrap=malloc, see the Makefile */
+static size_t allocations = 0;
+
+void *__real_malloc(size_t size);
+void *__wrap_malloc(size_t size)
+{
+    allocations++;
+    return __real_malloc(size);
+}
+#endif
+
+/* Plays back input, and swallows whatever is written. Input can be read
+   once something has been written, as a response comes after a command. */
+typedef struct {
+    char input[512];
+    size_t size;
+    size_t pos;
+    bool written;
+} check_dev_t;
+
+static int check_dev_read(void *impl_ptr, char *buffer, const size_t buffer_size,
+                          const unsigned int timeout_milliseconds)
+{
+    check_dev_t *d = (check_dev_t *)impl_ptr;
+    size_t n = d->written ? d->size - d->pos : 0;
+    (void)timeout_milliseconds;
+    if (n > buffer_size)
+        n = buffer_size;
+    memcpy(buffer, d->input + d->pos, n);
+    d->pos += n;
+    return (int)n;
+}
+
+static int check_dev_write(void *impl_ptr, const char *buffer, const size_t buffer_size,
+                           const unsigned int timeout_milliseconds)
+{
+    check_dev_t *d = (check_dev_t *)impl_ptr;
+    (void)buffer;
+    (void)timeout_milliseconds;
+    d->written = true;
+    return (int)buffer_size;
+}
+
+static int check_dev_close(void *impl_ptr)
+{
+    (void)impl_ptr;
+    return 1;
+}
+
+static const voltronic_dev_impl_t check_dev_impl = {
+    check_dev_read,
+    check_dev_write,
+    check_dev_close,
+    NULL
+};
+
+static voltronic_dev_t check_dev_open(check_dev_t *d)
+{
+    d->size = 0;
+    d->pos = 0;
+    d->written = false;
+    return voltronic_dev_internal_create(d, &check_dev_impl);
+}
+
+/* Appends a frame with data and its CRC to the device's input. If corrupt,
+   the data is changed after the CRC has been calculated. */
+static void check_dev_frame(check_dev_t *d, const char *data, bool corrupt)
+{
+    size_t len = strlen(data);
+    char *frame = d->input + d->size;
+    memcpy(frame, data, len);
+    write_voltronic_crc(calculate_voltronic_crc(data, len), frame + len);
+    frame[len + 2] = '\r';
+    if (corrupt)
+        frame[len - 1] ^= 1;
+    d->size += len + 3;
+}
+
+/* the original nibble-at-a-time CRC that the table one replaced */
+static voltronic_crc_t check_nibble_crc(const char *data, size_t len)
+{
+    static const voltronic_crc_t table[16] = {
+        0x0000, 0x1021, 0x2042, 0x3063,
+        0x4084, 0x50A5, 0x60C6, 0x70E7,
+        0x8108, 0x9129, 0xA14A, 0xB16B,
+        0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+    };
+    voltronic_crc_t crc = 0;
+    unsigned char byte;
+
+    if (!len)
+        return 0;
+
+    for (size_t i = 0; i < len; i++) {
+        byte = (unsigned char)data[i];
+        crc = table[(crc >> 12) ^ (byte >> 4)] ^ (crc << 4);
+        crc = table[(crc >> 12) ^ (byte & 0x0F)] ^ (crc << 4);
+    }
+
+    byte = (unsigned char)crc;
+    if (byte == 0x28 || byte == 0x0d || byte == 0x0a)
+        crc += 1;
+    byte = (unsigned char)(crc >> 8);
+    if (byte == 0x28 || byte == 0x0d || byte == 0x0a)
+        crc += 1 << 8;
+    return crc;
+}
+
+/* the table CRC, whole and in parts, matches the nibble one */
+static void check_crc(void)
+{
+    char data[300];
+    unsigned int seed = 1;
+    size_t mismatches = 0;
+
+    for (int round = 0; round < 2000; round++) {
+        size_t len = (size_t)round % sizeof(data);
+        for (size_t i = 0; i < len; i++) {
+            seed = seed * 1103515245 + 12345;
+            data[i] = (char)(seed >> 16);
+        }
+
+        voltronic_crc_t expected = check_nibble_crc(data, len);
+        if (calculate_voltronic_crc(data, len) != expected)
+            mismatches++;
+
+        if (len) {
+            size_t half = len / 2;
+            voltronic_crc_t crc = update_voltronic_crc(0, data, half);
+            crc = finish_voltronic_crc(update_voltronic_crc(crc, data + half, len - half));
+            if (crc != expected)
+                mismatches++;
+        }
+    }
+    CHECK(mismatches == 0);
+}
+
+static void check_bad_crc(void)
+{
+    check_dev_t d;
+    char buf[RESPONSE_BUF_LENGTH];
+    size_t received;
+    int result;
+
+    voltronic_dev_t dev = check_dev_open(&d);
+    check_dev_frame(&d, "^D00518", false);
+    check_dev_frame(&d, "^D00518", true);
+    check_dev_frame(&d, "^D00518", true);
+    d.written = true;
+
+    result = voltronic_dev_receive(dev, 0, buf, sizeof(buf), &received, 10);
+    CHECK(result == 7 && !strcmp(buf, "^D00518"));
+
+    errno = 0;
+    result = voltronic_dev_receive(dev, 0, buf, sizeof(buf), &received, 10);
+    CHECK(result == 0 && errno == EBADMSG);
+
+    result = voltronic_dev_receive(dev, DISABLE_VERIFY_VOLTRONIC_CRC, buf, sizeof(buf), &received, 10);
+    CHECK(result == 7);
+
+    voltronic_dev_close(dev);
+}
+
+/* a frame that fails the CRC is skipped, and the response after it is taken */
+static void check_bad_crc_resync(void)
+{
+    check_dev_t d;
+    char buf[RESPONSE_BUF_LENGTH];
+    char command[COMMAND_BUF_LENGTH];
+    char error[QUERY_ERROR_LENGTH];
+    p18_frame_t frame_buf;
+    size_t received;
+
+    voltronic_dev_t dev = check_dev_open(&d);
+    check_dev_frame(&d, "^D00518", true);
+    check_dev_frame(&d, "^D00518", false);
+
+    const p18_frame_t *frame = query_prepare(P18_QUERY_PROTOCOL_ID, NULL, 0, &frame_buf,
+                                             command, error, sizeof(error));
+    CHECK(frame != NULL);
+    if (frame != NULL) {
+        int result = query_transfer(dev, P18_QUERY_PROTOCOL_ID, frame, command, 100,
+                                    buf, sizeof(buf), &received, error, sizeof(error));
+        CHECK(result == QUERY_OK && !strcmp(buf, "^D00518"));
+    }
+
+    voltronic_dev_close(dev);
+}
+
+#if defined(CHECK_WRAP_MALLOC)
+/* commands are framed on the stack, only unusually long ones on the heap */
+static void check_send_allocations(void)
+{
+    check_dev_t d;
+    char command[COMMAND_BUF_LENGTH];
+    char error[QUERY_ERROR_LENGTH];
+    char long_command[300];
+    p18_frame_t frame_buf;
+
+    voltronic_dev_t dev = check_dev_open(&d);
+    const p18_frame_t *frame = query_prepare(P18_QUERY_GENERAL_STATUS, NULL, 0, &frame_buf,
+                                             command, error, sizeof(error));
+    CHECK(frame != NULL);
+    if (frame == NULL)
+        return;
+
+    allocations = 0;
+    CHECK(voltronic_dev_send(dev, WRITE_FRAMED_VOLTRONIC_INPUT, frame->data, frame->size, 10) == 1);
+    CHECK(voltronic_dev_send(dev, 0, "^P005GS", 7, 10) == 1);
+    CHECK(allocations == 0);
+
+    memset(long_command, 'A', sizeof(long_command));
+    CHECK(voltronic_dev_send(dev, 0, long_command, sizeof(long_command), 10) == 1);
+    CHECK(allocations == 1);
+
+    voltronic_dev_close(dev);
+}
+#endif
+
+int main(void)
+{
+    check_crc();
+    check_bad_crc();
+    check_bad_crc_resync();
+#if defined(CHECK_WRAP_MALLOC)
+    check_send_allocations();
+#endif
+
+    if (failures) {
+        fprintf(stderr, "%d %s failed\n", failures, failures > 1 ? "checks" : "check");
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
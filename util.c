@@ -16,17 +16,23 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <ctype.h>
 #include <string.h>
 #include <stdbool.h>
+#include <time.h>
 
 #include "util.h"
 
 #define HEXDUMP_COLS 8
 
+/* set by isv -v, enables LOG() and HEXDUMP() */
+bool g_verbose = false;
+
 /* based on: https://gist.github.com/richinseattle/c527a3acb6f152796a580401057c78b4 */
-void hexdump(void *mem, unsigned int len)
+void hexdump(const void *mem, unsigned int len)
 {
     unsigned int i, j;
 
@@ -37,7 +43,7 @@ void hexdump(void *mem, unsigned int len)
 
         if (i < len)
             /* Print hex data */
-            printf("%02x ", 0xFF & ((char *) mem)[i]);
+            printf("%02x ", 0xFF & ((const char *) mem)[i]);
         else
             /* End of block, just aligning for ASCII dump */
             printf("   ");
@@ -48,9 +54,9 @@ void hexdump(void *mem, unsigned int len)
                 if (j >= len)
                     /* end of block, not really printing */
                     putchar(' ');
-                else if (isprint(((char *) mem)[j]))
+                else if (isprint(((const char *) mem)[j]))
                     /* printable char */
-                    putchar(0xFF & ((char *) mem)[j]);
+                    putchar(0xFF & ((const char *) mem)[j]);
                 else
                     /* other char */
                     putchar('.');
@@ -113,3 +119,39 @@ bool instrarray(const char *needle, const char **list, size_t list_size, int *in
     }
     return found;
 }
+
+unsigned long long monotonic_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+unsigned long long realtime_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (unsigned long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void sleep_until_ms(unsigned long long deadline)
+{
+    struct timespec ts = {
+        .tv_sec = (time_t)(deadline / 1000),
+        .tv_nsec = (long)(deadline % 1000) * 1000000
+    };
+    /* an absolute deadline doesn't move however late we get here,
+       so lateness of one wakeup isn't carried over to the next.
+       May return early if interrupted by a signal */
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+void sleep_ms(unsigned int ms)
+{
+    struct timespec ts = {
+        .tv_sec = ms / 1000,
+        .tv_nsec = (long)(ms % 1000) * 1000000
+    };
+    /* may return early if interrupted by a signal */
+    nanosleep(&ts, NULL);
+}
@@ -29,6 +29,7 @@ extern bool g_verbose;
 #define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
 #define UNUSED(x)     (void)(x)
 #define MIN(x, y)     ((x) < (y) ? (x) : (y))
+#define MAX(x, y)     ((x) > (y) ? (x) : (y))
 
 #define LOG(f_, ...) \
     if (g_verbose) fprintf(stderr, (f_), ##__VA_ARGS__)
@@ -48,10 +49,15 @@ extern bool g_verbose;
 #define FOREACH(item, array) \
     FOREACH_OFSIZE(item, array, ARRAY_SIZE(array))
 
-void hexdump(void *mem, unsigned int len);
+void hexdump(const void *mem, unsigned int len);
 void substr_copy(char *dst, const char *src, int len);
 bool isnumeric(const char *s);
 bool isdatevalid(int y, int m, int d);
 bool instrarray(const char *needle, const char **list, size_t list_size, int *index);
+unsigned long long monotonic_ms(void);
+unsigned long long realtime_ms(void);
+void sleep_ms(unsigned int ms);
+/* sleeps until monotonic_ms() reaches deadline */
+void sleep_until_ms(unsigned long long deadline);
 
 #endif //ISV_UTIL_H
@@ -35,6 +35,16 @@ variant_t variant_long(long l)
     return v;
 }
 
+/* a decimal value, mantissa / 10^scale, that is never converted to double */
+variant_t variant_fixed(long mantissa, short scale)
+{
+    variant_t v;
+    v.type = VARIANT_TYPE_FIXED;
+    v.l = mantissa;
+    v.scale = scale;
+    return v;
+}
+
 variant_t variant_bool(bool b)
 {
     variant_t v;
@@ -83,4 +93,17 @@ inline bool variant_is_flag(variant_t v)
 inline bool variant_is_double(variant_t v)
 {
     return v.type == VARIANT_TYPE_DOUBLE;
-}
\ No newline at end of file
+}
+inline bool variant_is_fixed(variant_t v)
+{
+    return v.type == VARIANT_TYPE_FIXED;
+}
+
+/* 10^scale */
+long variant_fixed_divisor(short scale)
+{
+    long divisor = 1;
+    while (scale-- > 0)
+        divisor *= 10;
+    return divisor;
+}
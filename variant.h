@@ -20,25 +20,32 @@
 #define ISV_VARIANT_H
 
 #include <stdbool.h>
+#include <stddef.h>
 
 typedef enum {
     VARIANT_TYPE_STRING,
     VARIANT_TYPE_LONG,
     VARIANT_TYPE_DOUBLE,
+    VARIANT_TYPE_FIXED,
     VARIANT_TYPE_BOOL,
     VARIANT_TYPE_FLAG,
 } variant_type_t;
 
+/* 16 bytes on LP64: type selects the union member that holds the value */
 typedef struct {
     variant_type_t type;
-    double d;
-    long l;
-    bool b;
-    const char *s;
+    short scale; /* of a fixed-point value, l / 10^scale */
+    union {
+        double d;
+        long l;  /* also the mantissa of a fixed-point value */
+        bool b;
+        const char *s;
+    };
 } variant_t;
 
 variant_t variant_double(double d);
 variant_t variant_long(long l);
+variant_t variant_fixed(long mantissa, short scale);
 variant_t variant_bool(bool b);
 variant_t variant_flag(bool b);
 variant_t variant_string(const char *s);
@@ -50,5 +57,8 @@ bool variant_is_long(variant_t v);
 bool variant_is_bool(variant_t v);
 bool variant_is_flag(variant_t v);
 bool variant_is_double(variant_t v);
+bool variant_is_fixed(variant_t v);
+
+long variant_fixed_divisor(short scale);
 
 #endif //ISV_VARIANT_H